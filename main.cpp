@@ -2,10 +2,9 @@
 #include <cstdlib>
 #include <iostream>
 
-int main() {
-  Volcano volcano;
-
+int main(int argc, char** argv) {
   try {
+    Volcano volcano(parseCommandLine(argc, argv));
     volcano.run();
   } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
@@ -0,0 +1,224 @@
+#include "config.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+VolcanoConfig parseCommandLine(int argc, char** argv)
+{
+  VolcanoConfig config;
+
+  for (int i = 1; i < argc; i++)
+  {
+    auto nextValue = [&]() -> const char*
+    {
+      if (i + 1 >= argc)
+      {
+        throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+      }
+      return argv[++i];
+    };
+
+    if (strcmp(argv[i], "--mesh") == 0)
+    {
+      config.meshPath = nextValue();
+    }
+    else if (strcmp(argv[i], "--grid") == 0)
+    {
+      config.grid = std::max(1, std::atoi(nextValue()));
+    }
+    else if (strcmp(argv[i], "--lod-threshold") == 0)
+    {
+      config.lodThresholdPixels = static_cast<float>(std::atof(nextValue()));
+    }
+    else if (strcmp(argv[i], "--no-lod") == 0)
+    {
+      config.lodEnabled = false;
+    }
+    else if (strcmp(argv[i], "--present-mode") == 0)
+    {
+      config.presentMode = nextValue();
+    }
+    else if (strcmp(argv[i], "--swapchain-images") == 0)
+    {
+      config.swapChainImages = static_cast<uint32_t>(std::max(0, std::atoi(nextValue())));
+    }
+    else if (strcmp(argv[i], "--frames-in-flight") == 0)
+    {
+      config.framesInFlight = static_cast<uint32_t>(std::clamp(std::atoi(nextValue()), 1, MAX_FRAMES_IN_FLIGHT));
+    }
+    else if (strcmp(argv[i], "--fps-limit") == 0)
+    {
+      config.fpsLimit = std::max(0.0, std::atof(nextValue()));
+    }
+    else if (strcmp(argv[i], "--device") == 0)
+    {
+      config.deviceOverride = nextValue();
+    }
+    else if (strcmp(argv[i], "--list-devices") == 0)
+    {
+      config.listDevices = true;
+    }
+    else if (strcmp(argv[i], "--renderer") == 0)
+    {
+      const char* renderer = nextValue();
+      if (strcmp(renderer, "forward") != 0 && strcmp(renderer, "deferred") != 0)
+      {
+        throw std::runtime_error(std::string("Unknown renderer: ") + renderer);
+      }
+      config.deferredShading = strcmp(renderer, "deferred") == 0;
+    }
+    else if (strcmp(argv[i], "--lights") == 0)
+    {
+      config.lightCount = static_cast<uint32_t>(std::clamp(std::atoi(nextValue()), 0, MAX_LIGHTS));
+    }
+    else if (strcmp(argv[i], "--light-benchmark") == 0)
+    {
+      config.lightBenchmark = true;
+    }
+    else if (strcmp(argv[i], "--no-shadows") == 0)
+    {
+      config.shadows = false;
+    }
+    else if (strcmp(argv[i], "--no-shadow-cache") == 0)
+    {
+      config.shadowCache = false;
+    }
+    else if (strcmp(argv[i], "--no-post") == 0)
+    {
+      config.postProcessing = false;
+    }
+    else if (strcmp(argv[i], "--exposure") == 0)
+    {
+      config.exposure = static_cast<float>(std::atof(nextValue()));
+    }
+    else if (strcmp(argv[i], "--dynamic-resolution") == 0)
+    {
+      config.dynamicResolution = true;
+    }
+    else if (strcmp(argv[i], "--gpu-budget") == 0)
+    {
+      config.gpuBudgetMs = std::max(std::atof(nextValue()), 0.1);
+    }
+    else if (strcmp(argv[i], "--render-scale") == 0)
+    {
+      config.renderScale = std::clamp(static_cast<float>(std::atof(nextValue())), RENDER_SCALE_MIN, 1.0f);
+    }
+    else if (strcmp(argv[i], "--occlusion-culling") == 0)
+    {
+      config.occlusionCulling = true;
+    }
+    else if (strcmp(argv[i], "--async-compute") == 0)
+    {
+      config.asyncCompute = true;
+    }
+    else if (strcmp(argv[i], "--capture") == 0)
+    {
+      config.capturePath = nextValue();
+    }
+    else if (strcmp(argv[i], "--capture-frames") == 0)
+    {
+      config.captureFrames = static_cast<uint32_t>(std::max(0, std::atoi(nextValue())));
+    }
+    else if (strcmp(argv[i], "--capture-after") == 0)
+    {
+      config.captureAfter = static_cast<uint32_t>(std::max(0, std::atoi(nextValue())));
+    }
+    else if (strcmp(argv[i], "--headless") == 0)
+    {
+      config.headless = true;
+    }
+    else if (strcmp(argv[i], "--freeze-time") == 0)
+    {
+      config.freezeTime = std::max(0.0, std::atof(nextValue()));
+    }
+    else if (strcmp(argv[i], "--report") == 0)
+    {
+      config.reportPath = nextValue();
+    }
+    else if (strcmp(argv[i], "--gpu-timings") == 0)
+    {
+      config.gpuTimings = true;
+    }
+    else if (strcmp(argv[i], "--sim-rate") == 0)
+    {
+      config.simRate = std::clamp(std::atof(nextValue()), 1.0, 1000.0);
+    }
+    else if (strcmp(argv[i], "--sim-benchmark") == 0)
+    {
+      config.simBenchmark = true;
+    }
+    else if (strcmp(argv[i], "--legacy-render-pass") == 0)
+    {
+      config.legacyRenderPass = true;
+    }
+    else if (strcmp(argv[i], "--system-allocator") == 0)
+    {
+      config.systemAllocator = true;
+    }
+    else if (strcmp(argv[i], "--memory-budget") == 0)
+    {
+      config.memoryBudget = std::clamp(std::atof(nextValue()), 0.1, 1.0);
+    }
+    else if (strcmp(argv[i], "--world") == 0)
+    {
+      config.worldPath = nextValue();
+    }
+    else if (strcmp(argv[i], "--generate-world") == 0)
+    {
+      config.generateWorldCells = static_cast<uint32_t>(std::clamp(std::atoi(nextValue()), 0, 1024));
+    }
+    else if (strcmp(argv[i], "--world-radius") == 0)
+    {
+      config.worldRadius = std::clamp(static_cast<float>(std::atof(nextValue())), 1.0f, 32.0f);
+    }
+    else if (strcmp(argv[i], "--io-threads") == 0)
+    {
+      config.ioThreads = static_cast<uint32_t>(std::clamp(std::atoi(nextValue()), 1, 16));
+    }
+    else if (strcmp(argv[i], "--pipeline-cache") == 0)
+    {
+      config.pipelineCachePath = nextValue();
+    }
+    else if (strcmp(argv[i], "--no-pipeline-cache") == 0)
+    {
+      config.pipelineCachePath.clear();
+    }
+    else if (strcmp(argv[i], "--serial-startup") == 0)
+    {
+      config.serialStartup = true;
+    }
+    else if (strcmp(argv[i], "--watch-shaders") == 0)
+    {
+      config.watchShaders = true;
+    }
+    else if (strcmp(argv[i], "--trace") == 0)
+    {
+      config.tracePath = nextValue();
+    }
+    else
+    {
+      throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+    }
+  }
+
+  //Clustered lighting is the forward renderer's, there is nothing to benchmark in deferred
+  if (config.lightBenchmark)
+  {
+    config.deferredShading = false;
+  }
+
+  if (config.generateWorldCells > 0 && config.worldPath.empty())
+  {
+    throw std::runtime_error("--generate-world needs --world to write to");
+  }
+
+  //Nothing else would ever close it
+  if (config.headless && (config.capturePath.empty() || config.captureFrames == 0) && !config.lightBenchmark &&
+      !config.simBenchmark)
+  {
+    throw std::runtime_error("--headless needs --capture with --capture-frames, or a benchmark, to end the run");
+  }
+
+  return config;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#define MAX_FRAMES_IN_FLIGHT 4
+#define MAX_LIGHTS 16384
+#define RENDER_SCALE_MIN 0.25f
+
+//Everything that can be set from the command line, parsed once in main and handed to Volcano
+struct VolcanoConfig
+{
+  //.obj files are imported and optimized on load, .vmesh files are loaded as is, empty draws the built-in triangle
+  std::string meshPath;
+
+  //The mesh is instanced on a grid x grid layout, the camera dollies through it
+  int grid = 1;
+
+  //LOD selection: coarsest level whose error projects to at most this many pixels
+  bool lodEnabled = true;
+  float lodThresholdPixels = 1.0f;
+
+  //Presentation: empty present mode keeps the old MAILBOX-else-FIFO choice, 0 images means minImageCount + 1
+  std::string presentMode;
+  uint32_t swapChainImages = 0;
+  uint32_t framesInFlight = 2;
+  double fpsLimit = 0.0;
+
+  //Device selection: case insensitive name substring or deviceUUID, empty picks the best scored device
+  std::string deviceOverride;
+  bool listDevices = false;
+
+  //Forward shades in the mesh pass, deferred writes a G-buffer and lights it in a second subpass
+  bool deferredShading = false;
+
+  //Dynamic lights for the clustered forward renderer, the benchmark sweeps its own counts and exits
+  uint32_t lightCount = 256;
+  bool lightBenchmark = false;
+
+  //Cascaded sun shadows, the cache keeps cascades until the camera leaves them (off re-renders every frame)
+  bool shadows = true;
+  bool shadowCache = true;
+
+  //HDR scene color + compute bloom + tonemap, off renders straight into the swapchain. Exposure is in stops.
+  bool postProcessing = true;
+  float exposure = 0.0f;
+
+  //Renders the scene into a scaled part of the scene color and upscales it in the tonemap pass (needs post
+  //processing). Dynamic resolution moves the scale every few frames to keep the GPU frame time under the budget,
+  //renderScale is where it starts, or the fixed scale without it.
+  bool dynamicResolution = false;
+  double gpuBudgetMs = 16.6;
+  float renderScale = 1.0f;
+
+  //Draws last frame's visible objects, builds a Hi-Z pyramid from their depth, tests the rest against it on the GPU
+  //and draws the newly visible ones in a second indirect pass. Forward renderer with dynamic rendering only.
+  bool occlusionCulling = false;
+
+  //Runs light binning on a separate compute queue (dedicated family, else a second graphics queue) so it overlaps
+  //the shadow pass and vertex work, the main pass waits on a semaphore. Forward renderer only.
+  bool asyncCompute = false;
+
+  //Frame capture, see FrameEncoder for the target syntax. 0 frames captures until the window closes, otherwise
+  //the app exits once that many frames are written.
+  std::string capturePath;
+  uint32_t captureFrames = 0;
+  //Frames rendered before the capture starts, lets temporal effects and streaming settle first
+  uint32_t captureAfter = 0;
+
+  //No window: renders into a VK_EXT_headless_surface swapchain of the window's size, for capture on machines
+  //without a display. Nothing closes it, so it needs something that ends the run (--capture-frames, a benchmark).
+  bool headless = false;
+
+  //Camera and lights stay at this simulation time instead of moving, negative runs the simulation as usual
+  double freezeTime = -1.0;
+
+  //Frame time and allocation counters written as "name value" lines at exit, see Volcano::writeReport
+  std::string reportPath;
+
+  //GPU timestamps on every timeline range, averages printed with the stats line
+  bool gpuTimings = false;
+
+  //Fixed simulation tick rate, independent of the frame rate. The benchmark loads the sim and render threads in turn.
+  double simRate = 120.0;
+  bool simBenchmark = false;
+
+  //Forces the VkRenderPass/VkFramebuffer path even when dynamic rendering is available
+  bool legacyRenderPass = false;
+
+  //Hands the driver nullptr allocation callbacks instead of the tracking host allocator
+  bool systemAllocator = false;
+
+  //Share of the device local memory budget to stay under, streamed data is evicted above it
+  double memoryBudget = 0.9;
+
+  //Streamed world (.vworld), cells within worldRadius cells of the camera or of where it is headed are kept resident.
+  //generateWorldCells writes a synthetic N x N cell world to worldPath first, 0 uses the file as is.
+  std::string worldPath;
+  uint32_t generateWorldCells = 0;
+  float worldRadius = 3.0f;
+  uint32_t ioThreads = 2;
+
+  //Driver pipeline cache file, read at startup and written at exit. Empty keeps the cache in memory only.
+  std::string pipelineCachePath = "pipeline_cache.bin";
+
+  //Runs the startup tasks one after another on the main thread instead of overlapping them, for comparison
+  bool serialStartup = false;
+
+  //Rebuilds the mesh pipelines when the volcano-shaders target rewrites their .spv files, checked once a second
+  bool watchShaders = false;
+
+  //Chrome trace JSON written at exit, empty disables the CPU scopes and GPU timestamps at runtime
+  std::string tracePath;
+};
+
+VolcanoConfig parseCommandLine(int argc, char** argv);
@@ -0,0 +1,34 @@
+#include "mesh.hpp"
+#include <algorithm>
+#include <limits>
+
+void MeshData::computeBounds()
+{
+  if (vertices.empty())
+  {
+    return;
+  }
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    boundsMin[axis] = std::numeric_limits<float>::max();
+    boundsMax[axis] = std::numeric_limits<float>::lowest();
+  }
+
+  for (const auto& vertex : vertices)
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      boundsMin[axis] = std::min(boundsMin[axis], vertex.position[axis]);
+      boundsMax[axis] = std::max(boundsMax[axis], vertex.position[axis]);
+    }
+  }
+}
+
+void MeshData::ensureLods()
+{
+  if (lods.empty())
+  {
+    lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Interleaved vertex layout shared by the importer, the binary mesh format and the pipeline
+struct Vertex
+{
+  float position[3];
+  float normal[3];
+  float texCoord[2];
+};
+
+#define MAX_MESH_LODS 8
+
+//A range of MeshData::indices, error is how far (in object space) this level may deviate from LOD 0
+struct MeshLod
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+};
+
+struct MeshData
+{
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+
+  //Finest first, empty until a LOD chain is built (see buildLodChain)
+  std::vector<MeshLod> lods;
+
+  float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+  float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+
+  void computeBounds();
+
+  //Meshes without a chain get a single LOD covering all indices
+  void ensureLods();
+};
@@ -0,0 +1,89 @@
+#include "meshfile.hpp"
+#include "../utils/fileread.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+void writeMeshFile(const std::string& filename, const MeshData& mesh)
+{
+  std::vector<MeshLod> lods = mesh.lods;
+  if (lods.empty())
+  {
+    lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+  }
+
+  MeshFileHeader header{};
+  header.magic = MESH_FILE_MAGIC;
+  header.version = MESH_FILE_VERSION;
+  header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+  header.lodCount = static_cast<uint32_t>(lods.size());
+  std::memcpy(header.boundsMin, mesh.boundsMin, sizeof(header.boundsMin));
+  std::memcpy(header.boundsMax, mesh.boundsMax, sizeof(header.boundsMax));
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    throw std::runtime_error("failed to open mesh file for writing!");
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshLod));
+  file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+  file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+
+  if (!file)
+  {
+    throw std::runtime_error("failed to write mesh file!");
+  }
+}
+
+MeshData loadMeshFile(const std::string& filename)
+{
+  std::vector<char> buffer = readFile(filename);
+
+  if (buffer.size() < sizeof(MeshFileHeader))
+  {
+    throw std::runtime_error("Mesh file is truncated!");
+  }
+
+  MeshFileHeader header;
+  std::memcpy(&header, buffer.data(), sizeof(header));
+
+  if (header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION)
+  {
+    throw std::runtime_error("Not a supported mesh file, rebuild it with volcano-meshc!");
+  }
+
+  size_t lodBytes = static_cast<size_t>(header.lodCount) * sizeof(MeshLod);
+  size_t vertexBytes = static_cast<size_t>(header.vertexCount) * sizeof(Vertex);
+  size_t indexBytes = static_cast<size_t>(header.indexCount) * sizeof(uint32_t);
+
+  if (header.lodCount == 0 || header.lodCount > MAX_MESH_LODS ||
+      buffer.size() < sizeof(header) + lodBytes + vertexBytes + indexBytes)
+  {
+    throw std::runtime_error("Mesh file is truncated!");
+  }
+
+  MeshData mesh;
+  mesh.lods.resize(header.lodCount);
+  mesh.vertices.resize(header.vertexCount);
+  mesh.indices.resize(header.indexCount);
+
+  const char* data = buffer.data() + sizeof(header);
+  std::memcpy(mesh.lods.data(), data, lodBytes);
+  std::memcpy(mesh.vertices.data(), data + lodBytes, vertexBytes);
+  std::memcpy(mesh.indices.data(), data + lodBytes + vertexBytes, indexBytes);
+  std::memcpy(mesh.boundsMin, header.boundsMin, sizeof(mesh.boundsMin));
+  std::memcpy(mesh.boundsMax, header.boundsMax, sizeof(mesh.boundsMax));
+
+  for (const MeshLod& lod : mesh.lods)
+  {
+    if (static_cast<size_t>(lod.firstIndex) + lod.indexCount > mesh.indices.size())
+    {
+      throw std::runtime_error("Mesh file LOD range is out of bounds!");
+    }
+  }
+
+  return mesh;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "mesh.hpp"
+#include <string>
+
+//Binary mesh layout (.vmesh), little endian:
+//  MeshFileHeader
+//  MeshLod  lods[lodCount]
+//  Vertex   vertices[vertexCount]
+//  uint32_t indices[indexCount]
+#define MESH_FILE_MAGIC 0x48534D56u // "VMSH"
+#define MESH_FILE_VERSION 2
+
+struct MeshFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t lodCount;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+void writeMeshFile(const std::string& filename, const MeshData& mesh);
+
+//One read of the whole file, the arrays are copied straight out of that buffer
+MeshData loadMeshFile(const std::string& filename);
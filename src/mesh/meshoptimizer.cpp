@@ -0,0 +1,230 @@
+#include "meshoptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+//Modelled cache size for the optimizer, bigger than VERTEX_CACHE_SIZE so it also does well on larger caches
+const int32_t kOptimizerCacheSize = 32;
+const size_t kMaxValence = 64;
+
+float vertexScoreTable[kOptimizerCacheSize + 3][kMaxValence + 1];
+bool vertexScoreTableReady = false;
+
+float computeVertexScore(int32_t cachePosition, uint32_t remainingTriangles)
+{
+  if (remainingTriangles == 0)
+  {
+    //No triangle needs this vertex anymore
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cachePosition >= 0)
+  {
+    if (cachePosition < 3)
+    {
+      //Used by the last triangle, fixed score so the strip-like walk doesn't get preferred over fans
+      score = 0.75f;
+    }
+    else if (cachePosition < kOptimizerCacheSize)
+    {
+      float scaler = 1.0f / (kOptimizerCacheSize - 3);
+      score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+    }
+  }
+
+  //Boost vertices with few triangles left so lonely triangles get finished off
+  score += 2.0f * std::pow(static_cast<float>(remainingTriangles), -0.5f);
+  return score;
+}
+
+void buildVertexScoreTable()
+{
+  if (vertexScoreTableReady)
+    return;
+
+  for (int32_t cachePosition = -1; cachePosition < kOptimizerCacheSize + 2; cachePosition++)
+  {
+    for (uint32_t valence = 0; valence <= kMaxValence; valence++)
+    {
+      vertexScoreTable[cachePosition + 1][valence] = computeVertexScore(cachePosition, valence);
+    }
+  }
+  vertexScoreTableReady = true;
+}
+
+inline float vertexScore(int32_t cachePosition, uint32_t remainingTriangles)
+{
+  if (cachePosition >= kOptimizerCacheSize)
+    cachePosition = -1;
+  return vertexScoreTable[cachePosition + 1][std::min<size_t>(remainingTriangles, kMaxValence)];
+}
+
+}
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount)
+{
+  buildVertexScoreTable();
+
+  const size_t triangleCount = indices.size() / 3;
+  std::vector<uint32_t> result;
+  result.reserve(triangleCount * 3);
+
+  if (triangleCount == 0)
+    return result;
+
+  //Vertex -> triangle adjacency as one flat array, the live part of each range shrinks as triangles get emitted
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++)
+    remaining[indices[i]]++;
+
+  std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++)
+    adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+  std::vector<uint32_t> adjacency(triangleCount * 3);
+  {
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+      for (size_t corner = 0; corner < 3; corner++)
+        adjacency[fill[indices[t * 3 + corner]]++] = static_cast<uint32_t>(t);
+    }
+  }
+
+  std::vector<float> scores(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++)
+    scores[v] = vertexScore(-1, remaining[v]);
+
+  std::vector<bool> emitted(triangleCount, false);
+
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> nextCache;
+  cache.reserve(kOptimizerCacheSize + 3);
+  nextCache.reserve(kOptimizerCacheSize + 3);
+
+  size_t scanCursor = 0;
+  int64_t bestTriangle = -1;
+
+  for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+  {
+    if (bestTriangle < 0)
+    {
+      //Nothing in the cache touches a live triangle, restart from the next one in input order
+      while (emitted[scanCursor])
+        scanCursor++;
+      bestTriangle = static_cast<int64_t>(scanCursor);
+    }
+
+    const uint32_t* triangle = &indices[bestTriangle * 3];
+    result.insert(result.end(), triangle, triangle + 3);
+    emitted[bestTriangle] = true;
+
+    //Drop the triangle from each corner's live adjacency range
+    for (size_t corner = 0; corner < 3; corner++)
+    {
+      uint32_t vertex = triangle[corner];
+      uint32_t* begin = &adjacency[adjacencyOffset[vertex]];
+      uint32_t* end = begin + remaining[vertex];
+      uint32_t* found = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+      if (found != end)
+      {
+        std::swap(*found, *(end - 1));
+        remaining[vertex]--;
+      }
+    }
+
+    //New cache is the emitted corners followed by the previous contents, LRU style
+    nextCache.assign(triangle, triangle + 3);
+    for (uint32_t vertex : cache)
+    {
+      if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+        nextCache.push_back(vertex);
+    }
+
+    for (size_t i = 0; i < nextCache.size(); i++)
+    {
+      uint32_t vertex = nextCache[i];
+      int32_t position = i < static_cast<size_t>(kOptimizerCacheSize) ? static_cast<int32_t>(i) : -1;
+      scores[vertex] = vertexScore(position, remaining[vertex]);
+    }
+
+    //Rescore every live triangle touching the cache (including vertices just pushed out) and pick the best one
+    bestTriangle = -1;
+    float bestScore = 0.0f;
+    auto rescore = [&](uint32_t vertex)
+    {
+      uint32_t* begin = &adjacency[adjacencyOffset[vertex]];
+      for (uint32_t* it = begin; it != begin + remaining[vertex]; it++)
+      {
+        uint32_t t = *it;
+        float score = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+        if (score > bestScore)
+        {
+          bestScore = score;
+          bestTriangle = t;
+        }
+      }
+    };
+
+    for (uint32_t vertex : nextCache)
+      rescore(vertex);
+
+    if (nextCache.size() > static_cast<size_t>(kOptimizerCacheSize))
+      nextCache.resize(kOptimizerCacheSize);
+    std::swap(cache, nextCache);
+  }
+
+  return result;
+}
+
+void optimizeVertexFetch(MeshData& mesh)
+{
+  const uint32_t unassigned = ~0u;
+  std::vector<uint32_t> remap(mesh.vertices.size(), unassigned);
+  std::vector<Vertex> reordered;
+  reordered.reserve(mesh.vertices.size());
+
+  for (uint32_t& index : mesh.indices)
+  {
+    if (remap[index] == unassigned)
+    {
+      remap[index] = static_cast<uint32_t>(reordered.size());
+      reordered.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  //Unreferenced vertices are dropped
+  mesh.vertices.swap(reordered);
+}
+
+void optimizeMesh(MeshData& mesh)
+{
+  mesh.indices = optimizeVertexCache(mesh.indices, mesh.vertices.size());
+  optimizeVertexFetch(mesh);
+}
+
+float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+  if (indices.size() < 3)
+    return 0.0f;
+
+  //FIFO simulation: a vertex is resident while fewer than cacheSize misses happened since it was loaded
+  std::vector<uint32_t> loadedAt(vertexCount, 0);
+  uint32_t clock = cacheSize + 1;
+  size_t misses = 0;
+
+  for (uint32_t index : indices)
+  {
+    if (clock - loadedAt[index] > cacheSize)
+    {
+      loadedAt[index] = clock++;
+      misses++;
+    }
+  }
+
+  return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "mesh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Post-transform cache size most of our targets behave like, used for ACMR reporting
+#define VERTEX_CACHE_SIZE 16
+
+//Reorders triangles for post-transform vertex cache hits (Forsyth's linear-speed optimizer)
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+//Reorders vertices into first-use order so fetches walk the vertex buffer linearly, rewrites the indices to match
+void optimizeVertexFetch(MeshData& mesh);
+
+//Cache then fetch, the order matters since fetch follows the triangle order
+void optimizeMesh(MeshData& mesh);
+
+//Average cache misses per triangle on a FIFO cache, 0.5 is the ideal and 3.0 the worst case
+float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
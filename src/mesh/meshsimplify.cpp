@@ -0,0 +1,385 @@
+#include "meshsimplify.hpp"
+#include "meshoptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+
+//Boundary edges get a perpendicular plane with this much extra weight so open borders don't shrink
+const double kBoundaryWeight = 10.0;
+
+//Symmetric 4x4 quadric, weight is the accumulated area so the error reads as a squared distance
+struct Quadric
+{
+  double a2 = 0, ab = 0, ac = 0, ad = 0;
+  double b2 = 0, bc = 0, bd = 0;
+  double c2 = 0, cd = 0;
+  double d2 = 0;
+  double weight = 0;
+
+  void addPlane(double a, double b, double c, double d, double w)
+  {
+    a2 += a * a * w; ab += a * b * w; ac += a * c * w; ad += a * d * w;
+    b2 += b * b * w; bc += b * c * w; bd += b * d * w;
+    c2 += c * c * w; cd += c * d * w;
+    d2 += d * d * w;
+    weight += w;
+  }
+
+  void add(const Quadric& o)
+  {
+    a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+    b2 += o.b2; bc += o.bc; bd += o.bd;
+    c2 += o.c2; cd += o.cd;
+    d2 += o.d2;
+    weight += o.weight;
+  }
+
+  double evaluate(const float* p) const
+  {
+    double x = p[0], y = p[1], z = p[2];
+    double error = a2 * x * x + b2 * y * y + c2 * z * z
+                 + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+                 + 2.0 * (ad * x + bd * y + cd * z)
+                 + d2;
+    return weight > 0.0 ? std::fabs(error) / weight : 0.0;
+  }
+};
+
+struct PositionKey
+{
+  uint32_t bits[3];
+
+  bool operator==(const PositionKey& other) const
+  {
+    return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+  }
+};
+
+struct PositionKeyHash
+{
+  size_t operator()(const PositionKey& key) const
+  {
+    uint64_t h = key.bits[0];
+    h = h * 0x9E3779B97F4A7C15ull ^ key.bits[1];
+    h = h * 0x9E3779B97F4A7C15ull ^ key.bits[2];
+    return static_cast<size_t>(h ^ (h >> 29));
+  }
+};
+
+struct Edge
+{
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+inline bool sameAttributes(const Vertex& a, const Vertex& b)
+{
+  return std::memcmp(a.normal, b.normal, sizeof(a.normal)) == 0 &&
+         std::memcmp(a.texCoord, b.texCoord, sizeof(a.texCoord)) == 0;
+}
+
+inline uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+  return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+void triangleNormal(const float* p0, const float* p1, const float* p2, double* n)
+{
+  double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+  double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+  n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                   size_t targetIndexCount, float* resultError)
+{
+  const size_t vertexCount = vertices.size();
+
+  //Topology works on positions so uv/normal seams collapse together instead of tearing open
+  std::vector<uint32_t> canonical(vertexCount);
+  {
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> lookup;
+    lookup.reserve(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+      PositionKey key;
+      std::memcpy(key.bits, vertices[v].position, sizeof(key.bits));
+      canonical[v] = lookup.try_emplace(key, v).first->second;
+    }
+  }
+
+  //Positions where vertices with different normals or uvs meet. They stay where they are, collapsing one away would
+  //stretch one side's attributes over the other.
+  std::vector<bool> seam(vertexCount, false);
+  for (uint32_t v = 0; v < vertexCount; v++)
+  {
+    if (!sameAttributes(vertices[v], vertices[canonical[v]]))
+      seam[canonical[v]] = true;
+  }
+
+  //Per corner: the position it collapses with and the vertex it is drawn with
+  std::vector<uint32_t> positionOf(indices.size());
+  std::vector<uint32_t> drawnWith(indices);
+  for (size_t i = 0; i < indices.size(); i++)
+    positionOf[i] = canonical[indices[i]];
+
+  std::vector<Quadric> quadrics(vertexCount);
+  std::unordered_map<uint64_t, uint32_t> edgeUse;
+  edgeUse.reserve(indices.size());
+
+  for (size_t t = 0; t < indices.size() / 3; t++)
+  {
+    const uint32_t* tri = &positionOf[t * 3];
+    double n[3];
+    triangleNormal(vertices[tri[0]].position, vertices[tri[1]].position, vertices[tri[2]].position, n);
+
+    double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (area <= 0.0)
+      continue;
+
+    n[0] /= area; n[1] /= area; n[2] /= area;
+    const float* p = vertices[tri[0]].position;
+    double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+
+    for (int corner = 0; corner < 3; corner++)
+    {
+      quadrics[tri[corner]].addPlane(n[0], n[1], n[2], d, area * 0.5);
+      edgeUse[edgeKey(tri[corner], tri[(corner + 1) % 3])]++;
+    }
+  }
+
+  for (size_t t = 0; t < indices.size() / 3; t++)
+  {
+    const uint32_t* tri = &positionOf[t * 3];
+    double n[3];
+    triangleNormal(vertices[tri[0]].position, vertices[tri[1]].position, vertices[tri[2]].position, n);
+
+    for (int corner = 0; corner < 3; corner++)
+    {
+      uint32_t a = tri[corner];
+      uint32_t b = tri[(corner + 1) % 3];
+      if (edgeUse[edgeKey(a, b)] != 1)
+        continue;
+
+      const float* pa = vertices[a].position;
+      const float* pb = vertices[b].position;
+      double e[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+      double lengthSq = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+
+      double bn[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+      double bnLength = std::sqrt(bn[0] * bn[0] + bn[1] * bn[1] + bn[2] * bn[2]);
+      if (bnLength <= 0.0)
+        continue;
+
+      bn[0] /= bnLength; bn[1] /= bnLength; bn[2] /= bnLength;
+      double d = -(bn[0] * pa[0] + bn[1] * pa[1] + bn[2] * pa[2]);
+      quadrics[a].addPlane(bn[0], bn[1], bn[2], d, lengthSq * kBoundaryWeight);
+      quadrics[b].addPlane(bn[0], bn[1], bn[2], d, lengthSq * kBoundaryWeight);
+    }
+  }
+
+  size_t triangleCount = indices.size() / 3;
+  const size_t targetTriangles = targetIndexCount / 3;
+  double maxError = 0.0;
+
+  std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<bool> locked(vertexCount);
+  std::vector<Edge> edges;
+
+  while (triangleCount > targetTriangles)
+  {
+    //Vertex -> live triangle adjacency for this pass
+    std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+    for (uint32_t position : positionOf)
+      adjacencyOffset[position + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+      adjacencyOffset[v + 1] += adjacencyOffset[v];
+
+    adjacency.resize(positionOf.size());
+    {
+      std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+      for (size_t i = 0; i < positionOf.size(); i++)
+        adjacency[fill[positionOf[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    //Interior edges show up twice, the second copy is skipped by the locks once the first collapses
+    edges.clear();
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+      for (int corner = 0; corner < 3; corner++)
+      {
+        uint32_t a = std::min(positionOf[t * 3 + corner], positionOf[t * 3 + (corner + 1) % 3]);
+        uint32_t b = std::max(positionOf[t * 3 + corner], positionOf[t * 3 + (corner + 1) % 3]);
+        if (seam[a] && seam[b])
+          continue;
+
+        Quadric combined = quadrics[a];
+        combined.add(quadrics[b]);
+        double costAB = combined.evaluate(vertices[b].position);
+        double costBA = combined.evaluate(vertices[a].position);
+
+        //A seam end can only be the one collapsed onto
+        if (!seam[a] && (seam[b] || costAB <= costBA))
+          edges.push_back({a, b, costAB});
+        else
+          edges.push_back({b, a, costBA});
+      }
+    }
+
+    std::sort(edges.begin(), edges.end(), [](const Edge& l, const Edge& r) { return l.cost < r.cost; });
+
+    std::fill(locked.begin(), locked.end(), false);
+    size_t collapses = 0;
+    size_t remainingTriangles = triangleCount;
+
+    for (const Edge& edge : edges)
+    {
+      if (remainingTriangles <= targetTriangles)
+        break;
+
+      uint32_t from = edge.from;
+      uint32_t to = edge.to;
+      if (locked[from] || locked[to])
+        continue;
+
+      //Reject collapses that would flip a surviving triangle around 'from'. The triangles on the edge tell which
+      //vertex at 'to' belongs to this side of any seam there, the moved corners are drawn with that one.
+      bool flips = false;
+      size_t removed = 0;
+      uint32_t toVertex = to;
+      for (uint32_t a = adjacencyOffset[from]; a < adjacencyOffset[from + 1] && !flips; a++)
+      {
+        const uint32_t* tri = &positionOf[adjacency[a] * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+        {
+          for (int corner = 0; corner < 3; corner++)
+          {
+            if (tri[corner] == to)
+              toVertex = drawnWith[adjacency[a] * 3 + corner];
+          }
+          removed++;
+          continue;
+        }
+
+        const float* before[3];
+        const float* after[3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+          before[corner] = vertices[tri[corner]].position;
+          after[corner] = tri[corner] == from ? vertices[to].position : before[corner];
+        }
+
+        double n0[3], n1[3];
+        triangleNormal(before[0], before[1], before[2], n0);
+        triangleNormal(after[0], after[1], after[2], n1);
+        if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+          flips = true;
+      }
+
+      if (flips)
+        continue;
+
+      quadrics[to].add(quadrics[from]);
+      maxError = std::max(maxError, edge.cost);
+      remainingTriangles -= removed;
+      collapses++;
+      locked[from] = true;
+
+      for (uint32_t a = adjacencyOffset[from]; a < adjacencyOffset[from + 1]; a++)
+      {
+        uint32_t* tri = &positionOf[adjacency[a] * 3];
+        uint32_t* drawn = &drawnWith[adjacency[a] * 3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+          if (tri[corner] == from)
+          {
+            tri[corner] = to;
+            drawn[corner] = toVertex;
+          }
+          locked[tri[corner]] = true;
+        }
+      }
+      for (uint32_t a = adjacencyOffset[to]; a < adjacencyOffset[to + 1]; a++)
+      {
+        const uint32_t* tri = &positionOf[adjacency[a] * 3];
+        locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = true;
+      }
+    }
+
+    if (collapses == 0)
+      break;
+
+    //Compact away the triangles that went degenerate
+    size_t write = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+      const uint32_t* tri = &positionOf[t * 3];
+      if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+        continue;
+
+      for (int corner = 0; corner < 3; corner++)
+      {
+        positionOf[write * 3 + corner] = positionOf[t * 3 + corner];
+        drawnWith[write * 3 + corner] = drawnWith[t * 3 + corner];
+      }
+      write++;
+    }
+
+    triangleCount = write;
+    positionOf.resize(triangleCount * 3);
+    drawnWith.resize(triangleCount * 3);
+  }
+
+  if (resultError)
+    *resultError = static_cast<float>(std::sqrt(maxError));
+
+  return drawnWith;
+}
+
+void buildLodChain(MeshData& mesh, size_t maxLods)
+{
+  //Drop an old chain, LOD 0 is whatever the first range was
+  if (!mesh.lods.empty())
+  {
+    mesh.indices.resize(mesh.lods[0].indexCount);
+  }
+
+  mesh.lods.clear();
+  mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+
+  std::vector<uint32_t> current = mesh.indices;
+  float accumulatedError = 0.0f;
+
+  while (mesh.lods.size() < maxLods)
+  {
+    size_t targetIndexCount = (current.size() / 6) * 3;
+    if (targetIndexCount / 3 < MIN_LOD_TRIANGLES)
+      break;
+
+    float error = 0.0f;
+    std::vector<uint32_t> lod = simplifyMesh(mesh.vertices, current, targetIndexCount, &error);
+
+    //Stuck on locked/flipping topology, further levels would just repeat this one
+    if (lod.size() > current.size() * 85 / 100)
+      break;
+
+    lod = optimizeVertexCache(lod, mesh.vertices.size());
+
+    //Each level is simplified from the previous, so deviations from LOD 0 add up
+    accumulatedError += error;
+
+    mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(lod.size()), accumulatedError});
+    mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+    current.swap(lod);
+  }
+}
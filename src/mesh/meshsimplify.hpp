@@ -0,0 +1,18 @@
+#pragma once
+
+#include "mesh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//LODs stop once a level would drop below this many triangles
+#define MIN_LOD_TRIANGLES 64
+
+//Quadric error edge collapse. Vertices only ever collapse onto an existing neighbour, so the
+//result indexes the same vertex buffer. resultError is the object space deviation of this step.
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                   size_t targetIndexCount, float* resultError = nullptr);
+
+//Replaces mesh.lods with a chain where every level has about half the triangles of the previous one.
+//The LOD index ranges are appended to mesh.indices after LOD 0.
+void buildLodChain(MeshData& mesh, size_t maxLods = MAX_MESH_LODS);
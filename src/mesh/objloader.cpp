@@ -0,0 +1,302 @@
+#include "objloader.hpp"
+#include "../utils/fileread.hpp"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+
+struct VertexKey
+{
+  int32_t position;
+  int32_t texCoord;
+  int32_t normal;
+
+  bool operator==(const VertexKey& other) const
+  {
+    return position == other.position && texCoord == other.texCoord && normal == other.normal;
+  }
+};
+
+struct VertexKeyHash
+{
+  size_t operator()(const VertexKey& key) const
+  {
+    uint64_t h = static_cast<uint32_t>(key.position);
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.texCoord);
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.normal);
+    return static_cast<size_t>(h ^ (h >> 29));
+  }
+};
+
+//Cursor over the raw file bytes, everything below works on it in place
+struct Cursor
+{
+  const char* ptr;
+  const char* end;
+
+  bool atEnd() const { return ptr >= end; }
+
+  void skipSpaces()
+  {
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r'))
+      ptr++;
+  }
+
+  void skipLine()
+  {
+    const char* newline = static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+    ptr = newline ? newline + 1 : end;
+  }
+
+  bool atLineEnd() const
+  {
+    return ptr >= end || *ptr == '\n' || *ptr == '#';
+  }
+};
+
+inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+float parseFloat(Cursor& cursor)
+{
+  static const double powersOfTen[] =
+  {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  cursor.skipSpaces();
+  const char* p = cursor.ptr;
+  const char* end = cursor.end;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = *p == '-';
+    p++;
+  }
+
+  double value = 0.0;
+  while (p < end && isDigit(*p))
+  {
+    value = value * 10.0 + (*p - '0');
+    p++;
+  }
+
+  if (p < end && *p == '.')
+  {
+    p++;
+    double fraction = 0.0;
+    int digits = 0;
+    while (p < end && isDigit(*p))
+    {
+      if (digits < 22)
+      {
+        fraction = fraction * 10.0 + (*p - '0');
+        digits++;
+      }
+      p++;
+    }
+    value += fraction / powersOfTen[digits];
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    p++;
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+      negativeExponent = *p == '-';
+      p++;
+    }
+
+    int exponent = 0;
+    while (p < end && isDigit(*p))
+    {
+      exponent = exponent * 10 + (*p - '0');
+      p++;
+    }
+
+    double scale = 1.0;
+    while (exponent > 22)
+    {
+      scale *= 1e22;
+      exponent -= 22;
+    }
+    scale *= powersOfTen[exponent];
+    value = negativeExponent ? value / scale : value * scale;
+  }
+
+  cursor.ptr = p;
+  return static_cast<float>(negative ? -value : value);
+}
+
+int32_t parseInt(Cursor& cursor)
+{
+  const char* p = cursor.ptr;
+  bool negative = false;
+  if (p < cursor.end && *p == '-')
+  {
+    negative = true;
+    p++;
+  }
+
+  int32_t value = 0;
+  while (p < cursor.end && isDigit(*p))
+  {
+    value = value * 10 + (*p - '0');
+    p++;
+  }
+
+  cursor.ptr = p;
+  return negative ? -value : value;
+}
+
+//OBJ indices are 1 based and may be negative (relative to the end), 0 means "not present"
+int32_t resolveIndex(int32_t index, size_t count)
+{
+  if (index > 0)
+    return index - 1;
+  if (index < 0)
+    return static_cast<int32_t>(count) + index;
+  return -1;
+}
+
+}
+
+MeshData loadObj(const std::string& filename, ImportStats* stats)
+{
+  std::vector<char> buffer = readFile(filename);
+  return parseObj(buffer.data(), buffer.size(), stats);
+}
+
+MeshData parseObj(const char* data, size_t size, ImportStats* stats)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<float> positions;
+  std::vector<float> texCoords;
+  std::vector<float> normals;
+
+  //A rough guess from typical OBJ line lengths saves most of the regrowth
+  positions.reserve(size / 24);
+  normals.reserve(size / 24);
+  texCoords.reserve(size / 36);
+
+  MeshData mesh;
+  std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertexLookup;
+  vertexLookup.reserve(size / 48);
+
+  std::vector<uint32_t> polygon;
+  size_t faceCorners = 0;
+
+  Cursor cursor{data, data + size};
+
+  while (!cursor.atEnd())
+  {
+    cursor.skipSpaces();
+    if (cursor.atEnd())
+      break;
+
+    const char* p = cursor.ptr;
+    size_t remaining = cursor.end - p;
+
+    if (remaining > 1 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      cursor.ptr += 2;
+      positions.push_back(parseFloat(cursor));
+      positions.push_back(parseFloat(cursor));
+      positions.push_back(parseFloat(cursor));
+    }
+    else if (remaining > 2 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+    {
+      cursor.ptr += 3;
+      texCoords.push_back(parseFloat(cursor));
+      texCoords.push_back(parseFloat(cursor));
+    }
+    else if (remaining > 2 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+    {
+      cursor.ptr += 3;
+      normals.push_back(parseFloat(cursor));
+      normals.push_back(parseFloat(cursor));
+      normals.push_back(parseFloat(cursor));
+    }
+    else if (remaining > 1 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      cursor.ptr += 2;
+      polygon.clear();
+
+      while (true)
+      {
+        cursor.skipSpaces();
+        if (cursor.atLineEnd())
+          break;
+
+        VertexKey key{-1, -1, -1};
+        key.position = resolveIndex(parseInt(cursor), positions.size() / 3);
+
+        if (!cursor.atEnd() && *cursor.ptr == '/')
+        {
+          cursor.ptr++;
+          if (!cursor.atEnd() && *cursor.ptr != '/')
+            key.texCoord = resolveIndex(parseInt(cursor), texCoords.size() / 2);
+
+          if (!cursor.atEnd() && *cursor.ptr == '/')
+          {
+            cursor.ptr++;
+            key.normal = resolveIndex(parseInt(cursor), normals.size() / 3);
+          }
+        }
+
+        if (key.position < 0 || static_cast<size_t>(key.position) * 3 >= positions.size())
+        {
+          throw std::runtime_error("OBJ face references a missing position!");
+        }
+
+        auto [it, inserted] = vertexLookup.try_emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+        if (inserted)
+        {
+          Vertex vertex{};
+          std::memcpy(vertex.position, &positions[key.position * 3], sizeof(vertex.position));
+          if (key.normal >= 0 && static_cast<size_t>(key.normal) * 3 < normals.size())
+            std::memcpy(vertex.normal, &normals[key.normal * 3], sizeof(vertex.normal));
+          if (key.texCoord >= 0 && static_cast<size_t>(key.texCoord) * 2 < texCoords.size())
+            std::memcpy(vertex.texCoord, &texCoords[key.texCoord * 2], sizeof(vertex.texCoord));
+          mesh.vertices.push_back(vertex);
+        }
+        polygon.push_back(it->second);
+        faceCorners++;
+
+        //Anything else glued to the token (e.g. stray separators) is ignored
+        while (!cursor.atEnd() && *cursor.ptr != ' ' && *cursor.ptr != '\t' && *cursor.ptr != '\r' && *cursor.ptr != '\n')
+          cursor.ptr++;
+      }
+
+      for (size_t i = 2; i < polygon.size(); i++)
+      {
+        mesh.indices.push_back(polygon[0]);
+        mesh.indices.push_back(polygon[i - 1]);
+        mesh.indices.push_back(polygon[i]);
+      }
+    }
+
+    cursor.skipLine();
+  }
+
+  mesh.computeBounds();
+
+  if (stats)
+  {
+    auto end = std::chrono::high_resolution_clock::now();
+    stats->fileBytes = size;
+    stats->faceCorners = faceCorners;
+    stats->parseSeconds = std::chrono::duration<double>(end - start).count();
+  }
+
+  return mesh;
+}
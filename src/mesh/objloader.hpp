@@ -0,0 +1,22 @@
+#pragma once
+
+#include "mesh.hpp"
+#include <cstddef>
+#include <string>
+
+struct ImportStats
+{
+  size_t fileBytes = 0;
+  size_t faceCorners = 0;
+  double parseSeconds = 0.0;
+
+  double throughputMBs() const
+  {
+    return parseSeconds > 0.0 ? (fileBytes / (1024.0 * 1024.0)) / parseSeconds : 0.0;
+  }
+};
+
+//Parses a Wavefront OBJ straight out of the file buffer, no per-line strings.
+//Polygons are fan triangulated and identical position/uv/normal triples share a vertex.
+MeshData loadObj(const std::string& filename, ImportStats* stats = nullptr);
+MeshData parseObj(const char* data, size_t size, ImportStats* stats = nullptr);
@@ -0,0 +1,126 @@
+#include "../volcano.hpp"
+#include <stdexcept>
+#include <vector>
+#include "../utils/profiler.hpp"
+
+//Async compute: light binning only depends on the lights the CPU just wrote, so it's submitted to a compute queue
+//before the graphics command buffer. The shadow pass, vertex work and last frame's presentation run meanwhile and the
+//graphics submit only waits on the compute semaphore at the fragment shader stage, where the cluster lists are read.
+
+bool Volcano::findAsyncComputeQueue(uint32_t graphicsFamily, uint32_t& family, uint32_t& queueIndex)
+{
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  //A compute only family is what usually maps to separate hardware queues
+  for (uint32_t i = 0; i < queueFamilyCount; i++)
+  {
+    if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+    {
+      family = i;
+      queueIndex = 0;
+      return true;
+    }
+  }
+
+  //Otherwise a second queue of the graphics family, the driver may still overlap the two submissions
+  if (queueFamilies[graphicsFamily].queueCount >= 2)
+  {
+    family = graphicsFamily;
+    queueIndex = 1;
+    return true;
+  }
+  return false;
+}
+
+void Volcano::createAsyncCompute()
+{
+  PROFILE_FUNCTION();
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = m_ComputeFamily;
+
+  if (vkCreateCommandPool(m_Device, &poolInfo, m_Allocator, &m_ComputeCommandPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create compute command pool!");
+  }
+
+  m_ComputeCommandBuffers.resize(m_Config.framesInFlight);
+  VkCommandBufferAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocateInfo.commandPool = m_ComputeCommandPool;
+  allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocateInfo.commandBufferCount = m_Config.framesInFlight;
+
+  if (vkAllocateCommandBuffers(m_Device, &allocateInfo, m_ComputeCommandBuffers.data()) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate compute command buffers!");
+  }
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  m_ComputeFinishedSemaphores.resize(m_Config.framesInFlight);
+  for (VkSemaphore& semaphore : m_ComputeFinishedSemaphores)
+  {
+    if (vkCreateSemaphore(m_Device, &semaphoreInfo, m_Allocator, &semaphore) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create compute semaphore!");
+    }
+  }
+
+  m_ComputeTimeline.init(m_VulkanInstance, m_Device, m_PhysicalDevice, m_ComputeFamily, m_ComputeCommandPool,
+                         m_ComputeQueue, m_Config.framesInFlight,
+                         profilerEnabled() || m_Config.lightBenchmark || m_Config.gpuTimings,
+                         validationLayersOn, m_Allocator, "compute queue");
+}
+
+void Volcano::submitAsyncCompute()
+{
+  PROFILE_FUNCTION();
+  //The frame's fence was waited on, and the graphics submit that fence covers waited on this buffer's semaphore,
+  //so the previous use of this slot is done
+  VkCommandBuffer commandBuffer = m_ComputeCommandBuffers[m_CurrentFrame];
+  vkResetCommandBuffer(commandBuffer, 0);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to begin recording compute command buffer!");
+  }
+  m_ComputeTimeline.beginFrame(commandBuffer, m_CurrentFrame);
+  recordLightBinning(commandBuffer, true);
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to record compute command buffer!");
+  }
+
+  //Plain vkQueueSubmit, the semaphore signal makes the binning writes available to the graphics queue's wait
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &m_ComputeFinishedSemaphores[m_CurrentFrame];
+
+  if (vkQueueSubmit(m_ComputeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to submit compute command buffer!");
+  }
+}
+
+void Volcano::destroyAsyncCompute()
+{
+  m_ComputeTimeline.destroy(m_Allocator);
+  for (VkSemaphore semaphore : m_ComputeFinishedSemaphores)
+  {
+    vkDestroySemaphore(m_Device, semaphore, m_Allocator);
+  }
+  m_ComputeFinishedSemaphores.clear();
+  vkDestroyCommandPool(m_Device, m_ComputeCommandPool, m_Allocator);
+}
@@ -0,0 +1,191 @@
+#include "../volcano.hpp"
+#include <iostream>
+#include <stdexcept>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Frame capture: the finished swapchain image is copied into one of CAPTURE_RING_SIZE host visible buffers at the end
+//of the frame's command buffer. When the frame's fence comes around again the copy is done and the buffer goes to the
+//encoder thread, which reads it straight from the mapping and hands it back. Nothing ever waits on the encoder:
+//if it falls behind and every buffer is taken, the frame just isn't captured and counts as dropped.
+
+void Volcano::createCapture()
+{
+  PROFILE_FUNCTION();
+  VkDeviceSize frameBytes = static_cast<VkDeviceSize>(m_SwapChainExtent.width) * m_SwapChainExtent.height * 4;
+
+  for (CaptureSlot& slot : m_CaptureSlots)
+  {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = frameBytes;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(m_Device, &bufferInfo, m_Allocator, &slot.buffer) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create capture buffer!");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(m_Device, slot.buffer, &memoryRequirements);
+
+    //The CPU reads every byte, cached memory makes that several times faster. Not always coherent though.
+    uint32_t memoryType;
+    m_CaptureMemoryCoherent = false;
+    if (!tryFindMemoryType(m_PhysicalDevice, memoryRequirements.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, memoryType))
+    {
+      memoryType = findMemoryType(m_PhysicalDevice, memoryRequirements.memoryTypeBits,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+      m_CaptureMemoryCoherent = true;
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = memoryRequirements.size;
+    allocateInfo.memoryTypeIndex = memoryType;
+
+    if (vkAllocateMemory(m_Device, &allocateInfo, m_Allocator, &slot.memory) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to allocate capture memory!");
+    }
+    vkBindBufferMemory(m_Device, slot.buffer, slot.memory, 0);
+    vkMapMemory(m_Device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped);
+    m_Resources.addBuffer(slot.buffer, slot.memory, "capture");
+    slot.inUse.store(false);
+  }
+
+  for (int32_t& slot : m_CaptureFrameSlots)
+  {
+    slot = -1;
+  }
+
+  bool bgra = m_SwapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB || m_SwapChainImageFormat == VK_FORMAT_B8G8R8A8_UNORM;
+  uint32_t fps = m_Config.fpsLimit > 0.0 ? static_cast<uint32_t>(m_Config.fpsLimit + 0.5) : 60;
+  m_FrameEncoder.start(m_Config.capturePath, m_SwapChainExtent.width, m_SwapChainExtent.height, fps, bgra);
+  std::cout << "Capturing " << m_SwapChainExtent.width << "x" << m_SwapChainExtent.height << " to " << m_Config.capturePath << std::endl;
+}
+
+void Volcano::recordCapture(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  //--capture-after, still settling
+  if (m_FrameNumber < m_Config.captureAfter)
+  {
+    return;
+  }
+  if (m_Config.captureFrames > 0 && m_CaptureRecorded >= m_Config.captureFrames)
+  {
+    return;
+  }
+
+  //Oldest slot first, the encoder frees them in order
+  int32_t slotIndex = -1;
+  for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++)
+  {
+    uint32_t candidate = (m_CaptureNextSlot + i) % CAPTURE_RING_SIZE;
+    if (!m_CaptureSlots[candidate].inUse.load(std::memory_order_acquire))
+    {
+      slotIndex = static_cast<int32_t>(candidate);
+      break;
+    }
+  }
+  if (slotIndex < 0)
+  {
+    m_CaptureDropped++;
+    return;
+  }
+
+  CaptureSlot& slot = m_CaptureSlots[slotIndex];
+  slot.inUse.store(true, std::memory_order_relaxed);
+  m_CaptureFrameSlots[m_CurrentFrame] = slotIndex;
+  m_CaptureNextSlot = (slotIndex + 1) % CAPTURE_RING_SIZE;
+  m_CaptureRecorded++;
+
+  m_GpuTimeline.beginRange(commandBuffer, "capture copy");
+
+  //Both paths leave the image in PRESENT_SRC, borrow it for the copy and give it back
+  VkImageMemoryBarrier imageBarrier{};
+  imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imageBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.image = m_SwapChainImages[imageIndex];
+  imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  //ALL_COMMANDS chains with the render pass's implicit end dependency, where the legacy path's final transition is
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {m_SwapChainExtent.width, m_SwapChainExtent.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, m_SwapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         slot.buffer, 1, &region);
+
+  imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imageBarrier.dstAccessMask = 0;
+  imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  VkBufferMemoryBarrier bufferBarrier{};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = slot.buffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                       0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+
+  m_GpuTimeline.endRange(commandBuffer);
+}
+
+void Volcano::collectCapture(uint32_t frameIndex)
+{
+  //Only called once frameIndex's fence has signaled, the copy is complete
+  int32_t slotIndex = m_CaptureFrameSlots[frameIndex];
+  if (slotIndex < 0)
+  {
+    return;
+  }
+  m_CaptureFrameSlots[frameIndex] = -1;
+
+  CaptureSlot& slot = m_CaptureSlots[slotIndex];
+  if (!m_CaptureMemoryCoherent)
+  {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = slot.memory;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
+  }
+  m_FrameEncoder.push(static_cast<const uint8_t*>(slot.mapped), &slot.inUse);
+  m_CaptureCollected++;
+
+  if (m_Config.captureFrames > 0 && m_CaptureCollected >= m_Config.captureFrames)
+  {
+    requestClose();
+  }
+}
+
+void Volcano::destroyCapture()
+{
+  //The device is idle, pick up the frames still in flight in submission order
+  for (uint32_t i = 0; i < m_Config.framesInFlight; i++)
+  {
+    collectCapture((m_CurrentFrame + i) % m_Config.framesInFlight);
+  }
+  m_FrameEncoder.stop();
+  std::cout << "Captured " << m_FrameEncoder.framesWritten() << " frames to " << m_Config.capturePath
+            << " (" << m_CaptureDropped << " dropped while the encoder was behind)" << std::endl;
+
+  //The buffers themselves go with m_Resources
+  for (CaptureSlot& slot : m_CaptureSlots)
+  {
+    vkUnmapMemory(m_Device, slot.memory);
+  }
+}
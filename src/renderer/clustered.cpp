@@ -0,0 +1,371 @@
+#include "../volcano.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Clustered forward lighting: the view frustum is cut into a CLUSTER_GRID_X x CLUSTER_GRID_Y x CLUSTER_GRID_Z grid of
+//froxels (screen tiles x exponential depth slices). cluster.comp bins the visible lights into every froxel they touch
+//and packs the result into one index list, shader.frag then only loops over its own froxel's lights.
+//The lights are culled against the frustum on the CPU first, so binning cost follows what is on screen.
+
+//Per light layout shared with cluster.comp / shader.frag (std430)
+struct GpuLight
+{
+  float positionRadius[4];
+  float colorSpotOuter[4];
+  float directionSpotInner[4];
+};
+
+//std140 uniform, see ClusterParams in the shaders
+struct ClusterParams
+{
+  float projection[4];
+  float depth[4];
+  uint32_t grid[4];
+  float sunDirection[4];
+};
+
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+//Light counts the benchmark steps through, frames are per step after the warmup
+static const uint32_t s_BenchmarkLightCounts[] = {0, 64, 256, 1024, 4096, 16384};
+#define LIGHT_BENCHMARK_WARMUP_FRAMES 30
+#define LIGHT_BENCHMARK_FRAMES 200
+
+void Volcano::createLights()
+{
+  PROFILE_FUNCTION();
+  //Scattered over the object grid, fixed seed so runs are comparable
+  std::mt19937 random(1234);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  float halfWidth = (m_Config.grid + 1) * GRID_SPACING * 0.5f;
+  float depth = (m_Config.grid + 1) * GRID_SPACING;
+
+  m_Lights.resize(MAX_LIGHTS);
+  for (SceneLight& light : m_Lights)
+  {
+    light.position = Vec3((unit(random) * 2.0f - 1.0f) * halfWidth, 0.1f + unit(random) * 1.2f, 1.0f - unit(random) * depth);
+    light.radius = 0.6f + unit(random) * 1.4f;
+    light.color = Vec3(0.2f + unit(random), 0.2f + unit(random), 0.2f + unit(random)) * 0.8f;
+    light.phase = unit(random) * 6.2831853f;
+
+    //Every fourth light is a spot pointing down
+    light.spot = unit(random) < 0.25f;
+  }
+}
+
+void Volcano::createClusterResources()
+{
+  PROFILE_FUNCTION();
+  VkDescriptorSetLayoutBinding bindings[4]{};
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 4;
+  layoutInfo.pBindings = bindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_ClusterSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create cluster descriptor set layout!");
+  }
+
+  uint32_t frames = m_Config.framesInFlight;
+  VkDescriptorPoolSize poolSizes[2]{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[0].descriptorCount = 3 * frames;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[1].descriptorCount = frames;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = frames;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+
+  if (vkCreateDescriptorPool(m_Device, &poolInfo, m_Allocator, &m_ClusterDescriptorPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create cluster descriptor pool!");
+  }
+
+  std::vector<VkDescriptorSetLayout> setLayouts(frames, m_ClusterSetLayout);
+  VkDescriptorSetAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocateInfo.descriptorPool = m_ClusterDescriptorPool;
+  allocateInfo.descriptorSetCount = frames;
+  allocateInfo.pSetLayouts = setLayouts.data();
+
+  m_ClusterFrames.resize(frames);
+  std::vector<VkDescriptorSet> sets(frames);
+  if (vkAllocateDescriptorSets(m_Device, &allocateInfo, sets.data()) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate cluster descriptor sets!");
+  }
+
+  //Everything is per frame in flight: the CPU rewrites lights/params while the previous frame still reads its own
+  VkDeviceSize lightBytes = sizeof(GpuLight) * MAX_LIGHTS;
+  VkDeviceSize gridBytes = sizeof(uint32_t) * 2 * CLUSTER_COUNT;
+  VkDeviceSize indexBytes = sizeof(uint32_t) * (1 + static_cast<VkDeviceSize>(CLUSTER_COUNT) * MAX_LIGHTS_PER_CLUSTER);
+
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    ClusterFrame& frame = m_ClusterFrames[i];
+    frame.descriptorSet = sets[i];
+
+    //Shared with the async compute family when it's a different one, see m_ClusterQueueFamilies
+    VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    uint32_t familyCount = static_cast<uint32_t>(m_ClusterQueueFamilies.size());
+    const uint32_t* families = m_ClusterQueueFamilies.data();
+    createBuffer(m_Device, m_PhysicalDevice, lightBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible,
+                 frame.lightBuffer, frame.lightMemory, familyCount, families);
+    createBuffer(m_Device, m_PhysicalDevice, sizeof(ClusterParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible,
+                 frame.paramsBuffer, frame.paramsMemory, familyCount, families);
+    createBuffer(m_Device, m_PhysicalDevice, gridBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.gridBuffer, frame.gridMemory, familyCount, families);
+    createBuffer(m_Device, m_PhysicalDevice, indexBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.indexBuffer, frame.indexMemory, familyCount, families);
+
+    //Persistently mapped, coherent so there is nothing to flush
+    vkMapMemory(m_Device, frame.lightMemory, 0, lightBytes, 0, &frame.lightsMapped);
+    vkMapMemory(m_Device, frame.paramsMemory, 0, sizeof(ClusterParams), 0, &frame.paramsMapped);
+
+    VkDescriptorBufferInfo bufferInfos[4]{};
+    bufferInfos[0] = {frame.lightBuffer, 0, lightBytes};
+    bufferInfos[1] = {frame.gridBuffer, 0, gridBytes};
+    bufferInfos[2] = {frame.indexBuffer, 0, indexBytes};
+    bufferInfos[3] = {frame.paramsBuffer, 0, sizeof(ClusterParams)};
+
+    VkWriteDescriptorSet writes[4]{};
+    for (uint32_t binding = 0; binding < 4; binding++)
+    {
+      writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[binding].dstSet = frame.descriptorSet;
+      writes[binding].dstBinding = binding;
+      writes[binding].descriptorCount = 1;
+      writes[binding].descriptorType = bindings[binding].descriptorType;
+      writes[binding].pBufferInfo = &bufferInfos[binding];
+    }
+    vkUpdateDescriptorSets(m_Device, 4, writes, 0, nullptr);
+  }
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &m_ClusterSetLayout;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_ClusterPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create cluster pipeline layout!");
+  }
+
+  VkShaderModule computeShaderModule = loadShader(VOLCANO_SHADER_DIR "cluster.comp.spv");
+
+  m_ClusterPipeline = createComputePipeline(m_Device, m_PipelineCache, computeShaderModule, m_ClusterPipelineLayout, m_Allocator);
+  vkDestroyShaderModule(m_Device, computeShaderModule, m_Allocator);
+}
+
+void Volcano::updateLights(const Mat4& view, const Mat4& projection)
+{
+  PROFILE_FUNCTION();
+  ClusterFrame& frame = m_ClusterFrames[m_CurrentFrame];
+  GpuLight* gpuLights = static_cast<GpuLight*>(frame.lightsMapped);
+
+  //Same clock as the camera, the simulation's interpolated time
+  float time = static_cast<float>(m_SimTime);
+  float aspect = m_SwapChainExtent.width / static_cast<float>(m_SwapChainExtent.height);
+  float tanY = std::tan(CAMERA_FOV * 0.5f);
+  float tanX = tanY * aspect;
+  float sideX = 1.0f / std::sqrt(1.0f + tanX * tanX);
+  float sideY = 1.0f / std::sqrt(1.0f + tanY * tanY);
+
+  //A spot's cone fits in its range sphere, so one sphere test covers both kinds
+  const float spotCosOuter = std::cos(0.6f);
+  const float spotCosInner = std::cos(0.45f);
+  Vec3 spotDirection = view.transformDirection(Vec3(0.0f, -1.0f, 0.0f));
+
+  uint32_t visible = 0;
+  for (uint32_t i = 0; i < m_LightCount; i++)
+  {
+    const SceneLight& light = m_Lights[i];
+    Vec3 orbit(std::cos(time + light.phase) * 0.5f, 0.0f, std::sin(time + light.phase) * 0.5f);
+    Vec3 center = view.transformPoint(light.position + orbit);
+    float radius = light.radius;
+
+    //View space frustum test, the camera looks down -z
+    if (-center.z + radius < CAMERA_NEAR || -center.z - radius > CAMERA_FAR ||
+        (center.x + center.z * tanX) * sideX > radius || (-center.x + center.z * tanX) * sideX > radius ||
+        (center.y + center.z * tanY) * sideY > radius || (-center.y + center.z * tanY) * sideY > radius)
+    {
+      continue;
+    }
+
+    GpuLight& gpuLight = gpuLights[visible++];
+    gpuLight = {{center.x, center.y, center.z, radius},
+                {light.color.x, light.color.y, light.color.z, light.spot ? spotCosOuter : -2.0f},
+                {spotDirection.x, spotDirection.y, spotDirection.z, spotCosInner}};
+  }
+  m_FrameStats.lightsVisible = visible;
+
+  Vec3 sun = view.transformDirection(normalize(SUN_DIRECTION));
+
+  ClusterParams params{};
+  params.projection[0] = projection.at(0, 0);
+  params.projection[1] = projection.at(1, 1);
+  //gl_FragCoord only spans the rendered part of the target
+  params.projection[2] = static_cast<float>(m_RenderExtent.width);
+  params.projection[3] = static_cast<float>(m_RenderExtent.height);
+  params.depth[0] = CAMERA_NEAR;
+  params.depth[1] = CAMERA_FAR;
+  params.depth[2] = std::log(CAMERA_FAR / CAMERA_NEAR);
+  params.grid[0] = CLUSTER_GRID_X;
+  params.grid[1] = CLUSTER_GRID_Y;
+  params.grid[2] = CLUSTER_GRID_Z;
+  params.grid[3] = visible;
+  params.sunDirection[0] = sun.x;
+  params.sunDirection[1] = sun.y;
+  params.sunDirection[2] = sun.z;
+  memcpy(frame.paramsMapped, &params, sizeof(params));
+}
+
+void Volcano::recordLightBinning(VkCommandBuffer commandBuffer, bool asyncQueue)
+{
+  const ClusterFrame& frame = m_ClusterFrames[m_CurrentFrame];
+  GpuTimeline& timeline = asyncQueue ? m_ComputeTimeline : m_GpuTimeline;
+
+  //Explicit range rather than GPU_SCOPE, the light benchmark reads it back even without VOLCANO_PROFILING
+  timeline.beginRange(commandBuffer, "light binning");
+
+  //The index list's head is an atomic counter, reset it before the clusters allocate from it
+  vkCmdFillBuffer(commandBuffer, frame.indexBuffer, 0, sizeof(uint32_t), 0);
+
+  VkMemoryBarrier fillBarrier{};
+  fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  fillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       1, &fillBarrier, 0, nullptr, 0, nullptr);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipelineLayout, 0, 1,
+                          &frame.descriptorSet, 0, nullptr);
+  vkCmdDispatch(commandBuffer, CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+
+  //A compute queue has no fragment stage to barrier against, the graphics submit's semaphore wait covers it
+  if (asyncQueue)
+  {
+    timeline.endRange(commandBuffer);
+    return;
+  }
+
+  VkMemoryBarrier binningBarrier{};
+  binningBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  binningBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  binningBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                       1, &binningBarrier, 0, nullptr, 0, nullptr);
+
+  timeline.endRange(commandBuffer);
+}
+
+void Volcano::bindClusterSet(VkCommandBuffer commandBuffer)
+{
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1,
+                          &m_ClusterFrames[m_CurrentFrame].descriptorSet, 0, nullptr);
+}
+
+void Volcano::stepLightBenchmark()
+{
+  //Frame counter within the current step, the warmup frames are thrown away
+  m_LightBenchmarkFrame++;
+  if (m_LightBenchmarkFrame == LIGHT_BENCHMARK_WARMUP_FRAMES)
+  {
+    m_GpuTimeline.takeAverages();
+    m_ComputeTimeline.takeAverages();
+    m_LightBenchmarkVisible = 0;
+    m_LightBenchmarkStart = std::chrono::steady_clock::now();
+    return;
+  }
+  if (m_LightBenchmarkFrame > LIGHT_BENCHMARK_WARMUP_FRAMES)
+  {
+    m_LightBenchmarkVisible += m_FrameStats.lightsVisible;
+  }
+  if (m_LightBenchmarkFrame < LIGHT_BENCHMARK_WARMUP_FRAMES + LIGHT_BENCHMARK_FRAMES)
+  {
+    return;
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_LightBenchmarkStart;
+  std::map<std::string, double> gpu = m_GpuTimeline.takeAverages();
+  if (m_AsyncComputeEnabled)
+  {
+    //Binning time is on the compute queue, overlapped with the graphics frame rather than part of it
+    gpu["light binning"] = m_ComputeTimeline.takeAverages()["light binning"];
+  }
+
+  if (m_LightBenchmarkStep == 0)
+  {
+    std::cout << "Light benchmark, " << CLUSTER_GRID_X << "x" << CLUSTER_GRID_Y << "x" << CLUSTER_GRID_Z
+              << " clusters, " << LIGHT_BENCHMARK_FRAMES << " frames per step"
+              << (m_AsyncComputeEnabled ? ", binning on the async compute queue" : "")
+              << (m_GpuTimeline.timestampsEnabled() ? "" : " (no timestamp support, GPU columns are 0)") << std::endl;
+    std::cout << std::setw(8) << "lights" << std::setw(10) << "visible" << std::setw(14) << "binning ms"
+              << std::setw(14) << "main pass ms" << std::setw(12) << "frame ms" << std::endl;
+  }
+  std::cout << std::fixed << std::setprecision(3)
+            << std::setw(8) << m_LightCount << std::setw(10) << m_LightBenchmarkVisible / LIGHT_BENCHMARK_FRAMES
+            << std::setw(14) << gpu["light binning"] << std::setw(14) << gpu["main pass"]
+            << std::setw(12) << elapsed.count() / LIGHT_BENCHMARK_FRAMES << std::defaultfloat << std::endl;
+
+  m_LightBenchmarkStep++;
+  m_LightBenchmarkFrame = 0;
+  if (m_LightBenchmarkStep == sizeof(s_BenchmarkLightCounts) / sizeof(s_BenchmarkLightCounts[0]))
+  {
+    requestClose();
+    return;
+  }
+  m_LightCount = s_BenchmarkLightCounts[m_LightBenchmarkStep];
+}
+
+void Volcano::startLightBenchmark()
+{
+  m_LightBenchmarkStep = 0;
+  m_LightBenchmarkFrame = 0;
+  m_LightCount = s_BenchmarkLightCounts[0];
+}
+
+void Volcano::destroyClusterResources()
+{
+  vkDestroyPipeline(m_Device, m_ClusterPipeline, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_ClusterPipelineLayout, m_Allocator);
+  vkDestroyDescriptorPool(m_Device, m_ClusterDescriptorPool, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_ClusterSetLayout, m_Allocator);
+
+  for (ClusterFrame& frame : m_ClusterFrames)
+  {
+    vkUnmapMemory(m_Device, frame.lightMemory);
+    vkUnmapMemory(m_Device, frame.paramsMemory);
+
+    VkBuffer buffers[] = {frame.lightBuffer, frame.paramsBuffer, frame.gridBuffer, frame.indexBuffer};
+    VkDeviceMemory memories[] = {frame.lightMemory, frame.paramsMemory, frame.gridMemory, frame.indexMemory};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+      vkDestroyBuffer(m_Device, buffers[i], m_Allocator);
+      vkFreeMemory(m_Device, memories[i], m_Allocator);
+    }
+  }
+  m_ClusterFrames.clear();
+}
@@ -0,0 +1,330 @@
+#include "../volcano.hpp"
+#include <iostream>
+#include <stdexcept>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Deferred path: subpass 0 fills the G-buffer, subpass 1 reads it back as input attachments in the same render pass.
+//Nothing outside the render pass ever reads the G-buffer, so it is transient and, where the device offers it,
+//lazily allocated: tilers keep it in tile memory and may never back it with real memory at all.
+
+static const VkFormat s_GBufferFormats[GBUFFER_ATTACHMENT_COUNT] =
+{
+  VK_FORMAT_R8G8B8A8_UNORM,          //albedo
+  VK_FORMAT_A2B10G10R10_UNORM_PACK32 //normal
+};
+
+//Both G-buffer formats are 32 bits per pixel
+#define GBUFFER_BYTES_PER_PIXEL (GBUFFER_ATTACHMENT_COUNT * 4)
+
+void Volcano::createGBuffer()
+{
+  PROFILE_FUNCTION();
+  m_GBufferLazy = true;
+  m_GBufferAllocatedBytes = 0;
+
+  for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+  {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {m_SwapChainExtent.width, m_SwapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = s_GBufferFormats[i];
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+                      VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(m_Device, &imageInfo, m_Allocator, &m_GBufferImages[i]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create G-buffer image!");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(m_Device, m_GBufferImages[i], &memoryRequirements);
+
+    //Desktop GPUs usually have no lazily allocated type, plain device local memory it is then
+    uint32_t memoryType;
+    if (!tryFindMemoryType(m_PhysicalDevice, memoryRequirements.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, memoryType))
+    {
+      m_GBufferLazy = false;
+      memoryType = findMemoryType(m_PhysicalDevice, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = memoryRequirements.size;
+    allocateInfo.memoryTypeIndex = memoryType;
+
+    if (vkAllocateMemory(m_Device, &allocateInfo, m_Allocator, &m_GBufferMemory[i]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to allocate G-buffer memory!");
+    }
+    vkBindImageMemory(m_Device, m_GBufferImages[i], m_GBufferMemory[i], 0);
+
+    m_GBufferImageViews[i] = createImageView(m_Device, m_GBufferImages[i], s_GBufferFormats[i], VK_IMAGE_ASPECT_COLOR_BIT);
+    m_GBufferAllocatedBytes += memoryRequirements.size;
+    m_Resources.addImage(m_GBufferImages[i], m_GBufferMemory[i], "G-buffer");
+    m_Resources.addImageView(m_GBufferImageViews[i], "G-buffer view");
+  }
+}
+
+void Volcano::createDeferredRenderPass()
+{
+  PROFILE_FUNCTION();
+
+  //0: swapchain (HDR scene color with post processing), 1: depth, 2..: G-buffer
+  VkAttachmentDescription attachments[2 + GBUFFER_ATTACHMENT_COUNT]{};
+
+  //Every pixel gets written by the lighting triangle, no need to clear
+  attachments[0].format = mainColorFormat();
+  attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[0].finalLayout = m_Config.postProcessing ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  attachments[1].format = m_DepthFormat;
+  attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference gBufferWriteRefs[GBUFFER_ATTACHMENT_COUNT];
+  VkAttachmentReference gBufferReadRefs[GBUFFER_ATTACHMENT_COUNT];
+
+  for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+  {
+    //DONT_CARE store is what lets the G-buffer stay on chip
+    VkAttachmentDescription& attachment = attachments[2 + i];
+    attachment.format = s_GBufferFormats[i];
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    gBufferWriteRefs[i] = {2 + i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    gBufferReadRefs[i] = {2 + i, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  }
+
+  VkAttachmentReference depthRef{1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference colorRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpasses[2]{};
+  subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[0].colorAttachmentCount = GBUFFER_ATTACHMENT_COUNT;
+  subpasses[0].pColorAttachments = gBufferWriteRefs;
+  subpasses[0].pDepthStencilAttachment = &depthRef;
+
+  subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[1].inputAttachmentCount = GBUFFER_ATTACHMENT_COUNT;
+  subpasses[1].pInputAttachments = gBufferReadRefs;
+  subpasses[1].colorAttachmentCount = 1;
+  subpasses[1].pColorAttachments = &colorRef;
+
+  VkSubpassDependency dependencies[4]{};
+
+  //Previous frame's writes to the shared depth and G-buffer, and its lighting reads of the G-buffer
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  //Swapchain image is first touched in subpass 1, chain its layout transition to the acquire semaphore wait.
+  //The scene color instead waits for last frame's post chain to stop sampling it.
+  dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].dstSubpass = 1;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  dependencies[1].srcAccessMask = 0;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  //G-buffer writes -> input attachment reads, per pixel so tilers never leave the tile
+  dependencies[2].srcSubpass = 0;
+  dependencies[2].dstSubpass = 1;
+  dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+  dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  //Lit result -> bloom and tonemap sampling it, unused without post processing
+  dependencies[3].srcSubpass = 1;
+  dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[3].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[3].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 2 + GBUFFER_ATTACHMENT_COUNT;
+  renderPassInfo.pAttachments = attachments;
+  renderPassInfo.subpassCount = 2;
+  renderPassInfo.pSubpasses = subpasses;
+  renderPassInfo.dependencyCount = m_Config.postProcessing ? 4 : 3;
+  renderPassInfo.pDependencies = dependencies;
+
+  if (vkCreateRenderPass(m_Device, &renderPassInfo, m_Allocator, &m_RenderPass) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create deferred render pass!");
+  }
+}
+
+void Volcano::createLightingPipeline()
+{
+  PROFILE_FUNCTION();
+
+  VkDescriptorSetLayoutBinding bindings[GBUFFER_ATTACHMENT_COUNT]{};
+  for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+  {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = GBUFFER_ATTACHMENT_COUNT;
+  layoutInfo.pBindings = bindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_LightingSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create lighting descriptor set layout!");
+  }
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+  poolSize.descriptorCount = GBUFFER_ATTACHMENT_COUNT;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+
+  if (vkCreateDescriptorPool(m_Device, &poolInfo, m_Allocator, &m_LightingDescriptorPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create lighting descriptor pool!");
+  }
+
+  VkDescriptorSetAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocateInfo.descriptorPool = m_LightingDescriptorPool;
+  allocateInfo.descriptorSetCount = 1;
+  allocateInfo.pSetLayouts = &m_LightingSetLayout;
+
+  if (vkAllocateDescriptorSets(m_Device, &allocateInfo, &m_LightingDescriptorSet) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate lighting descriptor set!");
+  }
+
+  //One G-buffer shared by every frame in flight, the external subpass dependency orders reuse
+  VkDescriptorImageInfo imageInfos[GBUFFER_ATTACHMENT_COUNT]{};
+  VkWriteDescriptorSet writes[GBUFFER_ATTACHMENT_COUNT]{};
+  for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+  {
+    imageInfos[i].imageView = m_GBufferImageViews[i];
+    imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = m_LightingDescriptorSet;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    writes[i].pImageInfo = &imageInfos[i];
+  }
+  vkUpdateDescriptorSets(m_Device, GBUFFER_ATTACHMENT_COUNT, writes, 0, nullptr);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &m_LightingSetLayout;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_LightingPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create lighting pipeline layout!");
+  }
+
+  VkShaderModule vertShaderModule = loadShader(VOLCANO_SHADER_DIR "fullscreen.vert.spv");
+  VkShaderModule fragShaderModule = loadShader(VOLCANO_SHADER_DIR "lighting.frag.spv");
+
+  m_LightingPipeline = createFullscreenPipeline(m_Device, m_PipelineCache, vertShaderModule, fragShaderModule,
+                                                m_LightingPipelineLayout, m_RenderPass, 1, nullptr, m_Allocator);
+
+  vkDestroyShaderModule(m_Device, fragShaderModule, m_Allocator);
+  vkDestroyShaderModule(m_Device, vertShaderModule, m_Allocator);
+}
+
+void Volcano::recordLightingSubpass(VkCommandBuffer commandBuffer)
+{
+  vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+
+  GPU_SCOPE(m_GpuTimeline, commandBuffer, "lighting");
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_LightingPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_LightingPipelineLayout, 0, 1,
+                          &m_LightingDescriptorSet, 0, nullptr);
+  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void Volcano::reportRendererMemory()
+{
+  double pixels = static_cast<double>(m_SwapChainExtent.width) * m_SwapChainExtent.height;
+  double gBufferBytesPerPixel = GBUFFER_BYTES_PER_PIXEL;
+
+  //Bytes that would go to and come back from memory if the G-buffer were stored and read in a separate pass
+  double roundTripMB = 2.0 * gBufferBytesPerPixel * pixels / (1024.0 * 1024.0);
+
+  std::cout << "Deferred G-buffer: " << GBUFFER_ATTACHMENT_COUNT << " attachments, "
+            << gBufferBytesPerPixel << " bytes/pixel, " << m_GBufferAllocatedBytes / (1024.0 * 1024.0) << " MB allocated"
+            << (m_GBufferLazy ? " (lazily allocated)" : " (device local, no lazy memory type)") << std::endl;
+  //Worked out from the formats and the resolution, nothing here is measured
+  std::cout << "  estimated: a separate G-buffer pass would add " << roundTripMB << " MB of write + read traffic per "
+            << "frame, subpass input attachments let tilers skip it" << std::endl;
+}
+
+void Volcano::reportGBufferCommitment()
+{
+  if (!m_GBufferLazy)
+  {
+    return;
+  }
+
+  //Only meaningful after some frames, a tiler that kept everything on chip reports 0 here
+  VkDeviceSize committed = 0;
+  for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+  {
+    VkDeviceSize bytes = 0;
+    vkGetDeviceMemoryCommitment(m_Device, m_GBufferMemory[i], &bytes);
+    committed += bytes;
+  }
+
+  std::cout << "Deferred G-buffer: " << committed / (1024.0 * 1024.0) << " MB of "
+            << m_GBufferAllocatedBytes / (1024.0 * 1024.0) << " MB lazily allocated memory actually committed" << std::endl;
+}
+
+void Volcano::destroyDeferredResources()
+{
+  vkDestroyPipeline(m_Device, m_LightingPipeline, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_LightingPipelineLayout, m_Allocator);
+  vkDestroyDescriptorPool(m_Device, m_LightingDescriptorPool, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_LightingSetLayout, m_Allocator);
+}
@@ -0,0 +1,596 @@
+#include "../volcano.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Two phase occlusion culling. Phase 0 draws whatever was visible last frame (after a frustum test) with indirect
+//draws, then the main pass is interrupted: its depth is reduced into a Hi-Z pyramid holding the farthest depth per
+//texel, every object in the frustum is tested against it, and phase 1 draws the ones that are visible now but weren't
+//drawn yet. Objects that just came into view cost one extra test, nothing pops in for a frame, and nothing needs to be
+//reprojected: the Hi-Z is this frame's own depth. All the decisions stay on the GPU, the CPU only reads the counters
+//back once the frame's fence has signaled.
+
+#define CULL_GROUP_SIZE 64
+#define HIZ_GROUP_SIZE 8
+
+//One object's draw, std430 layout of ObjectData in indirect.vert / occlusion_cull.comp
+struct GpuObject
+{
+  Mat4 mvp;
+  Mat4 modelView;
+  float sphere[4];
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t objectId;
+  uint32_t padding;
+};
+
+struct CullPushConstants
+{
+  Mat4 viewProjection;
+  uint32_t renderSize[2];
+  uint32_t hiZSize[2];
+  uint32_t objectCount;
+  uint32_t phase;
+  uint32_t hiZLevels;
+};
+
+struct HiZPushConstants
+{
+  int32_t sourceSize[2];
+  int32_t destinationSize[2];
+};
+
+static VkImageAspectFlags depthBarrierAspect(VkFormat format)
+{
+  //Without separateDepthStencilLayouts a layout transition covers both aspects
+  VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT)
+    aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  return aspect;
+}
+
+//Level 0 is half the rendered area rounding down, every level after that halves again down to 1x1
+static VkExtent2D hiZLevelExtent(VkExtent2D renderExtent, uint32_t level)
+{
+  uint32_t width = std::max(1u, renderExtent.width / 2);
+  uint32_t height = std::max(1u, renderExtent.height / 2);
+  return {std::max(1u, width >> level), std::max(1u, height >> level)};
+}
+
+void Volcano::createOcclusionResources()
+{
+  PROFILE_FUNCTION();
+  VkExtent2D extent = hiZLevelExtent(m_SwapChainExtent, 0);
+  m_HiZLevels = 1;
+  while (m_HiZLevels < HIZ_MAX_LEVELS && (extent.width >> m_HiZLevels || extent.height >> m_HiZLevels))
+  {
+    m_HiZLevels++;
+  }
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {extent.width, extent.height, 1};
+  imageInfo.mipLevels = m_HiZLevels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = VK_FORMAT_R32_SFLOAT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateImage(m_Device, &imageInfo, m_Allocator, &m_HiZImage) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create Hi-Z image!");
+  }
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(m_Device, m_HiZImage, &memoryRequirements);
+
+  VkMemoryAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize = memoryRequirements.size;
+  allocateInfo.memoryTypeIndex = findMemoryType(m_PhysicalDevice, memoryRequirements.memoryTypeBits,
+                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  if (vkAllocateMemory(m_Device, &allocateInfo, m_Allocator, &m_HiZMemory) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate Hi-Z memory!");
+  }
+  vkBindImageMemory(m_Device, m_HiZImage, m_HiZMemory, 0);
+  m_Resources.addImage(m_HiZImage, m_HiZMemory, "Hi-Z");
+
+  //One view per level for the build, one over the whole chain for the cull's texelFetch
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = m_HiZImage;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = VK_FORMAT_R32_SFLOAT;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_HiZLevels, 0, 1};
+
+  if (vkCreateImageView(m_Device, &viewInfo, m_Allocator, &m_HiZView) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create Hi-Z view!");
+  }
+  m_Resources.addImageView(m_HiZView, "Hi-Z view");
+  for (uint32_t i = 0; i < m_HiZLevels; i++)
+  {
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1};
+    if (vkCreateImageView(m_Device, &viewInfo, m_Allocator, &m_HiZMipViews[i]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create Hi-Z level view!");
+    }
+    m_Resources.addImageView(m_HiZMipViews[i], "Hi-Z level view");
+  }
+
+  //Only ever texelFetch'd, the sampler is there because a combined image sampler needs one
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_NEAREST;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = static_cast<float>(m_HiZLevels);
+
+  if (vkCreateSampler(m_Device, &samplerInfo, m_Allocator, &m_HiZSampler) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create Hi-Z sampler!");
+  }
+
+  //Objects (also read by indirect.vert), visibility, commands, stats, Hi-Z
+  VkDescriptorSetLayoutBinding bindings[5]{};
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 5;
+  layoutInfo.pBindings = bindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_OcclusionSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create occlusion descriptor set layout!");
+  }
+
+  //Hi-Z build: sampled source level (or the depth buffer) + storage destination level
+  VkDescriptorSetLayoutBinding hiZBindings[2]{};
+  hiZBindings[0].binding = 0;
+  hiZBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  hiZBindings[0].descriptorCount = 1;
+  hiZBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  hiZBindings[1].binding = 1;
+  hiZBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  hiZBindings[1].descriptorCount = 1;
+  hiZBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = hiZBindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_HiZSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create Hi-Z descriptor set layout!");
+  }
+
+  //The per frame sets are allocated in createOcclusionBuffers once the scene exists
+  uint32_t frames = m_Config.framesInFlight;
+  VkDescriptorPoolSize poolSizes[3]{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[0].descriptorCount = 4 * frames;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[1].descriptorCount = frames + m_HiZLevels;
+  poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[2].descriptorCount = m_HiZLevels;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = frames + m_HiZLevels;
+  poolInfo.poolSizeCount = 3;
+  poolInfo.pPoolSizes = poolSizes;
+
+  if (vkCreateDescriptorPool(m_Device, &poolInfo, m_Allocator, &m_OcclusionDescriptorPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create occlusion descriptor pool!");
+  }
+
+  std::vector<VkDescriptorSetLayout> hiZLayouts(m_HiZLevels, m_HiZSetLayout);
+  VkDescriptorSetAllocateInfo setAllocateInfo{};
+  setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  setAllocateInfo.descriptorPool = m_OcclusionDescriptorPool;
+  setAllocateInfo.descriptorSetCount = m_HiZLevels;
+  setAllocateInfo.pSetLayouts = hiZLayouts.data();
+
+  if (vkAllocateDescriptorSets(m_Device, &setAllocateInfo, m_HiZSets) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate Hi-Z descriptor sets!");
+  }
+
+  for (uint32_t i = 0; i < m_HiZLevels; i++)
+  {
+    //Level 0 reduces the depth buffer, every other level the one above it
+    VkImageView sourceView = i == 0 ? m_DepthImageView : m_HiZMipViews[i - 1];
+    VkImageLayout sourceLayout = i == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+    VkDescriptorImageInfo sourceInfo{m_HiZSampler, sourceView, sourceLayout};
+    VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, m_HiZMipViews[i], VK_IMAGE_LAYOUT_GENERAL};
+
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = m_HiZSets[i];
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &sourceInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = m_HiZSets[i];
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = &destinationInfo;
+    vkUpdateDescriptorSets(m_Device, 2, writes, 0, nullptr);
+  }
+
+  VkPushConstantRange hiZPushRange{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZPushConstants)};
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &m_HiZSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &hiZPushRange;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_HiZPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create Hi-Z pipeline layout!");
+  }
+
+  VkPushConstantRange cullPushRange{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants)};
+  pipelineLayoutInfo.pSetLayouts = &m_OcclusionSetLayout;
+  pipelineLayoutInfo.pPushConstantRanges = &cullPushRange;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_CullPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create occlusion cull pipeline layout!");
+  }
+
+  VkShaderModule hiZShaderModule = loadShader(VOLCANO_SHADER_DIR "hiz_build.comp.spv");
+  VkShaderModule cullShaderModule = loadShader(VOLCANO_SHADER_DIR "occlusion_cull.comp.spv");
+  m_HiZPipeline = createComputePipeline(m_Device, m_PipelineCache, hiZShaderModule, m_HiZPipelineLayout, m_Allocator);
+  m_CullPipeline = createComputePipeline(m_Device, m_PipelineCache, cullShaderModule, m_CullPipelineLayout, m_Allocator);
+  vkDestroyShaderModule(m_Device, cullShaderModule, m_Allocator);
+  vkDestroyShaderModule(m_Device, hiZShaderModule, m_Allocator);
+}
+
+void Volcano::createOcclusionBuffers()
+{
+  PROFILE_FUNCTION();
+  m_OcclusionObjectCount = static_cast<uint32_t>(m_Objects.size());
+  VkDeviceSize objectBytes = sizeof(GpuObject) * std::max(m_OcclusionObjectCount, 1u);
+  VkDeviceSize visibilityBytes = sizeof(uint32_t) * std::max(m_OcclusionObjectCount, 1u);
+  VkDeviceSize indirectBytes = 2 * sizeof(VkDrawIndexedIndirectCommand) * std::max(m_OcclusionObjectCount, 1u);
+
+  createBuffer(m_Device, m_PhysicalDevice, visibilityBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_VisibilityBuffer, m_VisibilityMemory);
+  createBuffer(m_Device, m_PhysicalDevice, indirectBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_IndirectBuffer, m_IndirectMemory);
+  m_Resources.addBuffer(m_VisibilityBuffer, m_VisibilityMemory, "occlusion visibility");
+  m_Resources.addBuffer(m_IndirectBuffer, m_IndirectMemory, "occlusion indirect");
+
+  //Nothing counts as visible before the first frame: phase 0 draws nothing and phase 1 sorts it out
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands(m_Device, m_CommandPool);
+  vkCmdFillBuffer(commandBuffer, m_VisibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+  endSingleTimeCommands(m_Device, m_CommandPool, m_GraphicsQueue, commandBuffer);
+
+  uint32_t frames = m_Config.framesInFlight;
+  std::vector<VkDescriptorSetLayout> setLayouts(frames, m_OcclusionSetLayout);
+  std::vector<VkDescriptorSet> sets(frames);
+  VkDescriptorSetAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocateInfo.descriptorPool = m_OcclusionDescriptorPool;
+  allocateInfo.descriptorSetCount = frames;
+  allocateInfo.pSetLayouts = setLayouts.data();
+
+  if (vkAllocateDescriptorSets(m_Device, &allocateInfo, sets.data()) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate occlusion descriptor sets!");
+  }
+
+  m_OcclusionFrames.resize(frames);
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    OcclusionFrame& frame = m_OcclusionFrames[i];
+    frame.descriptorSet = sets[i];
+
+    //Rewritten by the CPU every frame and read back by it, so these two are per frame in flight
+    VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    createBuffer(m_Device, m_PhysicalDevice, objectBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible,
+                 frame.objectBuffer, frame.objectMemory);
+    createBuffer(m_Device, m_PhysicalDevice, sizeof(OcclusionStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible,
+                 frame.statsBuffer, frame.statsMemory);
+    vkMapMemory(m_Device, frame.objectMemory, 0, objectBytes, 0, &frame.objectsMapped);
+    vkMapMemory(m_Device, frame.statsMemory, 0, sizeof(OcclusionStats), 0, &frame.statsMapped);
+    memset(frame.statsMapped, 0, sizeof(OcclusionStats));
+    m_Resources.addBuffer(frame.objectBuffer, frame.objectMemory, "occlusion objects");
+    m_Resources.addBuffer(frame.statsBuffer, frame.statsMemory, "occlusion stats");
+
+    VkDescriptorBufferInfo bufferInfos[4]{};
+    bufferInfos[0] = {frame.objectBuffer, 0, objectBytes};
+    bufferInfos[1] = {m_VisibilityBuffer, 0, visibilityBytes};
+    bufferInfos[2] = {m_IndirectBuffer, 0, indirectBytes};
+    bufferInfos[3] = {frame.statsBuffer, 0, sizeof(OcclusionStats)};
+    VkDescriptorImageInfo hiZInfo{m_HiZSampler, m_HiZView, VK_IMAGE_LAYOUT_GENERAL};
+
+    VkWriteDescriptorSet writes[5]{};
+    for (uint32_t binding = 0; binding < 5; binding++)
+    {
+      writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[binding].dstSet = frame.descriptorSet;
+      writes[binding].dstBinding = binding;
+      writes[binding].descriptorCount = 1;
+      if (binding < 4)
+      {
+        writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[binding].pBufferInfo = &bufferInfos[binding];
+      }
+      else
+      {
+        writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[binding].pImageInfo = &hiZInfo;
+      }
+    }
+    vkUpdateDescriptorSets(m_Device, 5, writes, 0, nullptr);
+  }
+}
+
+void Volcano::uploadOcclusionObjects(const Mat4& viewProjection)
+{
+  PROFILE_FUNCTION();
+  //In draw queue order, so the indirect draws keep the front to back sort. m_DrawList is built one item per
+  //object in m_Objects order, a packet's item doubles as the object id the visibility buffer is indexed by.
+  GpuObject* objects = static_cast<GpuObject*>(m_OcclusionFrames[m_CurrentFrame].objectsMapped);
+  uint32_t slot = 0;
+  for (const DrawPacket& packet : m_DrawQueue.packets())
+  {
+    const DrawItem& draw = m_DrawList[packet.item];
+    const SceneObject& object = m_Objects[packet.item];
+    GpuObject& gpuObject = objects[slot++];
+    gpuObject.mvp = draw.mvp;
+    gpuObject.modelView = draw.modelView;
+    gpuObject.sphere[0] = object.center.x;
+    gpuObject.sphere[1] = object.center.y;
+    gpuObject.sphere[2] = object.center.z;
+    gpuObject.sphere[3] = object.radius;
+    gpuObject.firstIndex = draw.firstIndex;
+    gpuObject.indexCount = draw.indexCount;
+    gpuObject.objectId = packet.item;
+  }
+  m_OcclusionViewProjection = viewProjection;
+}
+
+void Volcano::recordOcclusionCull(VkCommandBuffer commandBuffer, uint32_t phase)
+{
+  m_GpuTimeline.beginRange(commandBuffer, phase == 0 ? "occlusion cull early" : "occlusion cull late");
+
+  //Phase 0 reuses the command buffer last frame's draws read and the visibility its phase 1 wrote,
+  //phase 1 the visibility phase 0 just read
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  if (phase == 0)
+  {
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  VkExtent2D hiZExtent = hiZLevelExtent(m_RenderExtent, 0);
+  CullPushConstants push{};
+  push.viewProjection = m_OcclusionViewProjection;
+  push.renderSize[0] = m_RenderExtent.width;
+  push.renderSize[1] = m_RenderExtent.height;
+  push.hiZSize[0] = hiZExtent.width;
+  push.hiZSize[1] = hiZExtent.height;
+  push.objectCount = m_OcclusionObjectCount;
+  push.phase = phase;
+  push.hiZLevels = m_HiZLevels;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipelineLayout, 0, 1,
+                          &m_OcclusionFrames[m_CurrentFrame].descriptorSet, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, m_CullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vkCmdDispatch(commandBuffer, (m_OcclusionObjectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  //The late cull's counters are final, make them visible to collectOcclusionStats
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  if (phase == 1)
+  {
+    barrier.dstAccessMask |= VK_ACCESS_HOST_READ_BIT;
+    dstStages |= VK_PIPELINE_STAGE_HOST_BIT;
+  }
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0,
+                       1, &barrier, 0, nullptr, 0, nullptr);
+
+  m_GpuTimeline.endRange(commandBuffer);
+}
+
+void Volcano::recordOcclusionDraws(VkCommandBuffer commandBuffer, uint32_t phase)
+{
+  //The cluster and shadow sets stay bound at 0 and 1, the layout is shared with the regular mesh pipeline
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_IndirectPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 2, 1,
+                          &m_OcclusionFrames[m_CurrentFrame].descriptorSet, 0, nullptr);
+
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_MeshBindings[MESH_SCENE].vertexBuffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, m_MeshBindings[MESH_SCENE].indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+  m_FrameStats.bindsIssued += 3;
+
+  //Culled objects keep their slot with instanceCount 0, no count buffer needed
+  uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  VkDeviceSize firstCommand = static_cast<VkDeviceSize>(phase) * m_OcclusionObjectCount * stride;
+  if (m_MultiDrawIndirectEnabled)
+  {
+    vkCmdDrawIndexedIndirect(commandBuffer, m_IndirectBuffer, firstCommand, m_OcclusionObjectCount, stride);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < m_OcclusionObjectCount; i++)
+    {
+      vkCmdDrawIndexedIndirect(commandBuffer, m_IndirectBuffer, firstCommand + i * stride, 1, stride);
+    }
+  }
+}
+
+void Volcano::recordOcclusionLatePass(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  vkCmdEndRendering(commandBuffer);
+
+  //Phase 0's depth becomes the Hi-Z source. The Hi-Z itself is rebuilt from scratch, it only has to wait for
+  //last frame's phase 1 to be done reading it.
+  VkImageMemoryBarrier imageBarriers[2]{};
+  imageBarriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imageBarriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  imageBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  imageBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarriers[0].image = m_DepthImage;
+  imageBarriers[0].subresourceRange = {depthBarrierAspect(m_DepthFormat), 0, 1, 0, 1};
+
+  imageBarriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imageBarriers[1].srcAccessMask = 0;
+  imageBarriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  imageBarriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarriers[1].image = m_HiZImage;
+  imageBarriers[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_HiZLevels, 0, 1};
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       0, nullptr, 0, nullptr, 2, imageBarriers);
+
+  m_GpuTimeline.beginRange(commandBuffer, "hi-z build");
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_HiZPipeline);
+  for (uint32_t i = 0; i < m_HiZLevels; i++)
+  {
+    VkExtent2D source = i == 0 ? m_RenderExtent : hiZLevelExtent(m_RenderExtent, i - 1);
+    VkExtent2D destination = hiZLevelExtent(m_RenderExtent, i);
+    HiZPushConstants push{{static_cast<int32_t>(source.width), static_cast<int32_t>(source.height)},
+                          {static_cast<int32_t>(destination.width), static_cast<int32_t>(destination.height)}};
+    vkCmdPushConstants(commandBuffer, m_HiZPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_HiZPipelineLayout, 0, 1,
+                            &m_HiZSets[i], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (destination.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+                  (destination.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+    VkMemoryBarrier levelBarrier{};
+    levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &levelBarrier, 0, nullptr, 0, nullptr);
+  }
+  m_GpuTimeline.endRange(commandBuffer);
+
+  recordOcclusionCull(commandBuffer, 1);
+
+  //Back to attachments for phase 1. Color never left its layout, it only needs phase 0's writes before the load.
+  imageBarriers[0].srcAccessMask = 0;
+  imageBarriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkImageMemoryBarrier& colorBarrier = imageBarriers[1];
+  colorBarrier = {};
+  colorBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  colorBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  colorBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  colorBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  colorBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  colorBarrier.image = m_Config.postProcessing ? m_SceneColor : m_SwapChainImages[imageIndex];
+  colorBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                       0, nullptr, 0, nullptr, 2, imageBarriers);
+
+  //Same attachments as beginDynamicRendering, loaded instead of cleared. Rendering stays open for
+  //endDynamicRendering like it was never interrupted.
+  VkRenderingAttachmentInfo colorAttachment{};
+  colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  colorAttachment.imageView = m_Config.postProcessing ? m_SceneColorView : m_SwapChainImageViews[imageIndex];
+  colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+  VkRenderingAttachmentInfo depthAttachment{};
+  depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  depthAttachment.imageView = m_DepthImageView;
+  depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+  VkRenderingInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  renderingInfo.renderArea.offset = {0, 0};
+  renderingInfo.renderArea.extent = m_RenderExtent;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachments = &colorAttachment;
+  renderingInfo.pDepthAttachment = &depthAttachment;
+  vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+  m_GpuTimeline.beginRange(commandBuffer, "occlusion late pass");
+  VkViewport viewport{0.0f, 0.0f, static_cast<float>(m_RenderExtent.width), static_cast<float>(m_RenderExtent.height), 0.0f, 1.0f};
+  VkRect2D scissor{{0, 0}, m_RenderExtent};
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  bindClusterSet(commandBuffer);
+  bindShadowSet(commandBuffer);
+  recordOcclusionDraws(commandBuffer, 1);
+  m_GpuTimeline.endRange(commandBuffer);
+}
+
+void Volcano::collectOcclusionStats(uint32_t frameIndex)
+{
+  //frameIndex's fence has signaled, its counters are final. Zeroed for the next use of the slot, the writes are
+  //visible to the GPU at the next submit.
+  OcclusionFrame& frame = m_OcclusionFrames[frameIndex];
+  memcpy(&m_OcclusionStats, frame.statsMapped, sizeof(OcclusionStats));
+  memset(frame.statsMapped, 0, sizeof(OcclusionStats));
+}
+
+void Volcano::destroyOcclusionResources()
+{
+  vkDestroyPipeline(m_Device, m_CullPipeline, m_Allocator);
+  vkDestroyPipeline(m_Device, m_HiZPipeline, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_CullPipelineLayout, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_HiZPipelineLayout, m_Allocator);
+  vkDestroyDescriptorPool(m_Device, m_OcclusionDescriptorPool, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_HiZSetLayout, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_OcclusionSetLayout, m_Allocator);
+  vkDestroySampler(m_Device, m_HiZSampler, m_Allocator);
+
+  //The buffers, the Hi-Z image and its views go with m_Resources
+  for (OcclusionFrame& frame : m_OcclusionFrames)
+  {
+    vkUnmapMemory(m_Device, frame.objectMemory);
+    vkUnmapMemory(m_Device, frame.statsMemory);
+  }
+  m_OcclusionFrames.clear();
+}
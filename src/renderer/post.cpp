@@ -0,0 +1,551 @@
+#include "../volcano.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Post chain: the renderers write linear HDR color into m_SceneColor instead of the swapchain. Compute passes build
+//a bloom pyramid starting at half resolution (threshold + downsample, then tent upsample back up the levels), and a
+//fullscreen pass applies exposure, adds the bloom and tonemaps into the swapchain image. A fragment pass rather than
+//a compute store because the usual _SRGB swapchain formats can't be storage images.
+
+//Rendered into and sampled, rgba16f is also one of the formats every device has to support as a storage image
+#define SCENE_COLOR_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+
+#define BLOOM_THRESHOLD 1.0f
+#define BLOOM_KNEE 0.5f
+#define BLOOM_STRENGTH 0.6f
+#define POST_GROUP_SIZE 8
+//Tonemap sharpening once the render scale is at RENDER_SCALE_MIN, fades out towards native resolution
+#define UPSCALE_SHARPNESS 0.6f
+
+//Layout shared by bloom_down.comp and bloom_up.comp
+struct BloomPushConstants
+{
+  float sourceTexelSize[2];
+  //Part of the source that holds the image, below 1 on level 0 when the scene renders at a reduced scale
+  float sourceUvScale[2];
+  float threshold;
+  float knee;
+  uint32_t prefilter;
+};
+
+struct TonemapPushConstants
+{
+  float uvScale[2];
+  float sceneTexelSize[2];
+  float sharpness;
+  float exposure;
+  float bloomStrength;
+  uint32_t encodeSrgb;
+};
+
+static VkImageView createMipView(VkDevice device, VkImage image, VkFormat format, uint32_t mip,
+                                 const VkAllocationCallbacks* allocator)
+{
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 1};
+
+  VkImageView view;
+  if (vkCreateImageView(device, &viewInfo, allocator, &view) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create bloom mip view!");
+  }
+  return view;
+}
+
+static bool isSrgbFormat(VkFormat format)
+{
+  return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+}
+
+VkFormat Volcano::mainColorFormat() const
+{
+  return m_Config.postProcessing ? SCENE_COLOR_FORMAT : m_SwapChainImageFormat;
+}
+
+void Volcano::createSceneColor()
+{
+  PROFILE_FUNCTION();
+  createImage(m_Device, m_PhysicalDevice, m_SwapChainExtent.width, m_SwapChainExtent.height, SCENE_COLOR_FORMAT,
+              VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_SceneColor, m_SceneColorMemory);
+  m_SceneColorView = createImageView(m_Device, m_SceneColor, SCENE_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+  m_Resources.addImage(m_SceneColor, m_SceneColorMemory, "scene color");
+  m_Resources.addImageView(m_SceneColorView, "scene color view");
+
+  //Level 0 is half resolution, every level after that halves again
+  VkExtent2D extent = m_SwapChainExtent;
+  for (uint32_t i = 0; i < BLOOM_MIP_COUNT; i++)
+  {
+    extent = {std::max(1u, extent.width / 2), std::max(1u, extent.height / 2)};
+    m_BloomExtents[i] = extent;
+  }
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {m_BloomExtents[0].width, m_BloomExtents[0].height, 1};
+  imageInfo.mipLevels = BLOOM_MIP_COUNT;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = SCENE_COLOR_FORMAT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateImage(m_Device, &imageInfo, m_Allocator, &m_BloomImage) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create bloom image!");
+  }
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(m_Device, m_BloomImage, &memoryRequirements);
+
+  VkMemoryAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize = memoryRequirements.size;
+  allocateInfo.memoryTypeIndex = findMemoryType(m_PhysicalDevice, memoryRequirements.memoryTypeBits,
+                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  if (vkAllocateMemory(m_Device, &allocateInfo, m_Allocator, &m_BloomMemory) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate bloom memory!");
+  }
+  vkBindImageMemory(m_Device, m_BloomImage, m_BloomMemory, 0);
+  m_Resources.addImage(m_BloomImage, m_BloomMemory, "bloom");
+
+  for (uint32_t i = 0; i < BLOOM_MIP_COUNT; i++)
+  {
+    m_BloomMipViews[i] = createMipView(m_Device, m_BloomImage, SCENE_COLOR_FORMAT, i, m_Allocator);
+    m_Resources.addImageView(m_BloomMipViews[i], "bloom level view");
+  }
+}
+
+void Volcano::createPostResources()
+{
+  PROFILE_FUNCTION();
+  createSceneColor();
+
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = 0.0f;
+
+  if (vkCreateSampler(m_Device, &samplerInfo, m_Allocator, &m_PostSampler) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create post sampler!");
+  }
+
+  //Bloom: sampled source level + storage destination level
+  VkDescriptorSetLayoutBinding bloomBindings[2]{};
+  bloomBindings[0].binding = 0;
+  bloomBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bloomBindings[0].descriptorCount = 1;
+  bloomBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  bloomBindings[1].binding = 1;
+  bloomBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bloomBindings[1].descriptorCount = 1;
+  bloomBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = bloomBindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_BloomSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create bloom descriptor set layout!");
+  }
+
+  //Tonemap: scene color + bloom level 0
+  VkDescriptorSetLayoutBinding tonemapBindings[2]{};
+  for (uint32_t i = 0; i < 2; i++)
+  {
+    tonemapBindings[i].binding = i;
+    tonemapBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    tonemapBindings[i].descriptorCount = 1;
+    tonemapBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  }
+  layoutInfo.pBindings = tonemapBindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_TonemapSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create tonemap descriptor set layout!");
+  }
+
+  //BLOOM_MIP_COUNT downsample sets, one fewer upsample sets, one tonemap set. The images are shared by every
+  //frame in flight like the depth buffer, the barriers in recordPostChain order reuse.
+  uint32_t setCount = 2 * BLOOM_MIP_COUNT;
+  VkDescriptorPoolSize poolSizes[2]{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount = 2 * BLOOM_MIP_COUNT + 1;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[1].descriptorCount = 2 * BLOOM_MIP_COUNT - 1;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = setCount;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+
+  if (vkCreateDescriptorPool(m_Device, &poolInfo, m_Allocator, &m_PostDescriptorPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create post descriptor pool!");
+  }
+
+  std::vector<VkDescriptorSetLayout> setLayouts(setCount - 1, m_BloomSetLayout);
+  setLayouts.push_back(m_TonemapSetLayout);
+  std::vector<VkDescriptorSet> sets(setCount);
+
+  VkDescriptorSetAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocateInfo.descriptorPool = m_PostDescriptorPool;
+  allocateInfo.descriptorSetCount = setCount;
+  allocateInfo.pSetLayouts = setLayouts.data();
+
+  if (vkAllocateDescriptorSets(m_Device, &allocateInfo, sets.data()) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate post descriptor sets!");
+  }
+
+  auto writeBloomSet = [&](VkDescriptorSet set, VkImageView source, VkImageLayout sourceLayout, VkImageView destination)
+  {
+    VkDescriptorImageInfo sourceInfo{m_PostSampler, source, sourceLayout};
+    VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, destination, VK_IMAGE_LAYOUT_GENERAL};
+
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &sourceInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = &destinationInfo;
+    vkUpdateDescriptorSets(m_Device, 2, writes, 0, nullptr);
+  };
+
+  //Every bloom level stays GENERAL, it's read and written by compute in turns
+  for (uint32_t i = 0; i < BLOOM_MIP_COUNT; i++)
+  {
+    m_BloomDownSets[i] = sets[i];
+    if (i == 0)
+    {
+      writeBloomSet(m_BloomDownSets[i], m_SceneColorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_BloomMipViews[0]);
+    }
+    else
+    {
+      writeBloomSet(m_BloomDownSets[i], m_BloomMipViews[i - 1], VK_IMAGE_LAYOUT_GENERAL, m_BloomMipViews[i]);
+    }
+  }
+  for (uint32_t i = 0; i + 1 < BLOOM_MIP_COUNT; i++)
+  {
+    m_BloomUpSets[i] = sets[BLOOM_MIP_COUNT + i];
+    writeBloomSet(m_BloomUpSets[i], m_BloomMipViews[i + 1], VK_IMAGE_LAYOUT_GENERAL, m_BloomMipViews[i]);
+  }
+
+  m_TonemapSet = sets[setCount - 1];
+  VkDescriptorImageInfo tonemapInfos[2] =
+  {
+    {m_PostSampler, m_SceneColorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+    {m_PostSampler, m_BloomMipViews[0], VK_IMAGE_LAYOUT_GENERAL}
+  };
+  VkWriteDescriptorSet tonemapWrites[2]{};
+  for (uint32_t i = 0; i < 2; i++)
+  {
+    tonemapWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    tonemapWrites[i].dstSet = m_TonemapSet;
+    tonemapWrites[i].dstBinding = i;
+    tonemapWrites[i].descriptorCount = 1;
+    tonemapWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    tonemapWrites[i].pImageInfo = &tonemapInfos[i];
+  }
+  vkUpdateDescriptorSets(m_Device, 2, tonemapWrites, 0, nullptr);
+
+  VkPushConstantRange bloomPushRange{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants)};
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &m_BloomSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &bloomPushRange;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_BloomPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create bloom pipeline layout!");
+  }
+
+  VkPushConstantRange tonemapPushRange{VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TonemapPushConstants)};
+  pipelineLayoutInfo.pSetLayouts = &m_TonemapSetLayout;
+  pipelineLayoutInfo.pPushConstantRanges = &tonemapPushRange;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_TonemapPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create tonemap pipeline layout!");
+  }
+
+  VkShaderModule downShaderModule = loadShader(VOLCANO_SHADER_DIR "bloom_down.comp.spv");
+  VkShaderModule upShaderModule = loadShader(VOLCANO_SHADER_DIR "bloom_up.comp.spv");
+  m_BloomDownPipeline = createComputePipeline(m_Device, m_PipelineCache, downShaderModule, m_BloomPipelineLayout, m_Allocator);
+  m_BloomUpPipeline = createComputePipeline(m_Device, m_PipelineCache, upShaderModule, m_BloomPipelineLayout, m_Allocator);
+  vkDestroyShaderModule(m_Device, upShaderModule, m_Allocator);
+  vkDestroyShaderModule(m_Device, downShaderModule, m_Allocator);
+
+  //Tonemap writes the swapchain image: through its own render pass, or straight into it with dynamic rendering
+  if (!m_DynamicRenderingEnabled)
+  {
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = m_SwapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorRef;
+
+    //Chains the layout transition to the acquire semaphore wait, like the forward pass used to
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
+
+    if (vkCreateRenderPass(m_Device, &renderPassInfo, m_Allocator, &m_PostRenderPass) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create tonemap render pass!");
+    }
+
+    m_PostFramebuffers.resize(m_SwapChainImageViews.size());
+    for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
+    {
+      VkFramebufferCreateInfo framebufferInfo{};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = m_PostRenderPass;
+      framebufferInfo.attachmentCount = 1;
+      framebufferInfo.pAttachments = &m_SwapChainImageViews[i];
+      framebufferInfo.width = m_SwapChainExtent.width;
+      framebufferInfo.height = m_SwapChainExtent.height;
+      framebufferInfo.layers = 1;
+
+      if (vkCreateFramebuffer(m_Device, &framebufferInfo, m_Allocator, &m_PostFramebuffers[i]) != VK_SUCCESS)
+      {
+        throw std::runtime_error("Failed to create tonemap framebuffer!");
+      }
+    }
+  }
+
+  VkPipelineRenderingCreateInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachmentFormats = &m_SwapChainImageFormat;
+
+  VkShaderModule vertShaderModule = loadShader(VOLCANO_SHADER_DIR "fullscreen.vert.spv");
+  VkShaderModule fragShaderModule = loadShader(VOLCANO_SHADER_DIR "tonemap.frag.spv");
+  m_TonemapPipeline = createFullscreenPipeline(m_Device, m_PipelineCache, vertShaderModule, fragShaderModule,
+                                               m_TonemapPipelineLayout,
+                                               m_DynamicRenderingEnabled ? VK_NULL_HANDLE : m_PostRenderPass, 0,
+                                               m_DynamicRenderingEnabled ? &renderingInfo : nullptr, m_Allocator);
+  vkDestroyShaderModule(m_Device, fragShaderModule, m_Allocator);
+  vkDestroyShaderModule(m_Device, vertShaderModule, m_Allocator);
+}
+
+static void computeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStage)
+{
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Volcano::recordPostChain(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  //Every level is rewritten each frame, so UNDEFINED is fine. Waits for last frame's chain to finish with the levels.
+  VkImageMemoryBarrier bloomBarrier{};
+  bloomBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  bloomBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  bloomBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  bloomBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bloomBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bloomBarrier.image = m_BloomImage;
+  bloomBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, BLOOM_MIP_COUNT, 0, 1};
+  bloomBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  bloomBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &bloomBarrier);
+
+  //The scene only fills m_RenderExtent of the scene color, level 0 and the tonemap pass stretch that part over the
+  //whole output, which is the upscale. The pyramid itself stays at output resolution.
+  float uvScale[2] = {static_cast<float>(m_RenderExtent.width) / m_SwapChainExtent.width,
+                      static_cast<float>(m_RenderExtent.height) / m_SwapChainExtent.height};
+
+  auto dispatch = [&](VkExtent2D extent)
+  {
+    vkCmdDispatch(commandBuffer, (extent.width + POST_GROUP_SIZE - 1) / POST_GROUP_SIZE,
+                  (extent.height + POST_GROUP_SIZE - 1) / POST_GROUP_SIZE, 1);
+  };
+
+  m_GpuTimeline.beginRange(commandBuffer, "bloom downsample");
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_BloomDownPipeline);
+  for (uint32_t i = 0; i < BLOOM_MIP_COUNT; i++)
+  {
+    VkExtent2D sourceExtent = i == 0 ? m_SwapChainExtent : m_BloomExtents[i - 1];
+    float sourceUvScale[2] = {1.0f, 1.0f};
+    if (i == 0)
+    {
+      sourceUvScale[0] = uvScale[0];
+      sourceUvScale[1] = uvScale[1];
+    }
+    BloomPushConstants push{{1.0f / sourceExtent.width, 1.0f / sourceExtent.height}, {sourceUvScale[0], sourceUvScale[1]},
+                            BLOOM_THRESHOLD, BLOOM_KNEE, i == 0};
+    vkCmdPushConstants(commandBuffer, m_BloomPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_BloomPipelineLayout, 0, 1,
+                            &m_BloomDownSets[i], 0, nullptr);
+    dispatch(m_BloomExtents[i]);
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  }
+  m_GpuTimeline.endRange(commandBuffer);
+
+  m_GpuTimeline.beginRange(commandBuffer, "bloom upsample");
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_BloomUpPipeline);
+  for (uint32_t i = BLOOM_MIP_COUNT - 1; i-- > 0;)
+  {
+    BloomPushConstants push{{1.0f / m_BloomExtents[i + 1].width, 1.0f / m_BloomExtents[i + 1].height}, {1.0f, 1.0f}, 0.0f, 0.0f, 0};
+    vkCmdPushConstants(commandBuffer, m_BloomPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_BloomPipelineLayout, 0, 1,
+                            &m_BloomUpSets[i], 0, nullptr);
+    dispatch(m_BloomExtents[i]);
+    computeBarrier(commandBuffer, i == 0 ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  }
+  m_GpuTimeline.endRange(commandBuffer);
+
+  m_GpuTimeline.beginRange(commandBuffer, "tonemap");
+  if (m_DynamicRenderingEnabled)
+  {
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_SwapChainImages[imageIndex];
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+    VkRenderingAttachmentInfo colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachment.imageView = m_SwapChainImageViews[imageIndex];
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea.extent = m_SwapChainExtent;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    vkCmdBeginRendering(commandBuffer, &renderingInfo);
+  }
+  else
+  {
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_PostRenderPass;
+    renderPassInfo.framebuffer = m_PostFramebuffers[imageIndex];
+    renderPassInfo.renderArea.extent = m_SwapChainExtent;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  }
+
+  VkViewport viewport{0.0f, 0.0f, static_cast<float>(m_SwapChainExtent.width), static_cast<float>(m_SwapChainExtent.height), 0.0f, 1.0f};
+  VkRect2D scissor{{0, 0}, m_SwapChainExtent};
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  float sharpness = UPSCALE_SHARPNESS * (1.0f - m_RenderScale) / (1.0f - RENDER_SCALE_MIN);
+  TonemapPushConstants push{{uvScale[0], uvScale[1]}, {1.0f / m_SwapChainExtent.width, 1.0f / m_SwapChainExtent.height},
+                            sharpness, std::exp2(m_Config.exposure), BLOOM_STRENGTH, !isSrgbFormat(m_SwapChainImageFormat)};
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_TonemapPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_TonemapPipelineLayout, 0, 1,
+                          &m_TonemapSet, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, m_TonemapPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push);
+  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+  if (m_DynamicRenderingEnabled)
+  {
+    vkCmdEndRendering(commandBuffer);
+    recordPresentTransition(commandBuffer, imageIndex);
+  }
+  else
+  {
+    vkCmdEndRenderPass(commandBuffer);
+  }
+  m_GpuTimeline.endRange(commandBuffer);
+}
+
+void Volcano::destroyPostResources()
+{
+  vkDestroyPipeline(m_Device, m_TonemapPipeline, m_Allocator);
+  vkDestroyPipeline(m_Device, m_BloomUpPipeline, m_Allocator);
+  vkDestroyPipeline(m_Device, m_BloomDownPipeline, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_TonemapPipelineLayout, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_BloomPipelineLayout, m_Allocator);
+  vkDestroyDescriptorPool(m_Device, m_PostDescriptorPool, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_TonemapSetLayout, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_BloomSetLayout, m_Allocator);
+  vkDestroySampler(m_Device, m_PostSampler, m_Allocator);
+
+  for (VkFramebuffer framebuffer : m_PostFramebuffers)
+  {
+    vkDestroyFramebuffer(m_Device, framebuffer, m_Allocator);
+  }
+  m_PostFramebuffers.clear();
+  if (!m_DynamicRenderingEnabled)
+  {
+    vkDestroyRenderPass(m_Device, m_PostRenderPass, m_Allocator);
+  }
+}
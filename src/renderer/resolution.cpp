@@ -0,0 +1,102 @@
+#include "../volcano.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "../utils/profiler.hpp"
+
+//Dynamic resolution: nothing gets reallocated. The scene color, depth and G-buffer stay swapchain sized, the main
+//pass just renders into the top left m_RenderExtent of them (render area + viewport) and everything reading the
+//scene color scales its UVs to match. Every RENDER_SCALE_ADJUST_FRAMES frames the average GPU frame time is compared
+//against --gpu-budget: over budget shrinks right away, growing only starts once there's real headroom and goes in
+//small steps, so the scale doesn't bounce between two sizes.
+
+#define RENDER_SCALE_ADJUST_FRAMES 8
+//Aim a bit under the budget so one slow frame doesn't put us straight back over it
+#define RENDER_SCALE_TARGET 0.9
+//Only grow below this fraction of the budget
+#define RENDER_SCALE_HEADROOM 0.75
+#define RENDER_SCALE_MAX_GROWTH 1.05
+//Render extents are kept to multiples of this, less churn and no odd sizes for the bilinear upscale
+#define RENDER_SCALE_ALIGN 8
+
+void Volcano::initRenderScale()
+{
+  m_RenderExtent = m_SwapChainExtent;
+  m_RenderScale = 1.0f;
+  if (!m_Config.postProcessing)
+  {
+    if (m_Config.dynamicResolution || m_Config.renderScale < 1.0f)
+    {
+      std::cout << "Render scale needs post processing for the upscale pass, rendering at native resolution" << std::endl;
+    }
+    return;
+  }
+
+  if (m_Config.dynamicResolution)
+  {
+    if (m_GpuTimeline.timestampsEnabled())
+    {
+      m_DynamicResolutionEnabled = true;
+      std::cout << "Dynamic resolution: " << m_Config.gpuBudgetMs << " ms GPU budget" << std::endl;
+    }
+    else
+    {
+      std::cout << "No timestamp queries on the graphics queue, dynamic resolution off" << std::endl;
+    }
+  }
+  setRenderScale(m_Config.renderScale);
+}
+
+void Volcano::setRenderScale(float scale)
+{
+  scale = std::clamp(scale, RENDER_SCALE_MIN, 1.0f);
+  auto scaled = [&](uint32_t size)
+  {
+    uint32_t aligned = static_cast<uint32_t>(std::lround(size * scale / RENDER_SCALE_ALIGN)) * RENDER_SCALE_ALIGN;
+    return std::clamp(aligned, std::min<uint32_t>(RENDER_SCALE_ALIGN, size), size);
+  };
+
+  m_RenderScale = scale;
+  m_RenderExtent = {scaled(m_SwapChainExtent.width), scaled(m_SwapChainExtent.height)};
+}
+
+void Volcano::updateRenderScale()
+{
+  //The "frame" range spans the whole graphics command buffer, framesInFlight frames old by the time it's read
+  double frameMs;
+  if (!m_GpuTimeline.takeLatest("frame", frameMs))
+  {
+    return;
+  }
+  m_RenderScaleGpuMs += frameMs;
+  m_RenderScaleSamples++;
+  if (m_RenderScaleSamples < RENDER_SCALE_ADJUST_FRAMES)
+  {
+    return;
+  }
+
+  double averageMs = m_RenderScaleGpuMs / m_RenderScaleSamples;
+  m_RenderScaleGpuMs = 0.0;
+  m_RenderScaleSamples = 0;
+
+  //Most of the frame goes with the pixel count, so the scale moves with the square root of the time ratio.
+  //Shadows and the post chain don't shrink with it, the next adjustment catches whatever this misses.
+  double budgetMs = m_Config.gpuBudgetMs;
+  double ratio = std::sqrt(budgetMs * RENDER_SCALE_TARGET / std::max(averageMs, 0.01));
+  float scale = m_RenderScale;
+  if (averageMs > budgetMs)
+  {
+    scale = static_cast<float>(scale * ratio);
+  }
+  else if (averageMs < budgetMs * RENDER_SCALE_HEADROOM)
+  {
+    scale = static_cast<float>(scale * std::min(ratio, RENDER_SCALE_MAX_GROWTH));
+  }
+
+  VkExtent2D previous = m_RenderExtent;
+  setRenderScale(scale);
+  if (m_RenderExtent.width != previous.width || m_RenderExtent.height != previous.height)
+  {
+    m_RenderScaleChanges++;
+  }
+}
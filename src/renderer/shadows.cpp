@@ -0,0 +1,580 @@
+#include "../volcano.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Cascaded shadow maps for the sun: SHADOW_CASCADE_COUNT tiles in one depth atlas, each fitted to a slice of the
+//camera frustum. Everything in the scene is static, so a cascade's tile is only re-rendered when the light turns
+//or the camera's slice leaves the (padded) region the tile was rendered for. Most frames draw no shadows at all,
+//the main pass just samples the cached tiles with the current camera's matrices.
+
+//std140 uniform, see ShadowParams in shader.frag
+struct ShadowParams
+{
+  float cascades[SHADOW_CASCADE_COUNT][16];
+  float splits[4];
+  float normalOffsets[4];
+  float atlas[4];
+};
+
+//Tile i sits at column i % 2, row i / 2
+#define SHADOW_TILE_SIZE (SHADOW_ATLAS_SIZE / 2)
+
+//Cascades end here instead of CAMERA_FAR, practical split blend between log and uniform
+#define SHADOW_DISTANCE 40.0f
+#define SHADOW_SPLIT_LAMBDA 0.75f
+
+//A cached tile covers this much more than its slice, the slice can move by the difference before a re-render
+#define SHADOW_CACHE_MARGIN 1.25f
+
+//Casters up to this far behind the slice towards the sun still land in the tile
+#define SHADOW_CASTER_DISTANCE 20.0f
+
+static VkFormat findShadowFormat(VkPhysicalDevice physicalDevice)
+{
+  for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM})
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    if ((properties.optimalTilingFeatures & needed) == needed)
+    {
+      return format;
+    }
+  }
+
+  throw std::runtime_error("Failed to find a sampleable shadow map format!");
+}
+
+void Volcano::createShadowResources()
+{
+  PROFILE_FUNCTION();
+  m_ShadowFormat = findShadowFormat(m_PhysicalDevice);
+
+  createImage(m_Device, m_PhysicalDevice, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, m_ShadowFormat, VK_IMAGE_TILING_OPTIMAL,
+              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_ShadowAtlas, m_ShadowAtlasMemory);
+  m_ShadowAtlasView = createImageView(m_Device, m_ShadowAtlas, m_ShadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+  //Hardware 2x2 PCF on top of the shader's 3x3 taps
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.compareEnable = VK_TRUE;
+  samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  samplerInfo.maxLod = 0.0f;
+
+  if (vkCreateSampler(m_Device, &samplerInfo, m_Allocator, &m_ShadowSampler) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow sampler!");
+  }
+
+  //Loads instead of clearing, tiles that aren't re-rendered this frame have to survive.
+  //Dirty tiles get cleared one by one with vkCmdClearAttachments.
+  VkAttachmentDescription attachment{};
+  attachment.format = m_ShadowFormat;
+  attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+  VkAttachmentReference depthRef{0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.pDepthStencilAttachment = &depthRef;
+
+  VkSubpassDependency dependencies[2]{};
+
+  //Earlier frames' main passes sampling the atlas
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  //This frame's main pass
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 1;
+  renderPassInfo.pAttachments = &attachment;
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = 2;
+  renderPassInfo.pDependencies = dependencies;
+
+  if (vkCreateRenderPass(m_Device, &renderPassInfo, m_Allocator, &m_ShadowRenderPass) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow render pass!");
+  }
+
+  VkFramebufferCreateInfo framebufferInfo{};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = m_ShadowRenderPass;
+  framebufferInfo.attachmentCount = 1;
+  framebufferInfo.pAttachments = &m_ShadowAtlasView;
+  framebufferInfo.width = SHADOW_ATLAS_SIZE;
+  framebufferInfo.height = SHADOW_ATLAS_SIZE;
+  framebufferInfo.layers = 1;
+
+  if (vkCreateFramebuffer(m_Device, &framebufferInfo, m_Allocator, &m_ShadowFramebuffer) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow framebuffer!");
+  }
+
+  VkDescriptorSetLayoutBinding bindings[2]{};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = bindings;
+
+  if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Allocator, &m_ShadowSetLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow descriptor set layout!");
+  }
+
+  uint32_t frames = m_Config.framesInFlight;
+  VkDescriptorPoolSize poolSizes[2]{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount = frames;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[1].descriptorCount = frames;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = frames;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+
+  if (vkCreateDescriptorPool(m_Device, &poolInfo, m_Allocator, &m_ShadowDescriptorPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow descriptor pool!");
+  }
+
+  std::vector<VkDescriptorSetLayout> setLayouts(frames, m_ShadowSetLayout);
+  VkDescriptorSetAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocateInfo.descriptorPool = m_ShadowDescriptorPool;
+  allocateInfo.descriptorSetCount = frames;
+  allocateInfo.pSetLayouts = setLayouts.data();
+
+  m_ShadowFrames.resize(frames);
+  std::vector<VkDescriptorSet> sets(frames);
+  if (vkAllocateDescriptorSets(m_Device, &allocateInfo, sets.data()) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to allocate shadow descriptor sets!");
+  }
+
+  //The atlas is shared, only the matrices (which follow the camera every frame) are per frame in flight
+  for (uint32_t i = 0; i < frames; i++)
+  {
+    ShadowFrame& frame = m_ShadowFrames[i];
+    frame.descriptorSet = sets[i];
+
+    createBuffer(m_Device, m_PhysicalDevice, sizeof(ShadowParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 frame.paramsBuffer, frame.paramsMemory);
+    vkMapMemory(m_Device, frame.paramsMemory, 0, sizeof(ShadowParams), 0, &frame.paramsMapped);
+
+    VkDescriptorImageInfo imageInfo{m_ShadowSampler, m_ShadowAtlasView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    VkDescriptorBufferInfo bufferInfo{frame.paramsBuffer, 0, sizeof(ShadowParams)};
+
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = frame.descriptorSet;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &imageInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = frame.descriptorSet;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writes[1].pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(m_Device, 2, writes, 0, nullptr);
+  }
+
+  createShadowPipeline();
+}
+
+void Volcano::createShadowPipeline()
+{
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(Mat4);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_ShadowPipelineLayout) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow pipeline layout!");
+  }
+
+  VkShaderModule vertShaderModule = loadShader(VOLCANO_SHADER_DIR "shadow.vert.spv");
+
+  //Depth only, no fragment shader
+  VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+  vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vertShaderStageInfo.module = vertShaderModule;
+  vertShaderStageInfo.pName = "main";
+
+  VkVertexInputBindingDescription bindingDescription{};
+  bindingDescription.binding = 0;
+  bindingDescription.stride = sizeof(Vertex);
+  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  VkVertexInputAttributeDescription positionAttribute{};
+  positionAttribute.binding = 0;
+  positionAttribute.location = 0;
+  positionAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+  positionAttribute.offset = offsetof(Vertex, position);
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+  vertexInputInfo.vertexAttributeDescriptionCount = 1;
+  vertexInputInfo.pVertexAttributeDescriptions = &positionAttribute;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  //Set per cascade tile
+  VkPipelineViewportStateCreateInfo viewportInfo{};
+  viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportInfo.viewportCount = 1;
+  viewportInfo.scissorCount = 1;
+
+  //No culling, meshes aren't guaranteed closed. Slope scaled bias against acne.
+  VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
+  rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizerInfo.lineWidth = 1.0f;
+  rasterizerInfo.cullMode = VK_CULL_MODE_NONE;
+  rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizerInfo.depthBiasEnable = VK_TRUE;
+  rasterizerInfo.depthBiasConstantFactor = 1.25f;
+  rasterizerInfo.depthBiasSlopeFactor = 1.75f;
+
+  VkPipelineMultisampleStateCreateInfo multiSampleInfo{};
+  multiSampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multiSampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  multiSampleInfo.minSampleShading = 1.0f;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = VK_TRUE;
+  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+
+  VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 1;
+  pipelineInfo.pStages = &vertShaderStageInfo;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportInfo;
+  pipelineInfo.pRasterizationState = &rasterizerInfo;
+  pipelineInfo.pMultisampleState = &multiSampleInfo;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = m_ShadowPipelineLayout;
+  pipelineInfo.renderPass = m_ShadowRenderPass;
+  pipelineInfo.subpass = 0;
+
+  if (vkCreateGraphicsPipelines(m_Device, m_PipelineCache, 1, &pipelineInfo, m_Allocator, &m_ShadowPipeline) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create shadow pipeline!");
+  }
+
+  vkDestroyShaderModule(m_Device, vertShaderModule, m_Allocator);
+}
+
+void Volcano::updateShadows(const Vec3& eye, const Vec3& target, const Mat4& view)
+{
+  PROFILE_FUNCTION();
+  ShadowParams params{};
+  params.atlas[0] = 1.0f / SHADOW_ATLAS_SIZE;
+  params.atlas[1] = m_Config.shadows ? 1.0f : 0.0f;
+
+  m_ShadowDraws.clear();
+  for (bool& dirty : m_ShadowCascadeDirty)
+  {
+    dirty = false;
+  }
+
+  if (!m_Config.shadows)
+  {
+    memcpy(m_ShadowFrames[m_CurrentFrame].paramsMapped, &params, sizeof(params));
+    return;
+  }
+
+  Vec3 lightDirection = normalize(SUN_DIRECTION);
+  Vec3 lightUp = std::fabs(lightDirection.y) > 0.99f ? Vec3(0.0f, 0.0f, 1.0f) : Vec3(0.0f, 1.0f, 0.0f);
+
+  Vec3 forward = normalize(target - eye);
+  Vec3 right = normalize(cross(forward, Vec3(0.0f, 1.0f, 0.0f)));
+  Vec3 up = cross(right, forward);
+  float aspect = m_SwapChainExtent.width / static_cast<float>(m_SwapChainExtent.height);
+  float tanY = std::tan(CAMERA_FOV * 0.5f);
+  float tanX = tanY * aspect;
+
+  Mat4 inverseView = view.rigidInverse();
+  float splitNear = CAMERA_NEAR;
+
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+  {
+    float t = (cascade + 1) / static_cast<float>(SHADOW_CASCADE_COUNT);
+    float logSplit = CAMERA_NEAR * std::pow(SHADOW_DISTANCE / CAMERA_NEAR, t);
+    float uniformSplit = CAMERA_NEAR + (SHADOW_DISTANCE - CAMERA_NEAR) * t;
+    float splitFar = SHADOW_SPLIT_LAMBDA * logSplit + (1.0f - SHADOW_SPLIT_LAMBDA) * uniformSplit;
+
+    //Bounding sphere of the slice's 8 corners. The corners move rigidly with the camera so the radius never
+    //changes, which keeps the texel size fixed and the cache comparisons exact.
+    Vec3 corners[8];
+    Vec3 center(0.0f, 0.0f, 0.0f);
+    for (uint32_t i = 0; i < 8; i++)
+    {
+      float depth = i < 4 ? splitNear : splitFar;
+      float x = (i & 1) ? 1.0f : -1.0f;
+      float y = (i & 2) ? 1.0f : -1.0f;
+      corners[i] = eye + forward * depth + right * (x * depth * tanX) + up * (y * depth * tanY);
+      center = center + corners[i] * 0.125f;
+    }
+    float radius = 0.0f;
+    for (const Vec3& corner : corners)
+    {
+      radius = std::max(radius, length(corner - center));
+    }
+
+    ShadowCascade& cached = m_ShadowCascades[cascade];
+    bool lightMoved = dot(cached.lightDirection, lightDirection) < 0.9999f;
+    bool sliceEscaped = length(center - cached.center) + radius > cached.radius;
+
+    if (!cached.valid || lightMoved || sliceEscaped || !m_Config.shadowCache)
+    {
+      float cachedRadius = radius * SHADOW_CACHE_MARGIN;
+
+      //Snap to whole texels in light space so re-renders don't make edges crawl
+      Mat4 lightRotation = Mat4::lookAt(Vec3(0.0f, 0.0f, 0.0f), -lightDirection, lightUp);
+      float texel = 2.0f * cachedRadius / SHADOW_TILE_SIZE;
+      Vec3 lightSpaceCenter = lightRotation.transformPoint(center);
+      lightSpaceCenter.x = std::floor(lightSpaceCenter.x / texel) * texel;
+      lightSpaceCenter.y = std::floor(lightSpaceCenter.y / texel) * texel;
+      Vec3 snappedCenter = lightRotation.rigidInverse().transformPoint(lightSpaceCenter);
+
+      float lightDistance = cachedRadius + SHADOW_CASTER_DISTANCE;
+      Mat4 lightView = Mat4::lookAt(snappedCenter + lightDirection * lightDistance, snappedCenter, lightUp);
+      Mat4 lightProjection = Mat4::orthographic(-cachedRadius, cachedRadius, -cachedRadius, cachedRadius,
+                                                0.0f, lightDistance + cachedRadius);
+
+      cached.valid = true;
+      cached.center = snappedCenter;
+      cached.radius = cachedRadius;
+      cached.lightDirection = lightDirection;
+      cached.viewProjection = lightProjection * lightView;
+      m_ShadowCascadeDirty[cascade] = true;
+      m_ShadowCascadeRenders++;
+
+      //Casters whose sphere touches the tile's box, coarser LODs for the wider cascades
+      float pixelsPerUnit = SHADOW_TILE_SIZE / (2.0f * cachedRadius);
+      for (const SceneObject& object : m_Objects)
+      {
+        Vec3 lightSpace = lightView.transformPoint(object.center);
+        if (std::fabs(lightSpace.x) > cachedRadius + object.radius || std::fabs(lightSpace.y) > cachedRadius + object.radius ||
+            -lightSpace.z - object.radius > lightDistance + cachedRadius)
+        {
+          continue;
+        }
+
+        uint32_t lodIndex = m_Config.lodEnabled ? selectLod(object, 1.0f, pixelsPerUnit) : 0;
+        const MeshLod& lod = m_Mesh.lods[lodIndex];
+        m_ShadowDraws.push_back({cached.viewProjection * object.model, lod.firstIndex, lod.indexCount, cascade});
+        m_FrameStats.shadowTriangles += lod.indexCount / 3;
+      }
+    }
+
+    //Main pass looks up from view space, so fold the camera's inverse into the cached light matrix
+    Mat4 viewToShadow = cached.viewProjection * inverseView;
+    memcpy(params.cascades[cascade], viewToShadow.m, sizeof(viewToShadow.m));
+    params.splits[cascade] = splitFar;
+    params.normalOffsets[cascade] = 1.5f * 2.0f * cached.radius / SHADOW_TILE_SIZE;
+
+    splitNear = splitFar;
+  }
+
+  memcpy(m_ShadowFrames[m_CurrentFrame].paramsMapped, &params, sizeof(params));
+}
+
+void Volcano::recordShadowPass(VkCommandBuffer commandBuffer)
+{
+  //First use: the atlas starts out cleared to far and in the layout the main pass samples it in
+  if (!m_ShadowAtlasInitialized)
+  {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_ShadowAtlas;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkClearDepthStencilValue clearValue{1.0f, 0};
+    vkCmdClearDepthStencilImage(commandBuffer, m_ShadowAtlas, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearValue, 1,
+                                &barrier.subresourceRange);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+    m_ShadowAtlasInitialized = true;
+  }
+
+  bool anyDirty = false;
+  for (bool dirty : m_ShadowCascadeDirty)
+  {
+    anyDirty = anyDirty || dirty;
+  }
+  if (!anyDirty)
+  {
+    return;
+  }
+
+  GPU_SCOPE(m_GpuTimeline, commandBuffer, "shadows");
+
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = m_ShadowRenderPass;
+  renderPassInfo.framebuffer = m_ShadowFramebuffer;
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = {SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE};
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowPipeline);
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_MeshBindings[MESH_SCENE].vertexBuffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, m_MeshBindings[MESH_SCENE].indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+  //m_ShadowDraws is in cascade order
+  size_t drawIndex = 0;
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+  {
+    if (!m_ShadowCascadeDirty[cascade])
+    {
+      continue;
+    }
+
+    VkRect2D tile{};
+    tile.offset = {static_cast<int32_t>((cascade % 2) * SHADOW_TILE_SIZE), static_cast<int32_t>((cascade / 2) * SHADOW_TILE_SIZE)};
+    tile.extent = {SHADOW_TILE_SIZE, SHADOW_TILE_SIZE};
+
+    VkViewport viewport{};
+    viewport.x = static_cast<float>(tile.offset.x);
+    viewport.y = static_cast<float>(tile.offset.y);
+    viewport.width = SHADOW_TILE_SIZE;
+    viewport.height = SHADOW_TILE_SIZE;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+
+    VkClearAttachment clear{};
+    clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    clear.clearValue.depthStencil = {1.0f, 0};
+    VkClearRect clearRect{tile, 0, 1};
+    vkCmdClearAttachments(commandBuffer, 1, &clear, 1, &clearRect);
+
+    for (; drawIndex < m_ShadowDraws.size() && m_ShadowDraws[drawIndex].cascade == cascade; drawIndex++)
+    {
+      const ShadowDraw& draw = m_ShadowDraws[drawIndex];
+      vkCmdPushConstants(commandBuffer, m_ShadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Mat4), &draw.mvp);
+      vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, 0, 0);
+    }
+  }
+
+  vkCmdEndRenderPass(commandBuffer);
+}
+
+void Volcano::bindShadowSet(VkCommandBuffer commandBuffer)
+{
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 1, 1,
+                          &m_ShadowFrames[m_CurrentFrame].descriptorSet, 0, nullptr);
+}
+
+void Volcano::destroyShadowResources()
+{
+  vkDestroyPipeline(m_Device, m_ShadowPipeline, m_Allocator);
+  vkDestroyPipelineLayout(m_Device, m_ShadowPipelineLayout, m_Allocator);
+  vkDestroyDescriptorPool(m_Device, m_ShadowDescriptorPool, m_Allocator);
+  vkDestroyDescriptorSetLayout(m_Device, m_ShadowSetLayout, m_Allocator);
+
+  for (ShadowFrame& frame : m_ShadowFrames)
+  {
+    vkUnmapMemory(m_Device, frame.paramsMemory);
+    vkDestroyBuffer(m_Device, frame.paramsBuffer, m_Allocator);
+    vkFreeMemory(m_Device, frame.paramsMemory, m_Allocator);
+  }
+  m_ShadowFrames.clear();
+
+  vkDestroyFramebuffer(m_Device, m_ShadowFramebuffer, m_Allocator);
+  vkDestroyRenderPass(m_Device, m_ShadowRenderPass, m_Allocator);
+  vkDestroySampler(m_Device, m_ShadowSampler, m_Allocator);
+  vkDestroyImageView(m_Device, m_ShadowAtlasView, m_Allocator);
+  vkDestroyImage(m_Device, m_ShadowAtlas, m_Allocator);
+  vkFreeMemory(m_Device, m_ShadowAtlasMemory, m_Allocator);
+}
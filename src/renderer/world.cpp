@@ -0,0 +1,243 @@
+#include "../volcano.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "../utils/profiler.hpp"
+#include "../utils/vkutils.hpp"
+
+//Streamed world (--world). The file is a grid of cells, WorldStreamer reads the ones around the camera and ahead of
+//it on the I/O pool, here they become GPU buffers: each decoded cell gets a staging buffer and a pair of device local
+//buffers, the copies are recorded at the top of the frame's command buffer and the staging buffer is released right
+//away, so the registry frees it once that frame is done. Cells are drawn with the mesh pipeline after the objects.
+//Geometry is in world space and static, it doesn't go through the shadow cascades or the occlusion cull.
+
+void Volcano::createWorld()
+{
+  PROFILE_FUNCTION();
+  if (m_Config.generateWorldCells > 0)
+  {
+    auto start = std::chrono::steady_clock::now();
+    generateWorldFile(m_Config.worldPath, m_Config.generateWorldCells, m_Config.generateWorldCells, WORLD_CELL_SIZE);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Generated " << m_Config.worldPath << ", " << m_Config.generateWorldCells << "x"
+              << m_Config.generateWorldCells << " cells in " << elapsed.count() << " s" << std::endl;
+  }
+
+  m_WorldStreamer.open(m_Config.worldPath, m_Config.ioThreads, m_Config.worldRadius);
+  const WorldFileHeader& header = m_WorldStreamer.index().header;
+  std::cout << "World " << header.cellsX << "x" << header.cellsZ << " cells of " << header.cellSize << " units, streaming "
+            << m_Config.worldRadius << " cells around the camera on " << m_Config.ioThreads << " I/O threads" << std::endl;
+
+  //Streamed cells are the cheapest thing to get back, they just load again once the camera comes near. The radius
+  //grows back a cell at a time once the budget has room again.
+  m_MemoryBudget.addEvictor("world cells", [this](VkDeviceSize bytes)
+  {
+    VkDeviceSize released = 0;
+    std::vector<uint32_t> unload;
+    while (released < bytes && m_WorldStreamer.radiusCells() > 1.0f)
+    {
+      unload.clear();
+      m_WorldStreamer.shrinkRadius(unload);
+      for (uint32_t cell : unload)
+      {
+        released += releaseWorldCell(cell);
+      }
+    }
+    return released;
+  }, [this]()
+  {
+    return m_WorldStreamer.growRadius();
+  });
+}
+
+VkDeviceSize Volcano::releaseWorldCell(uint32_t cell)
+{
+  auto it = m_WorldCells.find(cell);
+  if (it == m_WorldCells.end())
+  {
+    return 0;
+  }
+  VkDeviceSize bytes = it->second.bytes;
+  m_Resources.release(it->second.vertexBuffer);
+  m_Resources.release(it->second.indexBuffer);
+  m_WorldCells.erase(it);
+  m_WorldStreamer.markUnloaded(cell);
+  return bytes;
+}
+
+void Volcano::uploadWorldCell(DecodedCell& decoded)
+{
+  VkDeviceSize vertexBytes = decoded.mesh.vertices.size() * sizeof(Vertex);
+  VkDeviceSize indexBytes = decoded.mesh.indices.size() * sizeof(uint32_t);
+
+  //One staging buffer for both, vertices first
+  VkBuffer staging;
+  VkDeviceMemory stagingMemory;
+  createBuffer(m_Device, m_PhysicalDevice, vertexBytes + indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, stagingMemory);
+  void* mapped;
+  vkMapMemory(m_Device, stagingMemory, 0, vertexBytes + indexBytes, 0, &mapped);
+  memcpy(mapped, decoded.mesh.vertices.data(), vertexBytes);
+  memcpy(static_cast<char*>(mapped) + vertexBytes, decoded.mesh.indices.data(), indexBytes);
+  vkUnmapMemory(m_Device, stagingMemory);
+
+  VkBuffer vertexBuffer;
+  VkDeviceMemory vertexMemory;
+  createBuffer(m_Device, m_PhysicalDevice, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexMemory);
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexMemory;
+  createBuffer(m_Device, m_PhysicalDevice, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexMemory);
+
+  WorldCellGpu& gpu = m_WorldCells[decoded.cell];
+  gpu.vertexBuffer = m_Resources.addBuffer(vertexBuffer, vertexMemory, "world cell vertices");
+  gpu.indexBuffer = m_Resources.addBuffer(indexBuffer, indexMemory, "world cell indices");
+  gpu.indexCount = static_cast<uint32_t>(decoded.mesh.indices.size());
+  gpu.bytes = vertexBytes + indexBytes;
+  Vec3 boundsMin(decoded.mesh.boundsMin[0], decoded.mesh.boundsMin[1], decoded.mesh.boundsMin[2]);
+  Vec3 boundsMax(decoded.mesh.boundsMax[0], decoded.mesh.boundsMax[1], decoded.mesh.boundsMax[2]);
+  gpu.center = (boundsMin + boundsMax) * 0.5f;
+  gpu.radius = length(boundsMax - boundsMin) * 0.5f;
+
+  //Released now, destroyed once the frame recording the copy is done
+  ResourceHandle stagingHandle = m_Resources.addBuffer(staging, stagingMemory, "world staging");
+  m_WorldUploads.push_back({staging, vertexBuffer, indexBuffer, vertexBytes, indexBytes});
+  m_Resources.release(stagingHandle);
+
+  m_WorldStreamer.markResident(decoded.cell);
+}
+
+void Volcano::updateWorld(const Vec3& eye, double time, const Mat4& view, const Mat4& viewProjection)
+{
+  PROFILE_FUNCTION();
+  auto now = std::chrono::steady_clock::now();
+  bool firstFrame = m_WorldLastFrame == std::chrono::steady_clock::time_point{};
+
+  //A frame that took more than twice the running average, what streaming is supposed to avoid
+  if (!firstFrame)
+  {
+    double frameMs = std::chrono::duration<double, std::milli>(now - m_WorldLastFrame).count();
+    if (m_WorldFrameMsAverage > 0.0 && frameMs > 2.0 * m_WorldFrameMsAverage)
+    {
+      m_WorldHitches++;
+    }
+    m_WorldFrameMsAverage = m_WorldFrameMsAverage > 0.0 ? m_WorldFrameMsAverage * 0.95 + frameMs * 0.05 : frameMs;
+  }
+  m_WorldLastFrame = now;
+
+  //The sim only publishes positions, the prefetch direction comes from their difference
+  Vec3 velocity;
+  if (!firstFrame && time > m_WorldLastTime)
+  {
+    velocity = (eye - m_WorldLastEye) * static_cast<float>(1.0 / (time - m_WorldLastTime));
+  }
+  m_WorldLastEye = eye;
+  m_WorldLastTime = time;
+
+  std::vector<uint32_t> unload;
+  m_WorldStreamer.update(eye, velocity, unload);
+  for (uint32_t cell : unload)
+  {
+    releaseWorldCell(cell);
+  }
+
+  //Capped per frame so a burst of finished reads doesn't turn into one long frame
+  std::vector<DecodedCell> decoded;
+  m_WorldStreamer.takeDecoded(decoded, WORLD_UPLOAD_BUDGET_BYTES);
+  {
+    PROFILE_SCOPE("world staging");
+    for (DecodedCell& cell : decoded)
+    {
+      uploadWorldCell(cell);
+    }
+  }
+
+  //Same sphere against the view frustum test as the lights
+  float aspect = m_SwapChainExtent.width / static_cast<float>(m_SwapChainExtent.height);
+  float tanY = std::tan(CAMERA_FOV * 0.5f);
+  float tanX = tanY * aspect;
+  float sideX = 1.0f / std::sqrt(1.0f + tanX * tanX);
+  float sideY = 1.0f / std::sqrt(1.0f + tanY * tanY);
+
+  m_WorldDraws.clear();
+  for (const auto& entry : m_WorldCells)
+  {
+    const WorldCellGpu& gpu = entry.second;
+    Vec3 center = view.transformPoint(gpu.center);
+    float radius = gpu.radius;
+    if (-center.z + radius < CAMERA_NEAR || -center.z - radius > CAMERA_FAR ||
+        (center.x + center.z * tanX) * sideX > radius || (-center.x + center.z * tanX) * sideX > radius ||
+        (center.y + center.z * tanY) * sideY > radius || (-center.y + center.z * tanY) * sideY > radius)
+    {
+      continue;
+    }
+    m_WorldDraws.push_back({m_Resources.buffer(gpu.vertexBuffer), m_Resources.buffer(gpu.indexBuffer), gpu.indexCount});
+    m_FrameStats.worldTriangles += gpu.indexCount / 3;
+  }
+  m_WorldViewProjection = viewProjection;
+  m_WorldView = view;
+}
+
+void Volcano::recordWorldUploads(VkCommandBuffer commandBuffer)
+{
+  if (m_WorldUploads.empty())
+  {
+    return;
+  }
+
+  m_GpuTimeline.beginRange(commandBuffer, "world upload");
+  for (const WorldUpload& upload : m_WorldUploads)
+  {
+    VkBufferCopy vertexCopy{0, 0, upload.vertexBytes};
+    vkCmdCopyBuffer(commandBuffer, upload.staging, upload.vertexBuffer, 1, &vertexCopy);
+    VkBufferCopy indexCopy{upload.vertexBytes, 0, upload.indexBytes};
+    vkCmdCopyBuffer(commandBuffer, upload.staging, upload.indexBuffer, 1, &indexCopy);
+  }
+
+  //One barrier for all of them, first read by this frame's main pass
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                       1, &barrier, 0, nullptr, 0, nullptr);
+  m_GpuTimeline.endRange(commandBuffer);
+
+  m_WorldUploads.clear();
+}
+
+void Volcano::recordWorldDraws(VkCommandBuffer commandBuffer)
+{
+  if (m_WorldDraws.empty())
+  {
+    return;
+  }
+
+  //Whatever the objects left bound, the indirect pipeline reads its matrices elsewhere
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+  //World space vertices, so the object matrices are just the camera's
+  Mat4 matrices[2] = {m_WorldViewProjection, m_WorldView};
+  vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(matrices), matrices);
+
+  for (const WorldDraw& draw : m_WorldDraws)
+  {
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, 0, 0, 0);
+  }
+}
+
+void Volcano::destroyWorld()
+{
+  //Workers first, then the buffers go back to the registry like any other release
+  m_WorldStreamer.close();
+  for (auto& entry : m_WorldCells)
+  {
+    m_Resources.release(entry.second.vertexBuffer);
+    m_Resources.release(entry.second.indexBuffer);
+  }
+  m_WorldCells.clear();
+}
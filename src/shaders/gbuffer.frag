@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragNormal;
+
+//Attachment 0: albedo, attachment 1: world normal packed to 0..1
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+
+void main()
+{
+  outAlbedo = vec4(fragColor, 1.0);
+  outNormal = vec4(normalize(fragNormal) * 0.5 + 0.5, 0.0);
+}
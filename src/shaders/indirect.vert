@@ -0,0 +1,37 @@
+#version 450
+
+//shader.vert for the occlusion culled indirect draws: firstInstance is the draw's slot in the object buffer
+struct ObjectData
+{
+  mat4 mvp;
+  mat4 modelView;
+  vec4 sphere;
+  uint firstIndex;
+  uint indexCount;
+  uint objectId;
+  uint padding;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Objects
+{
+  ObjectData objects[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragViewPosition;
+layout(location = 3) out vec3 fragViewNormal;
+
+void main()
+{
+  ObjectData object = objects[gl_InstanceIndex];
+  gl_Position = object.mvp * vec4(inPosition, 1.0);
+  fragColor = abs(inNormal);
+  fragNormal = inNormal;
+  fragViewPosition = (object.modelView * vec4(inPosition, 1.0)).xyz;
+  fragViewNormal = mat3(object.modelView) * inNormal;
+}
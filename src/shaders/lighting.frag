@@ -0,0 +1,20 @@
+#version 450
+
+//Read straight out of tile memory on tilers, the G-buffer never has to reach DRAM
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput gAlbedo;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput gNormal;
+
+layout(location = 0) in vec2 inUV;
+layout(location = 0) out vec4 outColor;
+
+const vec3 LIGHT_DIRECTION = normalize(vec3(0.4, 1.0, 0.3));
+const float AMBIENT = 0.25;
+
+void main()
+{
+  vec3 albedo = subpassLoad(gAlbedo).rgb;
+  vec3 normal = normalize(subpassLoad(gNormal).xyz * 2.0 - 1.0);
+
+  float diffuse = max(dot(normal, LIGHT_DIRECTION), 0.0);
+  outColor = vec4(albedo * (AMBIENT + (1.0 - AMBIENT) * diffuse), 1.0);
+}
@@ -1,11 +1,124 @@
 #version 450
 
-
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec3 fragViewPosition;
+layout(location = 3) in vec3 fragViewNormal;
+
 layout(location = 0) out vec4 outColor;
 
+struct Light
+{
+  vec4 positionRadius;
+  vec4 colorSpotOuter;
+  vec4 directionSpotInner;
+};
+
+//Written by cluster.comp earlier in the frame
+layout(std430, set = 0, binding = 0) readonly buffer Lights { Light lights[]; };
+layout(std430, set = 0, binding = 1) readonly buffer ClusterGrid { uvec2 clusters[]; };
+layout(std430, set = 0, binding = 2) readonly buffer LightIndices { uint indexCount; uint indices[]; };
+
+layout(std140, set = 0, binding = 3) uniform ClusterParams
+{
+  vec4 projection;
+  vec4 depth;
+  uvec4 grid;
+  vec4 sunDirection;
+} params;
+
+//Must match SHADOW_CASCADE_COUNT in volcano.hpp, tiles are 2x2 in the atlas
+#define SHADOW_CASCADE_COUNT 4
+
+layout(set = 1, binding = 0) uniform sampler2DShadow shadowAtlas;
+
+layout(std140, set = 1, binding = 1) uniform ShadowParams
+{
+  mat4 cascades[SHADOW_CASCADE_COUNT];  //view space -> cascade clip space
+  vec4 splits;                          //far view depth of each cascade
+  vec4 normalOffsets;                   //view space push along the normal, about 1.5 texels
+  vec4 atlas;                           //1 / atlas size, enabled
+} shadow;
+
+const float AMBIENT = 0.15;
+const float SUN = 0.35;
+
+//1 lit, 0 shadowed, 3x3 taps of the comparison sampler (each already a 2x2 bilinear PCF)
+float sunShadow(vec3 viewPosition, vec3 normal)
+{
+  if (shadow.atlas.y == 0.0)
+  {
+    return 1.0;
+  }
+
+  float viewDepth = -viewPosition.z;
+  int cascade = 0;
+  while (cascade < SHADOW_CASCADE_COUNT && viewDepth > shadow.splits[cascade])
+  {
+    cascade++;
+  }
+  if (cascade == SHADOW_CASCADE_COUNT)
+  {
+    return 1.0;
+  }
+
+  vec4 lightClip = shadow.cascades[cascade] * vec4(viewPosition + normal * shadow.normalOffsets[cascade], 1.0);
+  vec2 tileOrigin = vec2(cascade % 2, cascade / 2) * 0.5;
+  vec2 uv = tileOrigin + (lightClip.xy * 0.5 + 0.5) * 0.5;
+
+  //Keep the kernel inside this cascade's tile
+  float texel = shadow.atlas.x;
+  vec2 uvMin = tileOrigin + texel;
+  vec2 uvMax = tileOrigin + 0.5 - texel;
+
+  float lit = 0.0;
+  for (int y = -1; y <= 1; y++)
+  {
+    for (int x = -1; x <= 1; x++)
+    {
+      lit += texture(shadowAtlas, vec3(clamp(uv + vec2(x, y) * texel, uvMin, uvMax), lightClip.z));
+    }
+  }
+  return lit / 9.0;
+}
 
 void main()
 {
-  outColor = vec4(fragColor, 1.0);
+  vec3 albedo = fragColor;
+  vec3 normal = normalize(fragViewNormal);
+  float sun = SUN * max(dot(normal, params.sunDirection.xyz), 0.0) * sunShadow(fragViewPosition, normal);
+  vec3 color = albedo * (AMBIENT + sun);
+
+  //Same froxel mapping as cluster.comp
+  float viewDepth = -fragViewPosition.z;
+  float slice = log(viewDepth / params.depth.x) / params.depth.z * float(params.grid.z);
+  uvec3 cluster = uvec3(clamp(gl_FragCoord.xy / params.projection.zw * vec2(params.grid.xy), vec2(0.0), vec2(params.grid.xy) - 1.0),
+                        clamp(slice, 0.0, float(params.grid.z) - 1.0));
+  uvec2 range = clusters[cluster.x + cluster.y * params.grid.x + cluster.z * params.grid.x * params.grid.y];
+
+  //Only the lights binned into this froxel, not every light in the scene
+  for (uint i = 0; i < range.y; i++)
+  {
+    Light light = lights[indices[range.x + i]];
+    vec3 toLight = light.positionRadius.xyz - fragViewPosition;
+    float distance = length(toLight);
+    if (distance >= light.positionRadius.w)
+    {
+      continue;
+    }
+
+    toLight /= distance;
+    float falloff = 1.0 - distance / light.positionRadius.w;
+    float attenuation = falloff * falloff;
+
+    if (light.colorSpotOuter.w >= -1.0)
+    {
+      float cosAngle = dot(-toLight, light.directionSpotInner.xyz);
+      attenuation *= smoothstep(light.colorSpotOuter.w, light.directionSpotInner.w, cosAngle);
+    }
+
+    color += albedo * light.colorSpotOuter.rgb * max(dot(normal, toLight), 0.0) * attenuation;
+  }
+
+  outColor = vec4(color, 1.0);
 }
@@ -1,26 +1,25 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+layout(push_constant) uniform PushConstants
+{
+  mat4 mvp;
+  mat4 modelView;
+} pc;
 
-vec2 positions[3] = vec2[]
-(
-vec2(0.0, -0.5),
-vec2(0.5, 0.5),
-vec2(-0.5, 0.5)
-);
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
 
-vec3 colors[3] = vec3[]
-(
-  vec3(1.0, 0.0, 0.0),
-  vec3(0.0, 1.0, 0.0),
-  vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragViewPosition;
+layout(location = 3) out vec3 fragViewNormal;
 
 void main()
 {
-  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-  fragColor = colors[gl_VertexIndex];
+  gl_Position = pc.mvp * vec4(inPosition, 1.0);
+  fragColor = abs(inNormal);
+  fragNormal = inNormal;
+  fragViewPosition = (pc.modelView * vec4(inPosition, 1.0)).xyz;
+  fragViewNormal = mat3(pc.modelView) * inNormal;
 }
-
-
-
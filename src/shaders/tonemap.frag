@@ -0,0 +1,58 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+layout(set = 0, binding = 1) uniform sampler2D bloom;
+
+layout(push_constant) uniform PushConstants
+{
+  vec2 uvScale;
+  vec2 sceneTexelSize;
+  float sharpness;
+  float exposure;
+  float bloomStrength;
+  uint encodeSrgb;
+} pc;
+
+layout(location = 0) in vec2 inUV;
+layout(location = 0) out vec4 outColor;
+
+//Narkowicz's ACES fit
+vec3 aces(vec3 x)
+{
+  return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+//Bilinear upscale from the rendered part of the scene color, kept half a texel inside it
+vec3 sceneAt(vec2 uv)
+{
+  return texture(sceneColor, min(uv, pc.uvScale - 0.5 * pc.sceneTexelSize)).rgb;
+}
+
+void main()
+{
+  vec2 uv = inUV * pc.uvScale;
+  vec3 scene = sceneAt(uv);
+
+  //Unsharp mask against the 4 neighbours, clamped to their range so edges don't ring
+  if (pc.sharpness > 0.0)
+  {
+    vec3 north = sceneAt(uv + vec2(0.0, -pc.sceneTexelSize.y));
+    vec3 south = sceneAt(uv + vec2(0.0, pc.sceneTexelSize.y));
+    vec3 west = sceneAt(uv + vec2(-pc.sceneTexelSize.x, 0.0));
+    vec3 east = sceneAt(uv + vec2(pc.sceneTexelSize.x, 0.0));
+    vec3 lowest = min(scene, min(min(north, south), min(west, east)));
+    vec3 highest = max(scene, max(max(north, south), max(west, east)));
+    vec3 blurred = (north + south + west + east) * 0.25;
+    scene = clamp(scene + (scene - blurred) * pc.sharpness, lowest, highest);
+  }
+
+  vec3 hdr = scene + texture(bloom, inUV).rgb * pc.bloomStrength;
+  vec3 mapped = aces(hdr * pc.exposure);
+
+  //_SRGB swapchains encode on write, anything else needs it done here
+  if (pc.encodeSrgb != 0)
+  {
+    mapped = pow(mapped, vec3(1.0 / 2.2));
+  }
+  outColor = vec4(mapped, 1.0);
+}
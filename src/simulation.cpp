@@ -0,0 +1,123 @@
+#include "simulation.hpp"
+#include <algorithm>
+#include <cmath>
+#include "utils/profiler.hpp"
+
+Simulation::~Simulation()
+{
+  stop();
+}
+
+void Simulation::start(double tickRate, float travel)
+{
+  m_TickRate = tickRate;
+  m_TickInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / tickRate));
+  m_Travel = travel;
+
+  //Something valid to sample before the first tick lands
+  SimState initial;
+  step(initial);
+  m_Snapshots.back() = {initial, initial, Clock::now()};
+  m_Snapshots.publish();
+
+  m_Running.store(true);
+  m_Thread = std::thread(&Simulation::run, this, initial);
+}
+
+void Simulation::freeze(double time, float travel)
+{
+  m_Travel = travel;
+
+  SimState state;
+  state.time = time;
+  step(state);
+  m_Snapshots.back() = {state, state, Clock::now()};
+  m_Snapshots.publish();
+}
+
+void Simulation::stop()
+{
+  if (!m_Thread.joinable())
+  {
+    return;
+  }
+  m_Running.store(false);
+  m_Thread.join();
+}
+
+void Simulation::step(SimState& state) const
+{
+  //Dolly back and forth through the grid so every LOD gets exercised
+  float time = static_cast<float>(state.time);
+  state.eye = Vec3(0.0f, 0.6f, 2.0f - m_Travel * 0.5f * (1.0f - std::cos(time * 0.25f)));
+}
+
+void Simulation::run(SimState state)
+{
+  profilerSetThreadName("simulation");
+  double dt = 1.0 / m_TickRate;
+  Clock::time_point nextTick = Clock::now() + m_TickInterval;
+  Clock::time_point lastTick = Clock::now();
+
+  while (m_Running.load(std::memory_order_relaxed))
+  {
+    std::this_thread::sleep_until(nextTick);
+
+    Clock::time_point now = Clock::now();
+    uint64_t gapUs = std::chrono::duration_cast<std::chrono::microseconds>(now - lastTick).count();
+    lastTick = now;
+    uint64_t worst = m_WorstTickGapUs.load(std::memory_order_relaxed);
+    while (gapUs > worst && !m_WorstTickGapUs.compare_exchange_weak(worst, gapUs, std::memory_order_relaxed))
+    {
+    }
+
+    SimState previous = state;
+    {
+      PROFILE_SCOPE("sim tick");
+      state.time += dt;
+      step(state);
+      simulateWork(m_LoadMs.load(std::memory_order_relaxed));
+    }
+
+    //back() is ours alone until publish, whatever the render thread is reading lives in another slot
+    m_Snapshots.back() = {previous, state, Clock::now()};
+    m_Snapshots.publish();
+    m_Ticks.fetch_add(1, std::memory_order_relaxed);
+
+    //Fixed timestep against the ideal schedule, a long stall drops ticks rather than bursting them all
+    nextTick += m_TickInterval;
+    if (Clock::now() - nextTick > m_TickInterval * SIM_MAX_CATCHUP_TICKS)
+    {
+      int64_t behind = (Clock::now() - nextTick) / m_TickInterval;
+      m_SkippedTicks.fetch_add(static_cast<uint64_t>(behind), std::memory_order_relaxed);
+      nextTick += m_TickInterval * behind;
+    }
+  }
+}
+
+SimState Simulation::sample()
+{
+  m_Snapshots.update();
+  const Snapshot& snapshot = m_Snapshots.front();
+
+  //Renders one tick in the past, blending previous -> current over the tick interval after it was published
+  std::chrono::duration<double> sincePublish = Clock::now() - snapshot.publishedAt;
+  float alpha = static_cast<float>(std::clamp(sincePublish.count() * m_TickRate, 0.0, 1.0));
+
+  SimState state;
+  state.time = snapshot.previous.time + (snapshot.current.time - snapshot.previous.time) * alpha;
+  state.eye = lerp(snapshot.previous.eye, snapshot.current.eye, alpha);
+  return state;
+}
+
+void simulateWork(double milliseconds)
+{
+  if (milliseconds <= 0.0)
+  {
+    return;
+  }
+  auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(milliseconds);
+  while (std::chrono::steady_clock::now() < end)
+  {
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include "utils/math.hpp"
+#include "utils/triplebuffer.hpp"
+
+//Catch-up limit, a sim that fell further behind than this skips the missed ticks instead of spiralling
+#define SIM_MAX_CATCHUP_TICKS 5
+
+//Everything the renderer needs from the simulation, interpolated between two ticks
+struct SimState
+{
+  double time = 0.0;
+  Vec3 eye;
+};
+
+//Fixed timestep simulation on its own thread. Each tick publishes the previous and current state through a
+//TripleBuffer, the render thread samples between them at its own rate, so neither ever waits on the other.
+class Simulation
+{
+public:
+  ~Simulation();
+
+  //travel: how far the camera dollies through the object grid
+  void start(double tickRate, float travel);
+  //No thread, sample() always returns the state at that time. Same camera every frame for image comparisons.
+  void freeze(double time, float travel);
+  void stop();
+
+  //Render thread: state interpolated to now, one tick behind the simulation
+  SimState sample();
+
+  //Synthetic per tick cost for the sim benchmark, busy work on the sim thread
+  void setLoad(double milliseconds) { m_LoadMs.store(milliseconds, std::memory_order_relaxed); }
+
+  double tickRate() const { return m_TickRate; }
+  uint64_t ticks() const { return m_Ticks.load(std::memory_order_relaxed); }
+  uint64_t skippedTicks() const { return m_SkippedTicks.load(std::memory_order_relaxed); }
+
+  //Longest gap between two ticks since the last call, in milliseconds
+  double takeWorstTickGap() { return m_WorstTickGapUs.exchange(0, std::memory_order_relaxed) / 1000.0; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Snapshot
+  {
+    SimState previous;
+    SimState current;
+    Clock::time_point publishedAt;
+  };
+
+  void run(SimState state);
+  void step(SimState& state) const;
+
+  double m_TickRate = 120.0;
+  Clock::duration m_TickInterval{};
+  float m_Travel = 0.0f;
+
+  std::thread m_Thread;
+  std::atomic<bool> m_Running{false};
+  std::atomic<double> m_LoadMs{0.0};
+  std::atomic<uint64_t> m_Ticks{0};
+  std::atomic<uint64_t> m_SkippedTicks{0};
+  std::atomic<uint64_t> m_WorstTickGapUs{0};
+
+  TripleBuffer<Snapshot> m_Snapshots;
+};
+
+//Spins for the given time, stands in for game logic or render thread work in benchmarks
+void simulateWork(double milliseconds);
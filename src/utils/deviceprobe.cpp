@@ -0,0 +1,116 @@
+#include "deviceprobe.hpp"
+#include "vkutils.hpp"
+#include "hostallocator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+//Big enough to get past caches, small enough to fit next to a running desktop on a 1GB card
+#define PROBE_BUFFER_SIZE (64ull * 1024 * 1024)
+#define PROBE_COPIES 8
+
+std::string formatDeviceUUID(const uint8_t uuid[VK_UUID_SIZE])
+{
+  char text[40];
+  int length = 0;
+  for (int i = 0; i < VK_UUID_SIZE; i++)
+  {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      text[length++] = '-';
+    length += snprintf(text + length, sizeof(text) - length, "%02x", uuid[i]);
+  }
+  return std::string(text, length);
+}
+
+VkDeviceSize getDeviceLocalHeapSize(VkPhysicalDevice physicalDevice)
+{
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  VkDeviceSize largest = 0;
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+  {
+    if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+    {
+      largest = std::max(largest, memoryProperties.memoryHeaps[i].size);
+    }
+  }
+  return largest;
+}
+
+double probeCopyThroughput(VkPhysicalDevice physicalDevice, uint32_t queueFamily)
+{
+  float queuePriority = 1.0f;
+  VkDeviceQueueCreateInfo queueCreateInfo{};
+  queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueCreateInfo.queueFamilyIndex = queueFamily;
+  queueCreateInfo.queueCount = 1;
+  queueCreateInfo.pQueuePriorities = &queuePriority;
+
+  VkDeviceCreateInfo deviceInfo{};
+  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceInfo.queueCreateInfoCount = 1;
+  deviceInfo.pQueueCreateInfos = &queueCreateInfo;
+
+  VkDevice device;
+  if (vkCreateDevice(physicalDevice, &deviceInfo, getHostAllocator().callbacks(), &device) != VK_SUCCESS)
+  {
+    return 0.0;
+  }
+
+  VkQueue queue;
+  vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  VkBuffer srcBuffer = VK_NULL_HANDLE;
+  VkBuffer dstBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory srcMemory = VK_NULL_HANDLE;
+  VkDeviceMemory dstMemory = VK_NULL_HANDLE;
+  double throughput = 0.0;
+
+  try {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, getHostAllocator().callbacks(), &commandPool) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create probe command pool!");
+    }
+
+    createBuffer(device, physicalDevice, PROBE_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, srcBuffer, srcMemory);
+    createBuffer(device, physicalDevice, PROBE_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dstBuffer, dstMemory);
+
+    //Warm up: first touch of fresh allocations is often much slower
+    copyBuffer(device, commandPool, queue, srcBuffer, dstBuffer, PROBE_BUFFER_SIZE);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+    VkBufferCopy region{0, 0, PROBE_BUFFER_SIZE};
+    for (int i = 0; i < PROBE_COPIES; i++)
+    {
+      vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &region);
+    }
+
+    //CPU timed around submit + wait, close enough at this size and avoids needing timestamp support
+    auto start = std::chrono::steady_clock::now();
+    endSingleTimeCommands(device, commandPool, queue, commandBuffer);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    throughput = (static_cast<double>(PROBE_BUFFER_SIZE) * PROBE_COPIES / 1e9) / elapsed.count();
+  } catch (const std::exception&) {
+    throughput = 0.0;
+  }
+
+  vkDeviceWaitIdle(device);
+  vkDestroyBuffer(device, srcBuffer, getHostAllocator().callbacks());
+  vkDestroyBuffer(device, dstBuffer, getHostAllocator().callbacks());
+  vkFreeMemory(device, srcMemory, getHostAllocator().callbacks());
+  vkFreeMemory(device, dstMemory, getHostAllocator().callbacks());
+  vkDestroyCommandPool(device, commandPool, getHostAllocator().callbacks());
+  vkDestroyDevice(device, getHostAllocator().callbacks());
+
+  return throughput;
+}
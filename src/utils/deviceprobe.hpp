@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vulkan/vulkan.h>
+
+//Formats VkPhysicalDeviceIDProperties::deviceUUID as 8-4-4-4-12 hex
+std::string formatDeviceUUID(const uint8_t uuid[VK_UUID_SIZE]);
+
+//Largest DEVICE_LOCAL heap, what we treat as the device's VRAM
+VkDeviceSize getDeviceLocalHeapSize(VkPhysicalDevice physicalDevice);
+
+//Short GPU copy benchmark on a throwaway logical device. Returns GB/s, 0 if the probe could not run.
+double probeCopyThroughput(VkPhysicalDevice physicalDevice, uint32_t queueFamily);
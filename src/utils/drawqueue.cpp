@@ -0,0 +1,158 @@
+#include "drawqueue.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1u << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+  const uint32_t depthMax = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+  uint32_t quantizedDepth = static_cast<uint32_t>(std::clamp(depth, 0.0f, 1.0f) * depthMax);
+
+  auto field = [](uint32_t value, uint32_t shift, uint32_t bits)
+  {
+    return (static_cast<uint64_t>(value) & ((1ull << bits) - 1)) << shift;
+  };
+
+  return field(pass, DRAW_KEY_PASS_SHIFT, DRAW_KEY_PASS_BITS) |
+         field(pipeline, DRAW_KEY_PIPELINE_SHIFT, DRAW_KEY_PIPELINE_BITS) |
+         field(material, DRAW_KEY_MATERIAL_SHIFT, DRAW_KEY_MATERIAL_BITS) |
+         field(mesh, DRAW_KEY_MESH_SHIFT, DRAW_KEY_MESH_BITS) |
+         field(quantizedDepth, DRAW_KEY_DEPTH_SHIFT, DRAW_KEY_DEPTH_BITS);
+}
+
+//Runs body(thread, begin, end) over even chunks of [0, count): chunk 0 on this thread, the rest on the pool.
+//On this thread alone when there's only one chunk.
+template <typename Body>
+static void parallelChunks(ThreadPool* pool, uint32_t threadCount, size_t count, const Body& body)
+{
+  size_t chunk = (count + threadCount - 1) / threadCount;
+  if (threadCount == 1)
+  {
+    body(0u, size_t(0), count);
+    return;
+  }
+
+  std::mutex mutex;
+  std::condition_variable done;
+  uint32_t remaining = threadCount - 1;
+  for (uint32_t t = 1; t < threadCount; t++)
+  {
+    size_t begin = std::min(count, t * chunk);
+    size_t end = std::min(count, begin + chunk);
+    pool->submit([&, t, begin, end]
+    {
+      body(t, begin, end);
+      //Under the lock, the waiter returns and takes the condition variable with it once it sees zero
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--remaining == 0)
+      {
+        done.notify_one();
+      }
+    });
+  }
+  body(0u, size_t(0), std::min(count, chunk));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&] { return remaining == 0; });
+}
+
+void radixSortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch, ThreadPool* pool)
+{
+  size_t count = packets.size();
+  if (count < 2)
+  {
+    return;
+  }
+
+  uint32_t threadCount = !pool || count < RADIX_SORT_PARALLEL_THRESHOLD ? 1 : pool->threadCount() + 1;
+  scratch.resize(count);
+
+  //Digit counts don't change with the order, so one sweep tells which passes would be no-ops
+  uint32_t globalHistogram[RADIX_PASSES][RADIX_BUCKETS] = {};
+  for (const DrawPacket& packet : packets)
+  {
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+    {
+      globalHistogram[pass][(packet.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  std::vector<uint32_t> histograms(static_cast<size_t>(threadCount) * RADIX_BUCKETS);
+  DrawPacket* source = packets.data();
+  DrawPacket* destination = scratch.data();
+
+  for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+  {
+    uint32_t shift = pass * RADIX_BITS;
+    uint32_t firstDigit = static_cast<uint32_t>((source[0].key >> shift) & (RADIX_BUCKETS - 1));
+    if (globalHistogram[pass][firstDigit] == count)
+    {
+      continue;
+    }
+
+    //Per thread histograms of each chunk ...
+    std::fill(histograms.begin(), histograms.end(), 0u);
+    parallelChunks(pool, threadCount, count, [&](uint32_t thread, size_t begin, size_t end)
+    {
+      uint32_t* histogram = &histograms[static_cast<size_t>(thread) * RADIX_BUCKETS];
+      for (size_t i = begin; i < end; i++)
+      {
+        histogram[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++;
+      }
+    });
+
+    //... turned into write offsets, digit major then thread so the sort stays stable
+    uint32_t offset = 0;
+    for (uint32_t digit = 0; digit < RADIX_BUCKETS; digit++)
+    {
+      for (uint32_t thread = 0; thread < threadCount; thread++)
+      {
+        uint32_t& slot = histograms[static_cast<size_t>(thread) * RADIX_BUCKETS + digit];
+        uint32_t digitCount = slot;
+        slot = offset;
+        offset += digitCount;
+      }
+    }
+
+    parallelChunks(pool, threadCount, count, [&](uint32_t thread, size_t begin, size_t end)
+    {
+      uint32_t* offsets = &histograms[static_cast<size_t>(thread) * RADIX_BUCKETS];
+      for (size_t i = begin; i < end; i++)
+      {
+        destination[offsets[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = source[i];
+      }
+    });
+
+    std::swap(source, destination);
+  }
+
+  if (source != packets.data())
+  {
+    std::copy(source, source + count, packets.data());
+  }
+}
+
+void DrawQueue::clear()
+{
+  m_Packets.clear();
+}
+
+void DrawQueue::push(uint64_t key, uint32_t item)
+{
+  m_Packets.push_back({key, item});
+}
+
+void DrawQueue::sort()
+{
+  uint32_t workers = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0;
+  if (m_Packets.size() >= RADIX_SORT_PARALLEL_THRESHOLD && workers > 0 && m_SortPool.threadCount() == 0)
+  {
+    m_SortPool.start(workers, "draw sort");
+  }
+  radixSortDrawPackets(m_Packets, m_Scratch, m_SortPool.threadCount() > 0 ? &m_SortPool : nullptr);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "threadpool.hpp"
+#include <cstdint>
+#include <vector>
+
+//64 bit draw sort key, most significant field first so one sort groups draws by pass, then pipeline,
+//then material, then mesh, and orders whatever is left front to back
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_PIPELINE_BITS 10
+#define DRAW_KEY_MATERIAL_BITS 12
+#define DRAW_KEY_MESH_BITS 14
+#define DRAW_KEY_DEPTH_BITS 24
+
+#define DRAW_KEY_DEPTH_SHIFT 0
+#define DRAW_KEY_MESH_SHIFT (DRAW_KEY_DEPTH_SHIFT + DRAW_KEY_DEPTH_BITS)
+#define DRAW_KEY_MATERIAL_SHIFT (DRAW_KEY_MESH_SHIFT + DRAW_KEY_MESH_BITS)
+#define DRAW_KEY_PIPELINE_SHIFT (DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS)
+#define DRAW_KEY_PASS_SHIFT (DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS)
+
+//Below this the sort stays on the calling thread, handing chunks to the pool costs more than it saves
+#define RADIX_SORT_PARALLEL_THRESHOLD 32768
+
+//depth is 0..1 (e.g. view distance / far plane) and gets quantized to DRAW_KEY_DEPTH_BITS
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+inline uint32_t drawKeyField(uint64_t key, uint32_t shift, uint32_t bits)
+{
+  return static_cast<uint32_t>((key >> shift) & ((1ull << bits) - 1));
+}
+
+inline uint32_t drawKeyPass(uint64_t key) { return drawKeyField(key, DRAW_KEY_PASS_SHIFT, DRAW_KEY_PASS_BITS); }
+inline uint32_t drawKeyPipeline(uint64_t key) { return drawKeyField(key, DRAW_KEY_PIPELINE_SHIFT, DRAW_KEY_PIPELINE_BITS); }
+inline uint32_t drawKeyMaterial(uint64_t key) { return drawKeyField(key, DRAW_KEY_MATERIAL_SHIFT, DRAW_KEY_MATERIAL_BITS); }
+inline uint32_t drawKeyMesh(uint64_t key) { return drawKeyField(key, DRAW_KEY_MESH_SHIFT, DRAW_KEY_MESH_BITS); }
+
+//The key plus an index into whatever holds the draw's payload (transforms, index ranges)
+struct DrawPacket
+{
+  uint64_t key;
+  uint32_t item;
+};
+
+//LSD radix sort on the key, 8 bits per pass. Passes where every key has the same byte are skipped,
+//which is most of them while there are only a handful of pipelines and meshes. Large sorts split each pass
+//between the calling thread and the pool's workers, nullptr sorts on the calling thread.
+void radixSortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch, ThreadPool* pool);
+
+class DrawQueue
+{
+public:
+  void clear();
+  void push(uint64_t key, uint32_t item);
+  void sort();
+
+  const std::vector<DrawPacket>& packets() const { return m_Packets; }
+
+private:
+  std::vector<DrawPacket> m_Packets;
+  std::vector<DrawPacket> m_Scratch;
+  //Started by the first sort big enough to use it, the same workers for every frame after
+  ThreadPool m_SortPool;
+};
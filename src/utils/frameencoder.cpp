@@ -0,0 +1,138 @@
+#include "frameencoder.hpp"
+#include <stdexcept>
+#include "profiler.hpp"
+
+//glibc's popen only takes "r"/"w" and fails on "wb", Windows needs the b or it translates newlines in the pixels
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#define PIPE_WRITE_MODE "w"
+#endif
+
+FrameEncoder::~FrameEncoder()
+{
+  stop();
+}
+
+void FrameEncoder::start(const std::string& target, uint32_t width, uint32_t height, uint32_t fps, bool bgra)
+{
+  m_Width = width;
+  m_Height = height;
+  m_Bgra = bgra;
+  m_Pipe = !target.empty() && target[0] == '|';
+  m_Y4m = target.size() >= 4 && target.compare(target.size() - 4, 4, ".y4m") == 0;
+
+  m_File = m_Pipe ? popen(target.c_str() + 1, PIPE_WRITE_MODE) : std::fopen(target.c_str(), "wb");
+  if (!m_File)
+  {
+    throw std::runtime_error("Failed to open capture output " + target + "!");
+  }
+
+  //Y4M has one stream header, PPM repeats its header per frame
+  if (m_Y4m)
+  {
+    std::fprintf(m_File, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", width, height, fps);
+  }
+  m_Scratch.resize(static_cast<size_t>(width) * height * 3);
+
+  m_Stopping = false;
+  m_Thread = std::thread(&FrameEncoder::run, this);
+}
+
+void FrameEncoder::push(const uint8_t* pixels, std::atomic<bool>* inUse)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Jobs.push_back({pixels, inUse});
+  }
+  m_Wake.notify_one();
+}
+
+void FrameEncoder::stop()
+{
+  if (!m_Thread.joinable())
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stopping = true;
+  }
+  m_Wake.notify_one();
+  m_Thread.join();
+
+  if (m_Pipe)
+  {
+    pclose(m_File);
+  }
+  else
+  {
+    std::fclose(m_File);
+  }
+  m_File = nullptr;
+}
+
+void FrameEncoder::run()
+{
+  profilerSetThreadName("frame encoder");
+  for (;;)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Wake.wait(lock, [&] { return m_Stopping || !m_Jobs.empty(); });
+
+      //Stopping still drains the queue, every pushed frame ends up in the file
+      if (m_Jobs.empty())
+      {
+        return;
+      }
+      job = m_Jobs.front();
+      m_Jobs.pop_front();
+    }
+
+    writeFrame(job.pixels);
+    job.inUse->store(false, std::memory_order_release);
+    m_FramesWritten.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void FrameEncoder::writeFrame(const uint8_t* pixels)
+{
+  PROFILE_FUNCTION();
+  size_t pixelCount = static_cast<size_t>(m_Width) * m_Height;
+  uint32_t r = m_Bgra ? 2 : 0;
+  uint32_t b = m_Bgra ? 0 : 2;
+
+  if (m_Y4m)
+  {
+    //BT.601 limited range, planar Y then U then V
+    uint8_t* yPlane = m_Scratch.data();
+    uint8_t* uPlane = yPlane + pixelCount;
+    uint8_t* vPlane = uPlane + pixelCount;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+      int red = pixels[i * 4 + r];
+      int green = pixels[i * 4 + 1];
+      int blue = pixels[i * 4 + b];
+      yPlane[i] = static_cast<uint8_t>(((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16);
+      uPlane[i] = static_cast<uint8_t>(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+      vPlane[i] = static_cast<uint8_t>(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+    }
+    std::fputs("FRAME\n", m_File);
+  }
+  else
+  {
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+      m_Scratch[i * 3 + 0] = pixels[i * 4 + r];
+      m_Scratch[i * 3 + 1] = pixels[i * 4 + 1];
+      m_Scratch[i * 3 + 2] = pixels[i * 4 + b];
+    }
+    std::fprintf(m_File, "P6\n%u %u\n255\n", m_Width, m_Height);
+  }
+  std::fwrite(m_Scratch.data(), 1, m_Scratch.size(), m_File);
+}
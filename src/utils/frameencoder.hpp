@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Background writer for captured frames. A target ending in .y4m gets a raw YUV4MPEG2 4:4:4 stream, anything else a
+//stream of binary PPMs (what ffmpeg's image2pipe reads). A target starting with '|' is a command that gets the
+//stream on stdin instead of a file, e.g. "|ffmpeg -y -i - capture.mp4".
+class FrameEncoder
+{
+public:
+  ~FrameEncoder();
+
+  //Pixels are tightly packed 8 bit RGBA, or BGRA when bgra is set, already in display encoding
+  void start(const std::string& target, uint32_t width, uint32_t height, uint32_t fps, bool bgra);
+
+  //Queues a frame and returns right away. pixels has to stay valid until the encoder thread clears *inUse.
+  void push(const uint8_t* pixels, std::atomic<bool>* inUse);
+
+  //Writes out whatever is queued and closes the output
+  void stop();
+
+  uint64_t framesWritten() const { return m_FramesWritten.load(std::memory_order_relaxed); }
+
+private:
+  struct Job
+  {
+    const uint8_t* pixels;
+    std::atomic<bool>* inUse;
+  };
+
+  void run();
+  void writeFrame(const uint8_t* pixels);
+
+  FILE* m_File = nullptr;
+  bool m_Pipe = false;
+  bool m_Y4m = false;
+  bool m_Bgra = false;
+  uint32_t m_Width = 0;
+  uint32_t m_Height = 0;
+  std::vector<uint8_t> m_Scratch;
+
+  std::thread m_Thread;
+  std::mutex m_Mutex;
+  std::condition_variable m_Wake;
+  std::deque<Job> m_Jobs;
+  bool m_Stopping = false;
+  std::atomic<uint64_t> m_FramesWritten{0};
+};
@@ -0,0 +1,38 @@
+#include "framelimiter.hpp"
+#include <thread>
+
+//OS sleeps overshoot, the last stretch before the deadline is spun instead
+static const std::chrono::microseconds kSpinWindow(1000);
+
+FrameLimiter::FrameLimiter(double targetFps)
+  : m_Enabled(targetFps > 0.0),
+    m_Interval(m_Enabled ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps)) : Clock::duration::zero()),
+    m_NextFrame(Clock::now())
+{
+}
+
+void FrameLimiter::wait()
+{
+  if (!m_Enabled)
+    return;
+
+  Clock::time_point now = Clock::now();
+
+  //Fell more than a frame behind (hitch, breakpoint), don't try to catch up with a burst of frames
+  if (now > m_NextFrame + m_Interval)
+  {
+    m_NextFrame = now;
+  }
+
+  if (m_NextFrame - now > kSpinWindow)
+  {
+    std::this_thread::sleep_until(m_NextFrame - kSpinWindow);
+  }
+
+  while (Clock::now() < m_NextFrame)
+  {
+    std::this_thread::yield();
+  }
+
+  m_NextFrame += m_Interval;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+//Paces the main loop to a target rate. Call wait() right before sampling input so the
+//time spent sleeping comes out of the input -> present latency instead of adding to it.
+class FrameLimiter
+{
+public:
+  //0 disables the limiter
+  explicit FrameLimiter(double targetFps);
+
+  void wait();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  bool m_Enabled;
+  Clock::duration m_Interval;
+  Clock::time_point m_NextFrame;
+};
@@ -0,0 +1,210 @@
+#include "gputimeline.hpp"
+#include "vkutils.hpp"
+#include <stdexcept>
+
+void GpuTimeline::init(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily,
+                       VkCommandPool commandPool, VkQueue queue, uint32_t framesInFlight,
+                       bool timestamps, bool labels, const VkAllocationCallbacks* allocator, const char* track)
+{
+  m_Device = device;
+  m_Track = track;
+  m_FrameRanges.assign(framesInFlight, {});
+
+  if (labels)
+  {
+    m_vkCmdBeginDebugUtilsLabelEXT = (PFN_vkCmdBeginDebugUtilsLabelEXT) vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT");
+    m_vkCmdEndDebugUtilsLabelEXT = (PFN_vkCmdEndDebugUtilsLabelEXT) vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT");
+  }
+
+  if (!timestamps)
+  {
+    return;
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+  if (validBits == 0 || properties.limits.timestampPeriod == 0.0f)
+  {
+    //CPU scopes still get traced, just no GPU track
+    return;
+  }
+
+  m_TimestampPeriod = properties.limits.timestampPeriod;
+  m_TimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = framesInFlight * GPU_TIMELINE_MAX_RANGES * 2;
+
+  if (vkCreateQueryPool(device, &poolInfo, allocator, &m_QueryPool) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create timestamp query pool!");
+  }
+
+  m_TimestampsEnabled = true;
+  calibrate(commandPool, queue);
+}
+
+void GpuTimeline::destroy(const VkAllocationCallbacks* allocator)
+{
+  if (m_QueryPool != VK_NULL_HANDLE)
+  {
+    //Whatever finished after the last beginFrame
+    for (uint32_t i = 0; i < m_FrameRanges.size(); i++)
+    {
+      collect(i);
+    }
+    vkDestroyQueryPool(m_Device, m_QueryPool, allocator);
+    m_QueryPool = VK_NULL_HANDLE;
+  }
+}
+
+void GpuTimeline::calibrate(VkCommandPool commandPool, VkQueue queue)
+{
+  //One timestamp written right after submit, the CPU midpoint around the submit + wait is close enough
+  //to line the GPU track up with the CPU scopes (VK_EXT_calibrated_timestamps would be the exact way)
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands(m_Device, commandPool);
+  vkCmdResetQueryPool(commandBuffer, m_QueryPool, 0, 1);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, 0);
+
+  int64_t cpuBefore = profilerNow();
+  endSingleTimeCommands(m_Device, commandPool, queue, commandBuffer);
+  int64_t cpuAfter = profilerNow();
+
+  uint64_t timestamp = 0;
+  vkGetQueryPoolResults(m_Device, m_QueryPool, 0, 1, sizeof(timestamp), &timestamp, sizeof(timestamp),
+                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+  int64_t gpuNs = static_cast<int64_t>(static_cast<double>(timestamp & m_TimestampMask) * m_TimestampPeriod);
+  m_GpuToCpuOffsetNs = (cpuBefore + cpuAfter) / 2 - gpuNs;
+}
+
+void GpuTimeline::collect(uint32_t frameIndex)
+{
+  std::vector<Range>& ranges = m_FrameRanges[frameIndex];
+  if (ranges.empty())
+  {
+    return;
+  }
+
+  uint32_t firstQuery = frameIndex * GPU_TIMELINE_MAX_RANGES * 2;
+  uint64_t timestamps[GPU_TIMELINE_MAX_RANGES * 2];
+  uint32_t queryCount = static_cast<uint32_t>(ranges.size()) * 2;
+
+  //The slot's fence was waited on before we got here, anything not ready was never submitted
+  if (vkGetQueryPoolResults(m_Device, m_QueryPool, firstQuery, queryCount, sizeof(timestamps), timestamps,
+                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+  {
+    for (const Range& range : ranges)
+    {
+      auto toCpu = [&](uint32_t query)
+      {
+        uint64_t ticks = timestamps[query - firstQuery] & m_TimestampMask;
+        return static_cast<int64_t>(static_cast<double>(ticks) * m_TimestampPeriod) + m_GpuToCpuOffsetNs;
+      };
+      int64_t begin = toCpu(range.beginQuery);
+      int64_t end = toCpu(range.endQuery);
+      if (profilerEnabled())
+      {
+        profilerRecordGpu(m_Track, range.name, begin, end);
+      }
+
+      Accumulator& accumulator = m_Accumulators[range.name];
+      accumulator.totalMs += (end - begin) / 1e6;
+      accumulator.samples++;
+
+      Latest& latest = m_Latest[range.name];
+      latest.ms = (end - begin) / 1e6;
+      latest.fresh = true;
+    }
+  }
+
+  ranges.clear();
+}
+
+std::map<std::string, double> GpuTimeline::takeAverages()
+{
+  std::map<std::string, double> averages;
+  for (const auto& entry : m_Accumulators)
+  {
+    averages[entry.first] = entry.second.samples ? entry.second.totalMs / entry.second.samples : 0.0;
+  }
+  m_Accumulators.clear();
+  return averages;
+}
+
+bool GpuTimeline::takeLatest(const std::string& name, double& ms)
+{
+  auto it = m_Latest.find(name);
+  if (it == m_Latest.end() || !it->second.fresh)
+  {
+    return false;
+  }
+  ms = it->second.ms;
+  it->second.fresh = false;
+  return true;
+}
+
+void GpuTimeline::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+  m_FrameIndex = frameIndex;
+  m_OpenRanges.clear();
+
+  if (!m_TimestampsEnabled)
+  {
+    return;
+  }
+
+  collect(frameIndex);
+  vkCmdResetQueryPool(commandBuffer, m_QueryPool, frameIndex * GPU_TIMELINE_MAX_RANGES * 2, GPU_TIMELINE_MAX_RANGES * 2);
+}
+
+void GpuTimeline::beginRange(VkCommandBuffer commandBuffer, const char* name)
+{
+  if (m_vkCmdBeginDebugUtilsLabelEXT)
+  {
+    VkDebugUtilsLabelEXT label{};
+    label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    label.pLabelName = name;
+    m_vkCmdBeginDebugUtilsLabelEXT(commandBuffer, &label);
+  }
+
+  std::vector<Range>& ranges = m_FrameRanges[m_FrameIndex];
+  if (!m_TimestampsEnabled || ranges.size() >= GPU_TIMELINE_MAX_RANGES)
+  {
+    //Still has to balance endRange
+    m_OpenRanges.push_back(UINT32_MAX);
+    return;
+  }
+
+  uint32_t query = m_FrameIndex * GPU_TIMELINE_MAX_RANGES * 2 + static_cast<uint32_t>(ranges.size()) * 2;
+  ranges.push_back({name, query, query + 1});
+  m_OpenRanges.push_back(static_cast<uint32_t>(ranges.size() - 1));
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, query);
+}
+
+void GpuTimeline::endRange(VkCommandBuffer commandBuffer)
+{
+  uint32_t rangeIndex = m_OpenRanges.back();
+  m_OpenRanges.pop_back();
+
+  if (rangeIndex != UINT32_MAX)
+  {
+    const Range& range = m_FrameRanges[m_FrameIndex][rangeIndex];
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_QueryPool, range.endQuery);
+  }
+
+  if (m_vkCmdEndDebugUtilsLabelEXT)
+  {
+    m_vkCmdEndDebugUtilsLabelEXT(commandBuffer);
+  }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "profiler.hpp"
+
+//Timestamp query ranges per frame in flight, each range takes a begin and an end query
+#define GPU_TIMELINE_MAX_RANGES 32
+
+//GPU side of the trace: named ranges in a command buffer become timestamp query pairs plus
+//vkCmdBeginDebugUtilsLabelEXT labels (so RenderDoc/Nsight show the same names).
+//Results are read back when the frame slot comes around again, its fence has been waited on by then,
+//and converted to the profiler's steady clock with an offset calibrated once at init.
+class GpuTimeline
+{
+public:
+  //timestamps is off unless a trace or a benchmark reads them back, labels need VK_EXT_debug_utils on the instance.
+  //One timeline per queue, track names the queue in the trace.
+  void init(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily,
+            VkCommandPool commandPool, VkQueue queue, uint32_t framesInFlight,
+            bool timestamps, bool labels, const VkAllocationCallbacks* allocator, const char* track = "graphics queue");
+  void destroy(const VkAllocationCallbacks* allocator);
+
+  //Right after vkBeginCommandBuffer: collects this slot's previous results and resets its queries
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+  //Ranges nest, outside of a render pass or inside, just not across one
+  void beginRange(VkCommandBuffer commandBuffer, const char* name);
+  void endRange(VkCommandBuffer commandBuffer);
+
+  bool timestampsEnabled() const { return m_TimestampsEnabled; }
+
+  //Average GPU milliseconds per range name since the last call, for benchmarks and the stats line
+  std::map<std::string, double> takeAverages();
+
+  //Last collected GPU milliseconds of a range, false if nothing new came in since the previous call.
+  //Doesn't touch the averages, so a controller can watch a range while the stats line prints it.
+  bool takeLatest(const std::string& name, double& ms);
+
+private:
+  struct Range
+  {
+    const char* name;
+    uint32_t beginQuery;
+    uint32_t endQuery;
+  };
+
+  void calibrate(VkCommandPool commandPool, VkQueue queue);
+  void collect(uint32_t frameIndex);
+
+  VkDevice m_Device = VK_NULL_HANDLE;
+  const char* m_Track = "graphics queue";
+  VkQueryPool m_QueryPool = VK_NULL_HANDLE;
+  bool m_TimestampsEnabled = false;
+
+  double m_TimestampPeriod = 1.0;
+  uint64_t m_TimestampMask = ~0ull;
+  int64_t m_GpuToCpuOffsetNs = 0;
+
+  uint32_t m_FrameIndex = 0;
+  std::vector<std::vector<Range>> m_FrameRanges;
+  std::vector<uint32_t> m_OpenRanges;
+
+  struct Accumulator
+  {
+    double totalMs = 0.0;
+    uint32_t samples = 0;
+  };
+  std::map<std::string, Accumulator> m_Accumulators;
+
+  struct Latest
+  {
+    double ms = 0.0;
+    bool fresh = false;
+  };
+  std::map<std::string, Latest> m_Latest;
+
+  PFN_vkCmdBeginDebugUtilsLabelEXT m_vkCmdBeginDebugUtilsLabelEXT = nullptr;
+  PFN_vkCmdEndDebugUtilsLabelEXT m_vkCmdEndDebugUtilsLabelEXT = nullptr;
+};
+
+class GpuScope
+{
+public:
+  GpuScope(GpuTimeline& timeline, VkCommandBuffer commandBuffer, const char* name)
+    : m_Timeline(timeline), m_CommandBuffer(commandBuffer)
+  {
+    m_Timeline.beginRange(m_CommandBuffer, name);
+  }
+
+  ~GpuScope()
+  {
+    m_Timeline.endRange(m_CommandBuffer);
+  }
+
+  GpuScope(const GpuScope&) = delete;
+  GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+  GpuTimeline& m_Timeline;
+  VkCommandBuffer m_CommandBuffer;
+};
+
+#ifdef VOLCANO_PROFILING
+#define GPU_SCOPE(timeline, commandBuffer, name) GpuScope PROFILE_CONCAT(gpuScope, __LINE__)(timeline, commandBuffer, name)
+#else
+#define GPU_SCOPE(timeline, commandBuffer, name)
+#endif
@@ -0,0 +1,283 @@
+#include "hostallocator.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static uintptr_t alignUp(uintptr_t value, size_t alignment)
+{
+  return (value + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+uint64_t HostAllocatorStats::totalAllocations() const
+{
+  uint64_t total = 0;
+  for (const HostScopeStats& scope : scopes)
+  {
+    total += scope.totalAllocations;
+  }
+  return total;
+}
+
+HostAllocator::HostAllocator()
+  : m_Arena(new char[HOST_ARENA_SIZE])
+{
+  m_Callbacks.pUserData = this;
+  m_Callbacks.pfnAllocation = allocationCallback;
+  m_Callbacks.pfnReallocation = reallocationCallback;
+  m_Callbacks.pfnFree = freeCallback;
+  m_Callbacks.pfnInternalAllocation = internalAllocationCallback;
+  m_Callbacks.pfnInternalFree = internalFreeCallback;
+}
+
+void HostAllocator::setEnabled(bool enabled)
+{
+  m_Enabled = enabled;
+}
+
+const VkAllocationCallbacks* HostAllocator::callbacks() const
+{
+  return m_Enabled ? &m_Callbacks : nullptr;
+}
+
+void HostAllocator::beginFrame()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  //A command scope allocation only lives for the duration of the call, so this is just a safety net
+  if (m_ArenaLive == 0)
+  {
+    m_ArenaOffset = 0;
+  }
+}
+
+HostAllocatorStats HostAllocator::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Stats;
+}
+
+const char* HostAllocator::scopeName(int scope)
+{
+  switch (scope)
+  {
+    case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+    case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+    case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+    case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+    case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+    default: return "unknown";
+  }
+}
+
+HostAllocator::Header* HostAllocator::headerOf(void* memory)
+{
+  return reinterpret_cast<Header*>(static_cast<char*>(memory) - sizeof(Header));
+}
+
+void* HostAllocator::allocateFromArena(size_t size, size_t alignment)
+{
+  uintptr_t base = reinterpret_cast<uintptr_t>(m_Arena.get());
+  uintptr_t aligned = alignUp(base + m_ArenaOffset + sizeof(Header), alignment);
+
+  if (aligned + size > base + HOST_ARENA_SIZE)
+  {
+    return nullptr;
+  }
+
+  m_ArenaOffset = aligned + size - base;
+  m_ArenaLive++;
+  return reinterpret_cast<void*>(aligned);
+}
+
+void* HostAllocator::allocateFromPool(size_t size, size_t alignment, uint8_t& sizeClass)
+{
+  //Worst case the header plus alignment padding sits in front of the payload
+  size_t needed = sizeof(Header) + alignment - 1 + size;
+
+  size_t classSize = HOST_POOL_MIN_CLASS;
+  uint8_t index = 0;
+  while (classSize < needed)
+  {
+    classSize <<= 1;
+    index++;
+  }
+
+  if (index >= HOST_POOL_CLASS_COUNT)
+  {
+    return nullptr;
+  }
+
+  std::vector<void*>& freeBlocks = m_FreeBlocks[index];
+  if (freeBlocks.empty())
+  {
+    m_PoolChunks.emplace_back(new char[HOST_POOL_CHUNK_SIZE]);
+    char* chunk = m_PoolChunks.back().get();
+    for (size_t offset = 0; offset + classSize <= HOST_POOL_CHUNK_SIZE; offset += classSize)
+    {
+      freeBlocks.push_back(chunk + offset);
+    }
+  }
+
+  void* block = freeBlocks.back();
+  freeBlocks.pop_back();
+
+  sizeClass = index;
+  return block;
+}
+
+void* HostAllocator::allocateFromHeap(size_t size, size_t alignment)
+{
+  return std::malloc(sizeof(Header) + alignment - 1 + size);
+}
+
+void HostAllocator::track(void* memory, size_t size, int scope, Source source, uint8_t sizeClass, void* raw)
+{
+  Header* header = headerOf(memory);
+  header->size = size;
+  header->offset = static_cast<uint32_t>(static_cast<char*>(memory) - static_cast<char*>(raw));
+  header->scope = static_cast<uint8_t>(scope);
+  header->source = source;
+  header->sizeClass = sizeClass;
+
+  HostScopeStats& stats = m_Stats.scopes[scope];
+  stats.liveBytes += size;
+  stats.liveCount++;
+  stats.totalAllocations++;
+  stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  if (size == 0)
+  {
+    return nullptr;
+  }
+
+  int scopeIndex = std::min(static_cast<int>(scope), HOST_ALLOCATION_SCOPE_COUNT - 1);
+  alignment = std::max(alignment, alignof(Header));
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+  {
+    void* memory = allocateFromArena(size, alignment);
+    if (memory)
+    {
+      //The arena is rewound wholesale, raw is never used on free
+      track(memory, size, scopeIndex, SOURCE_ARENA, 0, static_cast<char*>(memory) - sizeof(Header));
+      return memory;
+    }
+    m_Stats.arenaOverflows++;
+  }
+  else if (scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT)
+  {
+    uint8_t sizeClass = 0;
+    void* raw = allocateFromPool(size, alignment, sizeClass);
+    if (raw)
+    {
+      void* memory = reinterpret_cast<void*>(alignUp(reinterpret_cast<uintptr_t>(raw) + sizeof(Header), alignment));
+      track(memory, size, scopeIndex, SOURCE_POOL, sizeClass, raw);
+      return memory;
+    }
+  }
+
+  void* raw = allocateFromHeap(size, alignment);
+  if (!raw)
+  {
+    return nullptr;
+  }
+
+  void* memory = reinterpret_cast<void*>(alignUp(reinterpret_cast<uintptr_t>(raw) + sizeof(Header), alignment));
+  track(memory, size, scopeIndex, SOURCE_HEAP, 0, raw);
+  return memory;
+}
+
+void HostAllocator::release(void* memory)
+{
+  if (!memory)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  Header* header = headerOf(memory);
+  HostScopeStats& stats = m_Stats.scopes[header->scope];
+  stats.liveBytes -= header->size;
+  stats.liveCount--;
+
+  void* raw = static_cast<char*>(memory) - header->offset;
+  switch (header->source)
+  {
+    case SOURCE_ARENA:
+      m_ArenaLive--;
+      break;
+    case SOURCE_POOL:
+      m_FreeBlocks[header->sizeClass].push_back(raw);
+      break;
+    default:
+      std::free(raw);
+      break;
+  }
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  if (!original)
+  {
+    return allocate(size, alignment, scope);
+  }
+
+  if (size == 0)
+  {
+    release(original);
+    return nullptr;
+  }
+
+  //Always move, the pools and the arena can't grow in place anyway
+  void* memory = allocate(size, alignment, scope);
+  if (!memory)
+  {
+    //Spec says the original stays valid when reallocation fails
+    return nullptr;
+  }
+
+  std::memcpy(memory, original, std::min<size_t>(size, headerOf(original)->size));
+  release(original);
+  return memory;
+}
+
+void* VKAPI_CALL HostAllocator::allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  return static_cast<HostAllocator*>(userData)->allocate(size, alignment, scope);
+}
+
+void* VKAPI_CALL HostAllocator::reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  return static_cast<HostAllocator*>(userData)->reallocate(original, size, alignment, scope);
+}
+
+void VKAPI_CALL HostAllocator::freeCallback(void* userData, void* memory)
+{
+  static_cast<HostAllocator*>(userData)->release(memory);
+}
+
+void VKAPI_CALL HostAllocator::internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+  HostAllocator* allocator = static_cast<HostAllocator*>(userData);
+  std::lock_guard<std::mutex> lock(allocator->m_Mutex);
+  allocator->m_Stats.internalBytes += size;
+}
+
+void VKAPI_CALL HostAllocator::internalFreeCallback(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+  HostAllocator* allocator = static_cast<HostAllocator*>(userData);
+  std::lock_guard<std::mutex> lock(allocator->m_Mutex);
+  allocator->m_Stats.internalBytes -= size;
+}
+
+HostAllocator& getHostAllocator()
+{
+  static HostAllocator allocator;
+  return allocator;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define HOST_ARENA_SIZE (1u << 20)
+#define HOST_POOL_CHUNK_SIZE (64u << 10)
+#define HOST_POOL_MIN_CLASS 32u
+#define HOST_POOL_CLASS_COUNT 8
+
+//VK_SYSTEM_ALLOCATION_SCOPE_COMMAND .. VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE
+#define HOST_ALLOCATION_SCOPE_COUNT 5
+
+struct HostScopeStats
+{
+  uint64_t liveBytes = 0;
+  uint64_t liveCount = 0;
+  uint64_t peakBytes = 0;
+  uint64_t totalAllocations = 0;
+};
+
+struct HostAllocatorStats
+{
+  HostScopeStats scopes[HOST_ALLOCATION_SCOPE_COUNT];
+
+  //Driver allocations it made itself and only told us about
+  uint64_t internalBytes = 0;
+
+  //Command scope requests that did not fit in the arena and went to the heap
+  uint64_t arenaOverflows = 0;
+
+  uint64_t totalAllocations() const;
+};
+
+//VkAllocationCallbacks for the driver's host allocations:
+//  command scope -> linear arena, reset every frame once nothing in it is live
+//  object scope  -> power of two size class pools with free lists
+//  everything else, and anything too big for the above -> aligned heap allocation
+//Every allocation carries a small header in front of it so free/realloc know where it came from.
+class HostAllocator
+{
+public:
+  HostAllocator();
+
+  //Disabled hands out nullptr callbacks, i.e. the driver's own allocator.
+  //Only toggle before the first Vulkan object is created.
+  void setEnabled(bool enabled);
+  const VkAllocationCallbacks* callbacks() const;
+
+  //Rewinds the command arena, call once per frame outside of any Vulkan call
+  void beginFrame();
+
+  HostAllocatorStats stats() const;
+
+  static const char* scopeName(int scope);
+
+private:
+  struct Header
+  {
+    uint64_t size;
+    uint32_t offset; //aligned pointer - raw pointer
+    uint8_t scope;
+    uint8_t source;
+    uint8_t sizeClass;
+    uint8_t padding;
+  };
+
+  enum Source : uint8_t
+  {
+    SOURCE_HEAP,
+    SOURCE_ARENA,
+    SOURCE_POOL
+  };
+
+  void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+  void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  void release(void* memory);
+
+  void* allocateFromArena(size_t size, size_t alignment);
+  void* allocateFromPool(size_t size, size_t alignment, uint8_t& sizeClass);
+  void* allocateFromHeap(size_t size, size_t alignment);
+  void track(void* memory, size_t size, int scope, Source source, uint8_t sizeClass, void* raw);
+
+  static Header* headerOf(void* memory);
+
+  static void* VKAPI_CALL allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  static void* VKAPI_CALL reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+  static void VKAPI_CALL freeCallback(void* userData, void* memory);
+  static void VKAPI_CALL internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+  static void VKAPI_CALL internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+  bool m_Enabled = true;
+  VkAllocationCallbacks m_Callbacks{};
+
+  //Drivers may call back from their own threads
+  mutable std::mutex m_Mutex;
+
+  std::unique_ptr<char[]> m_Arena;
+  size_t m_ArenaOffset = 0;
+  uint64_t m_ArenaLive = 0;
+
+  std::vector<void*> m_FreeBlocks[HOST_POOL_CLASS_COUNT];
+  std::vector<std::unique_ptr<char[]>> m_PoolChunks;
+
+  HostAllocatorStats m_Stats;
+};
+
+//Process wide instance, Vulkan objects have to be destroyed with the callbacks they were created with
+HostAllocator& getHostAllocator();
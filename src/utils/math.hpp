@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cmath>
+
+//Just enough vector math for the renderer, matrices are column major to match GLSL
+
+struct Vec3
+{
+  float x = 0.0f;
+  float y = 0.0f;
+  float z = 0.0f;
+
+  Vec3() = default;
+  Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+  Vec3 operator+(const Vec3& o) const { return {x + o.x, y + o.y, z + o.z}; }
+  Vec3 operator-(const Vec3& o) const { return {x - o.x, y - o.y, z - o.z}; }
+  Vec3 operator*(float s) const { return {x * s, y * s, z * s}; }
+  Vec3 operator-() const { return {-x, -y, -z}; }
+};
+
+inline float dot(const Vec3& a, const Vec3& b)
+{
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vec3 cross(const Vec3& a, const Vec3& b)
+{
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline float length(const Vec3& v)
+{
+  return std::sqrt(dot(v, v));
+}
+
+inline Vec3 normalize(const Vec3& v)
+{
+  float len = length(v);
+  return len > 0.0f ? v * (1.0f / len) : v;
+}
+
+inline Vec3 lerp(const Vec3& a, const Vec3& b, float t)
+{
+  return a + (b - a) * t;
+}
+
+struct Mat4
+{
+  float m[16] = {1, 0, 0, 0,
+                 0, 1, 0, 0,
+                 0, 0, 1, 0,
+                 0, 0, 0, 1};
+
+  float& at(int column, int row) { return m[column * 4 + row]; }
+  float at(int column, int row) const { return m[column * 4 + row]; }
+
+  Mat4 operator*(const Mat4& o) const
+  {
+    Mat4 result;
+    for (int column = 0; column < 4; column++)
+    {
+      for (int row = 0; row < 4; row++)
+      {
+        float sum = 0.0f;
+        for (int k = 0; k < 4; k++)
+          sum += at(k, row) * o.at(column, k);
+        result.at(column, row) = sum;
+      }
+    }
+    return result;
+  }
+
+  Vec3 transformPoint(const Vec3& p) const
+  {
+    return {at(0, 0) * p.x + at(1, 0) * p.y + at(2, 0) * p.z + at(3, 0),
+            at(0, 1) * p.x + at(1, 1) * p.y + at(2, 1) * p.z + at(3, 1),
+            at(0, 2) * p.x + at(1, 2) * p.y + at(2, 2) * p.z + at(3, 2)};
+  }
+
+  //Ignores translation, for normals and light directions under rotation + uniform scale
+  Vec3 transformDirection(const Vec3& d) const
+  {
+    return {at(0, 0) * d.x + at(1, 0) * d.y + at(2, 0) * d.z,
+            at(0, 1) * d.x + at(1, 1) * d.y + at(2, 1) * d.z,
+            at(0, 2) * d.x + at(1, 2) * d.y + at(2, 2) * d.z};
+  }
+
+  //Inverse of a rotation + translation (view matrices), transposes the rotation instead of a general inverse
+  Mat4 rigidInverse() const
+  {
+    Mat4 result;
+    for (int column = 0; column < 3; column++)
+    {
+      for (int row = 0; row < 3; row++)
+        result.at(column, row) = at(row, column);
+    }
+    Vec3 t(at(3, 0), at(3, 1), at(3, 2));
+    Vec3 inverseT = -result.transformDirection(t);
+    result.at(3, 0) = inverseT.x;
+    result.at(3, 1) = inverseT.y;
+    result.at(3, 2) = inverseT.z;
+    return result;
+  }
+
+  static Mat4 translation(const Vec3& t)
+  {
+    Mat4 result;
+    result.at(3, 0) = t.x;
+    result.at(3, 1) = t.y;
+    result.at(3, 2) = t.z;
+    return result;
+  }
+
+  static Mat4 scale(float s)
+  {
+    Mat4 result;
+    result.at(0, 0) = s;
+    result.at(1, 1) = s;
+    result.at(2, 2) = s;
+    return result;
+  }
+
+  //Right handed view, camera looks down -z
+  static Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up)
+  {
+    Vec3 f = normalize(center - eye);
+    Vec3 s = normalize(cross(f, up));
+    Vec3 u = cross(s, f);
+
+    Mat4 result;
+    result.at(0, 0) = s.x;  result.at(1, 0) = s.y;  result.at(2, 0) = s.z;
+    result.at(0, 1) = u.x;  result.at(1, 1) = u.y;  result.at(2, 1) = u.z;
+    result.at(0, 2) = -f.x; result.at(1, 2) = -f.y; result.at(2, 2) = -f.z;
+    result.at(3, 0) = -dot(s, eye);
+    result.at(3, 1) = -dot(u, eye);
+    result.at(3, 2) = dot(f, eye);
+    return result;
+  }
+
+  //Vulkan clip space: y points down and depth goes 0..1
+  static Mat4 perspective(float fovY, float aspect, float zNear, float zFar)
+  {
+    float f = 1.0f / std::tan(fovY * 0.5f);
+
+    Mat4 result;
+    result.at(0, 0) = f / aspect;
+    result.at(1, 1) = -f;
+    result.at(2, 2) = zFar / (zNear - zFar);
+    result.at(2, 3) = -1.0f;
+    result.at(3, 2) = (zNear * zFar) / (zNear - zFar);
+    result.at(3, 3) = 0.0f;
+    return result;
+  }
+
+  //Same conventions as perspective, the box is in view space with near/far as positive distances down -z
+  static Mat4 orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+  {
+    Mat4 result;
+    result.at(0, 0) = 2.0f / (right - left);
+    result.at(1, 1) = -2.0f / (top - bottom);
+    result.at(2, 2) = -1.0f / (zFar - zNear);
+    result.at(3, 0) = -(right + left) / (right - left);
+    result.at(3, 1) = (top + bottom) / (top - bottom);
+    result.at(3, 2) = -zNear / (zFar - zNear);
+    return result;
+  }
+};
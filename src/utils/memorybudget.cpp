@@ -0,0 +1,145 @@
+#include "memorybudget.hpp"
+
+void MemoryBudget::init(VkPhysicalDevice physicalDevice, bool budgetExtension, double fraction)
+{
+  m_PhysicalDevice = physicalDevice;
+  m_BudgetExtension = budgetExtension;
+  m_Fraction = fraction;
+  poll(0);
+}
+
+void MemoryBudget::addEvictor(const char* name, MemoryEvictor evictor, MemoryRestorer restorer)
+{
+  m_Evictors.push_back({name, std::move(evictor), std::move(restorer)});
+}
+
+void MemoryBudget::poll(VkDeviceSize trackedBytes)
+{
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+  budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+  VkPhysicalDeviceMemoryProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  properties.pNext = m_BudgetExtension ? &budgetProperties : nullptr;
+  vkGetPhysicalDeviceMemoryProperties2(m_PhysicalDevice, &properties);
+
+  const VkPhysicalDeviceMemoryProperties& memory = properties.memoryProperties;
+  m_Heaps.resize(memory.memoryHeapCount);
+
+  //Without the extension everything we track is charged to the biggest device local heap
+  uint32_t trackedHeap = 0;
+  for (uint32_t i = 0; i < memory.memoryHeapCount; i++)
+  {
+    MemoryHeapBudget& heap = m_Heaps[i];
+    heap.size = memory.memoryHeaps[i].size;
+    heap.deviceLocal = (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    if (heap.deviceLocal && (!m_Heaps[trackedHeap].deviceLocal || heap.size > m_Heaps[trackedHeap].size))
+    {
+      trackedHeap = i;
+    }
+
+    if (m_BudgetExtension)
+    {
+      heap.budget = budgetProperties.heapBudget[i];
+      heap.usage = budgetProperties.heapUsage[i];
+    }
+    else
+    {
+      heap.budget = static_cast<VkDeviceSize>(heap.size * MEMORY_BUDGET_FALLBACK_SHARE);
+      heap.usage = 0;
+    }
+  }
+  if (!m_BudgetExtension && !m_Heaps.empty())
+  {
+    m_Heaps[trackedHeap].usage = trackedBytes;
+  }
+}
+
+void MemoryBudget::update(VkDeviceSize trackedBytes, VkDeviceSize pendingBytes)
+{
+  poll(trackedBytes);
+
+  VkDeviceSize usage = deviceLocalUsage();
+  usage = usage > pendingBytes ? usage - pendingBytes : 0;
+  VkDeviceSize limit = static_cast<VkDeviceSize>(deviceLocalBudget() * m_Fraction);
+  m_OverBudget = usage > limit;
+  m_FramesUnder = usage < limit * MEMORY_BUDGET_RESTORE_SHARE ? m_FramesUnder + 1 : 0;
+
+  if (m_Cooldown > 0)
+  {
+    m_Cooldown--;
+    return;
+  }
+
+  if (m_FramesUnder >= MEMORY_BUDGET_RESTORE_FRAMES)
+  {
+    //Most expensive to reload first, one step and then wait for the numbers again
+    for (auto it = m_Evictors.rbegin(); it != m_Evictors.rend(); it++)
+    {
+      if (it->restore && it->restore())
+      {
+        break;
+      }
+    }
+    m_FramesUnder = 0;
+    return;
+  }
+
+  if (!m_OverBudget || m_Evictors.empty())
+  {
+    return;
+  }
+
+  VkDeviceSize wanted = usage - limit;
+  VkDeviceSize released = 0;
+  for (Evictor& evictor : m_Evictors)
+  {
+    if (released >= wanted)
+    {
+      break;
+    }
+    released += evictor.evict(wanted - released);
+  }
+
+  if (released > 0)
+  {
+    m_Evictions++;
+    m_EvictedBytes += released;
+  }
+  m_Cooldown = MEMORY_BUDGET_EVICT_COOLDOWN;
+}
+
+VkDeviceSize MemoryBudget::deviceLocalUsage() const
+{
+  VkDeviceSize usage = 0;
+  for (const MemoryHeapBudget& heap : m_Heaps)
+  {
+    if (heap.deviceLocal)
+    {
+      usage += heap.usage;
+    }
+  }
+  return usage;
+}
+
+VkDeviceSize MemoryBudget::deviceLocalBudget() const
+{
+  VkDeviceSize budget = 0;
+  for (const MemoryHeapBudget& heap : m_Heaps)
+  {
+    if (heap.deviceLocal)
+    {
+      budget += heap.budget;
+    }
+  }
+  return budget;
+}
+
+uint32_t MemoryBudget::takeEvictions(VkDeviceSize& bytes)
+{
+  uint32_t evictions = m_Evictions;
+  bytes = m_EvictedBytes;
+  m_Evictions = 0;
+  m_EvictedBytes = 0;
+  return evictions;
+}
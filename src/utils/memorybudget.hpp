@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//Frames to wait after an eviction before evicting again, the driver's usage numbers and the deferred releases lag
+#define MEMORY_BUDGET_EVICT_COOLDOWN 8
+//Without VK_EXT_memory_budget the budget is this share of the heap, what is left is the rest of the system's
+#define MEMORY_BUDGET_FALLBACK_SHARE 0.8
+//Usage has to stay under this share of the limit for MEMORY_BUDGET_RESTORE_FRAMES frames before one step of what was
+//evicted comes back, the gap keeps it from bouncing between evicting and restoring
+#define MEMORY_BUDGET_RESTORE_SHARE 0.75
+#define MEMORY_BUDGET_RESTORE_FRAMES 120
+
+struct MemoryHeapBudget
+{
+  VkDeviceSize size = 0;
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage = 0;
+  bool deviceLocal = false;
+};
+
+//Releases up to bytes of something that can be loaded again later and returns how much it released
+using MemoryEvictor = std::function<VkDeviceSize(VkDeviceSize bytes)>;
+//Undoes one step of an earlier eviction, false once there is nothing left to undo
+using MemoryRestorer = std::function<bool()>;
+
+//Per heap usage and budget, polled once a frame. With VK_EXT_memory_budget both come from the driver and cover
+//every process on the GPU; without it usage is whatever the caller tracks itself and the budget a fixed share of the
+//heap. When the device local heaps go over the configured fraction of their budget the evictors are asked, in the
+//order they were added, to release the difference. Once usage has stayed well under the limit for a while the
+//restorers undo it again a step at a time, last added first.
+class MemoryBudget
+{
+public:
+  void init(VkPhysicalDevice physicalDevice, bool budgetExtension, double fraction);
+
+  //Cheapest to reload first
+  void addEvictor(const char* name, MemoryEvictor evictor, MemoryRestorer restorer = nullptr);
+
+  //Once per frame after the fence wait. trackedBytes is only used without the extension, pendingBytes are
+  //released already and only wait for their frame's fence, so they don't count against the budget.
+  void update(VkDeviceSize trackedBytes, VkDeviceSize pendingBytes);
+
+  bool budgetExtensionEnabled() const { return m_BudgetExtension; }
+  //Over the limit as of the last update, whether or not anything could be evicted
+  bool overBudget() const { return m_OverBudget; }
+  const std::vector<MemoryHeapBudget>& heaps() const { return m_Heaps; }
+
+  //Summed over the device local heaps
+  VkDeviceSize deviceLocalUsage() const;
+  VkDeviceSize deviceLocalBudget() const;
+
+  //Since the last call
+  uint32_t takeEvictions(VkDeviceSize& bytes);
+
+private:
+  struct Evictor
+  {
+    std::string name;
+    MemoryEvictor evict;
+    MemoryRestorer restore;
+  };
+
+  void poll(VkDeviceSize trackedBytes);
+
+  VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+  bool m_BudgetExtension = false;
+  double m_Fraction = 0.9;
+  std::vector<MemoryHeapBudget> m_Heaps;
+  std::vector<Evictor> m_Evictors;
+  uint32_t m_Cooldown = 0;
+  uint32_t m_FramesUnder = 0;
+  bool m_OverBudget = false;
+
+  uint32_t m_Evictions = 0;
+  VkDeviceSize m_EvictedBytes = 0;
+};
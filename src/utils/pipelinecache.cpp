@@ -0,0 +1,71 @@
+#include "pipelinecache.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+std::vector<char> readPipelineCacheFile(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::ate | std::ios::binary);
+  if (!file.is_open())
+  {
+    return {};
+  }
+
+  std::vector<char> data(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(data.data(), data.size()))
+  {
+    return {};
+  }
+  return data;
+}
+
+VkPipelineCache createPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::vector<char>& data,
+                                    const VkAllocationCallbacks* allocator, bool& reused)
+{
+  //Drivers are supposed to reject foreign data themselves, not all of them do it gracefully
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  VkPipelineCacheHeaderVersionOne header{};
+  if (data.size() >= sizeof(header))
+  {
+    memcpy(&header, data.data(), sizeof(header));
+  }
+  reused = data.size() >= sizeof(header) && header.headerSize >= sizeof(header) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+           memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = reused ? data.size() : 0;
+  createInfo.pInitialData = reused ? data.data() : nullptr;
+
+  VkPipelineCache cache;
+  if (vkCreatePipelineCache(device, &createInfo, allocator, &cache) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to create pipeline cache!");
+  }
+  return cache;
+}
+
+size_t savePipelineCache(VkDevice device, VkPipelineCache cache, const std::string& filename)
+{
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0)
+  {
+    return 0;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+  {
+    return 0;
+  }
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.write(data.data(), size))
+  {
+    return 0;
+  }
+  return size;
+}
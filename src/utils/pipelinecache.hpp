@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+//Driver pipeline cache kept on disk between runs, so pipelines compiled once come back from the cache next time
+
+//A previous run's cache file, empty when there is none. Plain file read, can run before there is a device.
+std::vector<char> readPipelineCacheFile(const std::string& filename);
+
+//Seeded with data when its header says it came from this device and driver, empty otherwise. reused tells which.
+VkPipelineCache createPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::vector<char>& data,
+                                    const VkAllocationCallbacks* allocator, bool& reused);
+
+//Writes the cache's current contents, returns the size written (0 when it couldn't)
+size_t savePipelineCache(VkDevice device, VkPipelineCache cache, const std::string& filename);
@@ -0,0 +1,160 @@
+#include "profiler.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+struct ProfilerEvent
+{
+  const char* name;
+  int64_t startNs;
+  int64_t endNs;
+};
+
+struct ProfilerThreadBuffer
+{
+  std::unique_ptr<ProfilerEvent[]> events{new ProfilerEvent[PROFILER_EVENTS_PER_THREAD]};
+
+  //Published with release so the exporter sees complete events
+  std::atomic<uint32_t> count{0};
+  uint64_t dropped = 0;
+
+  uint32_t pid = 1;
+  uint32_t tid = 0;
+  std::string name;
+};
+
+static std::atomic<bool> s_Enabled{false};
+static const auto s_Epoch = std::chrono::steady_clock::now();
+
+//Only touched when a thread records its first event and at export
+static std::mutex s_BuffersMutex;
+static std::vector<std::unique_ptr<ProfilerThreadBuffer>> s_Buffers;
+
+static thread_local ProfilerThreadBuffer* t_Buffer = nullptr;
+//Kept until the thread records something, most named threads never do with the profiler off
+static thread_local std::string t_Name = "thread";
+static std::vector<ProfilerThreadBuffer*> s_GpuBuffers;
+
+static ProfilerThreadBuffer* registerBuffer(uint32_t pid, const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(s_BuffersMutex);
+  s_Buffers.emplace_back(new ProfilerThreadBuffer());
+
+  ProfilerThreadBuffer* buffer = s_Buffers.back().get();
+  buffer->pid = pid;
+  buffer->tid = static_cast<uint32_t>(s_Buffers.size());
+  buffer->name = name;
+  return buffer;
+}
+
+static ProfilerThreadBuffer* threadBuffer()
+{
+  if (!t_Buffer)
+  {
+    t_Buffer = registerBuffer(1, t_Name);
+  }
+  return t_Buffer;
+}
+
+static void append(ProfilerThreadBuffer* buffer, const char* name, int64_t startNs, int64_t endNs)
+{
+  uint32_t index = buffer->count.load(std::memory_order_relaxed);
+  if (index >= PROFILER_EVENTS_PER_THREAD)
+  {
+    buffer->dropped++;
+    return;
+  }
+
+  buffer->events[index] = {name, startNs, endNs};
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void profilerSetEnabled(bool enabled)
+{
+  s_Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool profilerEnabled()
+{
+  return s_Enabled.load(std::memory_order_relaxed);
+}
+
+int64_t profilerNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_Epoch).count();
+}
+
+void profilerSetThreadName(const char* name)
+{
+  t_Name = name;
+  if (t_Buffer)
+  {
+    std::lock_guard<std::mutex> lock(s_BuffersMutex);
+    t_Buffer->name = name;
+  }
+}
+
+void profilerRecord(const char* name, int64_t startNs, int64_t endNs)
+{
+  append(threadBuffer(), name, startNs, endNs);
+}
+
+void profilerRecordGpu(const char* track, const char* name, int64_t startNs, int64_t endNs)
+{
+  //GPU results are only ever read back on the render thread, so one buffer per queue does
+  for (ProfilerThreadBuffer* buffer : s_GpuBuffers)
+  {
+    if (buffer->name == track)
+    {
+      append(buffer, name, startNs, endNs);
+      return;
+    }
+  }
+  s_GpuBuffers.push_back(registerBuffer(2, track));
+  append(s_GpuBuffers.back(), name, startNs, endNs);
+}
+
+void profilerWriteTrace(const std::string& filename)
+{
+  FILE* file = std::fopen(filename.c_str(), "w");
+  if (!file)
+  {
+    throw std::runtime_error("Failed to open trace file for writing!");
+  }
+
+  std::lock_guard<std::mutex> lock(s_BuffersMutex);
+
+  std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+  std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+  size_t eventCount = 0;
+  uint64_t dropped = 0;
+  for (const auto& buffer : s_Buffers)
+  {
+    std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 buffer->pid, buffer->tid, buffer->name.c_str());
+
+    uint32_t count = buffer->count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++)
+    {
+      const ProfilerEvent& event = buffer->events[i];
+      //Chrome trace timestamps are microseconds
+      std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                   event.name, buffer->pid, buffer->tid, event.startNs / 1000.0, (event.endNs - event.startNs) / 1000.0);
+    }
+
+    eventCount += count;
+    dropped += buffer->dropped;
+  }
+
+  std::fprintf(file, "\n]}\n");
+  std::fclose(file);
+
+  std::printf("Wrote %zu trace events to %s (%llu dropped)\n", eventCount, filename.c_str(),
+              static_cast<unsigned long long>(dropped));
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//Fixed size so recording never allocates, events past this are dropped and counted
+#define PROFILER_EVENTS_PER_THREAD (1u << 18)
+
+//Chrome trace / Perfetto timeline of CPU scopes and GPU ranges.
+//Each thread appends to its own buffer, only the exporter reads them so recording takes no locks.
+//Build without VOLCANO_PROFILING and the macros below compile to nothing.
+
+void profilerSetEnabled(bool enabled);
+bool profilerEnabled();
+
+//Nanoseconds on the steady clock, the same clock GPU timestamps are calibrated against
+int64_t profilerNow();
+
+//Only remembered, the thread's event buffer is allocated by its first recorded event
+void profilerSetThreadName(const char* name);
+
+//name has to outlive the trace export, string literals and __func__ are fine
+void profilerRecord(const char* name, int64_t startNs, int64_t endNs);
+//GPU ranges go on their own track per queue, track is a name like "graphics queue" and has to outlive the export too
+void profilerRecordGpu(const char* track, const char* name, int64_t startNs, int64_t endNs);
+
+//Writes every buffered event as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+void profilerWriteTrace(const std::string& filename);
+
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char* name)
+    : m_Name(profilerEnabled() ? name : nullptr), m_Start(m_Name ? profilerNow() : 0) {}
+
+  ~ProfileScope()
+  {
+    if (m_Name)
+    {
+      profilerRecord(m_Name, m_Start, profilerNow());
+    }
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  const char* m_Name;
+  int64_t m_Start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef VOLCANO_PROFILING
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#endif
@@ -0,0 +1,245 @@
+#include "resourceregistry.hpp"
+#include <algorithm>
+
+uint32_t ResourceRegistryStats::liveCount() const
+{
+  uint32_t total = 0;
+  for (const ResourceTypeStats& type : types)
+  {
+    total += type.liveCount;
+  }
+  return total;
+}
+
+uint64_t ResourceRegistryStats::liveBytes() const
+{
+  uint64_t total = 0;
+  for (const ResourceTypeStats& type : types)
+  {
+    total += type.liveBytes;
+  }
+  return total;
+}
+
+void ResourceRegistry::init(VkDevice device, uint32_t framesInFlight, const VkAllocationCallbacks* allocator)
+{
+  m_Device = device;
+  m_FramesInFlight = std::max(framesInFlight, 1u);
+  m_Allocator = allocator;
+}
+
+void ResourceRegistry::destroy()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const PendingRelease& pending : m_Pending)
+  {
+    destroyObjects(pending.resource);
+  }
+  m_Pending.clear();
+
+  for (Slot& slot : m_Slots)
+  {
+    if (slot.live)
+    {
+      destroyObjects(slot);
+      slot = Slot{};
+    }
+  }
+  m_Slots.clear();
+  m_FreeSlots.clear();
+}
+
+ResourceHandle ResourceRegistry::addBuffer(VkBuffer buffer, VkDeviceMemory memory, const char* name)
+{
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+
+  Slot resource{};
+  resource.type = RESOURCE_BUFFER;
+  resource.buffer = buffer;
+  resource.memory = memory;
+  resource.bytes = requirements.size;
+  resource.name = name;
+  return add(resource);
+}
+
+ResourceHandle ResourceRegistry::addImage(VkImage image, VkDeviceMemory memory, const char* name)
+{
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(m_Device, image, &requirements);
+
+  Slot resource{};
+  resource.type = RESOURCE_IMAGE;
+  resource.image = image;
+  resource.memory = memory;
+  resource.bytes = requirements.size;
+  resource.name = name;
+  return add(resource);
+}
+
+ResourceHandle ResourceRegistry::addImageView(VkImageView view, const char* name)
+{
+  Slot resource{};
+  resource.type = RESOURCE_IMAGE_VIEW;
+  resource.view = view;
+  resource.name = name;
+  return add(resource);
+}
+
+ResourceHandle ResourceRegistry::addPipeline(VkPipeline pipeline, const char* name)
+{
+  Slot resource{};
+  resource.type = RESOURCE_PIPELINE;
+  resource.pipeline = pipeline;
+  resource.name = name;
+  return add(resource);
+}
+
+ResourceHandle ResourceRegistry::add(const Slot& resource)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  uint32_t index;
+  if (!m_FreeSlots.empty())
+  {
+    index = m_FreeSlots.back();
+    m_FreeSlots.pop_back();
+  }
+  else
+  {
+    index = static_cast<uint32_t>(m_Slots.size());
+    m_Slots.emplace_back();
+  }
+
+  //The slot keeps counting generations across reuse
+  uint32_t generation = m_Slots[index].generation;
+  m_Slots[index] = resource;
+  m_Slots[index].generation = generation;
+  m_Slots[index].live = true;
+  return {index, generation};
+}
+
+const ResourceRegistry::Slot* ResourceRegistry::resolve(ResourceHandle handle, ResourceType type) const
+{
+  if (!handle.valid() || handle.index >= m_Slots.size())
+  {
+    return nullptr;
+  }
+  const Slot& slot = m_Slots[handle.index];
+  return slot.live && slot.generation == handle.generation && slot.type == type ? &slot : nullptr;
+}
+
+VkBuffer ResourceRegistry::buffer(ResourceHandle handle) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const Slot* slot = resolve(handle, RESOURCE_BUFFER);
+  return slot ? slot->buffer : VK_NULL_HANDLE;
+}
+
+VkImage ResourceRegistry::image(ResourceHandle handle) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const Slot* slot = resolve(handle, RESOURCE_IMAGE);
+  return slot ? slot->image : VK_NULL_HANDLE;
+}
+
+VkImageView ResourceRegistry::imageView(ResourceHandle handle) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const Slot* slot = resolve(handle, RESOURCE_IMAGE_VIEW);
+  return slot ? slot->view : VK_NULL_HANDLE;
+}
+
+VkPipeline ResourceRegistry::pipeline(ResourceHandle handle) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const Slot* slot = resolve(handle, RESOURCE_PIPELINE);
+  return slot ? slot->pipeline : VK_NULL_HANDLE;
+}
+
+void ResourceRegistry::release(ResourceHandle& handle)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!handle.valid() || handle.index >= m_Slots.size())
+  {
+    return;
+  }
+  Slot& slot = m_Slots[handle.index];
+  if (!slot.live || slot.generation != handle.generation)
+  {
+    //Released twice, the first one already queued it
+    handle = {};
+    return;
+  }
+
+  m_Pending.push_back({slot, m_FrameNumber});
+  slot.live = false;
+  //Wraps past 0 so a handle can't turn valid by accident
+  slot.generation = slot.generation == UINT32_MAX ? 1 : slot.generation + 1;
+  m_FreeSlots.push_back(handle.index);
+  handle = {};
+}
+
+void ResourceRegistry::beginFrame(uint64_t frameNumber)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_FrameNumber = frameNumber;
+
+  //Frame n shares its slot and fence with frame n + framesInFlight, which is the one about to be recorded
+  size_t done = 0;
+  while (done < m_Pending.size() && m_Pending[done].frame + m_FramesInFlight <= frameNumber)
+  {
+    destroyObjects(m_Pending[done].resource);
+    done++;
+  }
+  m_Pending.erase(m_Pending.begin(), m_Pending.begin() + done);
+}
+
+void ResourceRegistry::destroyObjects(const Slot& resource)
+{
+  switch (resource.type)
+  {
+    case RESOURCE_BUFFER: vkDestroyBuffer(m_Device, resource.buffer, m_Allocator); break;
+    case RESOURCE_IMAGE: vkDestroyImage(m_Device, resource.image, m_Allocator); break;
+    case RESOURCE_IMAGE_VIEW: vkDestroyImageView(m_Device, resource.view, m_Allocator); break;
+    case RESOURCE_PIPELINE: vkDestroyPipeline(m_Device, resource.pipeline, m_Allocator); break;
+    default: break;
+  }
+  if (resource.memory != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_Device, resource.memory, m_Allocator);
+  }
+  m_DestroyedTotal++;
+}
+
+ResourceRegistryStats ResourceRegistry::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  ResourceRegistryStats stats;
+  for (const Slot& slot : m_Slots)
+  {
+    if (slot.live)
+    {
+      stats.types[slot.type].liveCount++;
+      stats.types[slot.type].liveBytes += slot.bytes;
+    }
+  }
+  for (const PendingRelease& pending : m_Pending)
+  {
+    stats.pendingCount++;
+    stats.pendingBytes += pending.resource.bytes;
+  }
+  stats.destroyedTotal = m_DestroyedTotal;
+  return stats;
+}
+
+const char* ResourceRegistry::typeName(ResourceType type)
+{
+  switch (type)
+  {
+    case RESOURCE_BUFFER: return "buffers";
+    case RESOURCE_IMAGE: return "images";
+    case RESOURCE_IMAGE_VIEW: return "image views";
+    case RESOURCE_PIPELINE: return "pipelines";
+    default: return "unknown";
+  }
+}
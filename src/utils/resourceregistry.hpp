@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum ResourceType : uint8_t
+{
+  RESOURCE_BUFFER,
+  RESOURCE_IMAGE,
+  RESOURCE_IMAGE_VIEW,
+  RESOURCE_PIPELINE,
+  RESOURCE_TYPE_COUNT
+};
+
+//Slot index plus the generation the slot had when it was handed out. Releasing bumps the generation,
+//so an old handle resolves to VK_NULL_HANDLE instead of whatever reuses the slot later. Generation 0 is never used.
+struct ResourceHandle
+{
+  uint32_t index = 0;
+  uint32_t generation = 0;
+
+  bool valid() const { return generation != 0; }
+};
+
+struct ResourceTypeStats
+{
+  uint32_t liveCount = 0;
+  uint64_t liveBytes = 0;
+};
+
+struct ResourceRegistryStats
+{
+  ResourceTypeStats types[RESOURCE_TYPE_COUNT];
+
+  //Released, waiting for the GPU to finish the frame that released them
+  uint32_t pendingCount = 0;
+  uint64_t pendingBytes = 0;
+  uint64_t destroyedTotal = 0;
+
+  uint32_t liveCount() const;
+  uint64_t liveBytes() const;
+};
+
+//Owns Vulkan objects behind generational handles and destroys released ones only after the GPU is done with them.
+//A release is tagged with the frame being recorded and destroyed in the beginFrame framesInFlight frames later,
+//which runs after that frame's fence has been waited on. Nothing needs vkDeviceWaitIdle to free mid-run.
+//Bytes are the memory requirements of buffers and images, views and pipelines count as 0.
+class ResourceRegistry
+{
+public:
+  void init(VkDevice device, uint32_t framesInFlight, const VkAllocationCallbacks* allocator);
+  //Everything still live or pending, only once the device is idle
+  void destroy();
+
+  //Takes ownership, memory is optional and freed together with its buffer / image
+  ResourceHandle addBuffer(VkBuffer buffer, VkDeviceMemory memory, const char* name);
+  ResourceHandle addImage(VkImage image, VkDeviceMemory memory, const char* name);
+  ResourceHandle addImageView(VkImageView view, const char* name);
+  ResourceHandle addPipeline(VkPipeline pipeline, const char* name);
+
+  //VK_NULL_HANDLE for a released handle or one of another type
+  VkBuffer buffer(ResourceHandle handle) const;
+  VkImage image(ResourceHandle handle) const;
+  VkImageView imageView(ResourceHandle handle) const;
+  VkPipeline pipeline(ResourceHandle handle) const;
+
+  //The handle stops resolving right away, the objects live until the current frame has finished on the GPU.
+  //Safe from any thread, e.g. a streaming worker dropping what it uploaded.
+  void release(ResourceHandle& handle);
+
+  //Right after the frame slot's fence wait, frameNumber counts every frame recorded so far
+  void beginFrame(uint64_t frameNumber);
+
+  ResourceRegistryStats stats() const;
+
+  static const char* typeName(ResourceType type);
+
+private:
+  struct Slot
+  {
+    ResourceType type = RESOURCE_BUFFER;
+    bool live = false;
+    uint32_t generation = 1;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize bytes = 0;
+    const char* name = "";
+  };
+
+  struct PendingRelease
+  {
+    Slot resource;
+    uint64_t frame;
+  };
+
+  ResourceHandle add(const Slot& resource);
+  const Slot* resolve(ResourceHandle handle, ResourceType type) const;
+  void destroyObjects(const Slot& resource);
+
+  VkDevice m_Device = VK_NULL_HANDLE;
+  const VkAllocationCallbacks* m_Allocator = nullptr;
+  uint32_t m_FramesInFlight = 1;
+  uint64_t m_FrameNumber = 0;
+
+  mutable std::mutex m_Mutex;
+  std::vector<Slot> m_Slots;
+  std::vector<uint32_t> m_FreeSlots;
+  //In release order, so frames only ever grow along it
+  std::vector<PendingRelease> m_Pending;
+  uint64_t m_DestroyedTotal = 0;
+};
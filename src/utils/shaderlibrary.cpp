@@ -0,0 +1,58 @@
+#include "shaderlibrary.hpp"
+#include "fileread.hpp"
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#define SPIRV_MAGIC 0x07230203u
+
+std::vector<char> readShaderFile(const std::string& filename)
+{
+  std::vector<char> code = readFile(filename);
+  uint32_t magic = 0;
+  if (code.size() >= sizeof(magic))
+  {
+    memcpy(&magic, code.data(), sizeof(magic));
+  }
+  if (magic != SPIRV_MAGIC || code.size() % sizeof(uint32_t) != 0)
+  {
+    throw std::runtime_error("Not a SPIR-V file: " + filename + "!");
+  }
+  return code;
+}
+
+void ShaderLibrary::preload(const std::string& filename)
+{
+  std::vector<char> code;
+  try
+  {
+    code = readShaderFile(filename);
+  }
+  catch (const std::exception&)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Code[filename] = std::move(code);
+}
+
+std::vector<char> ShaderLibrary::get(const std::string& filename)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Code.find(filename);
+    if (it != m_Code.end())
+    {
+      return it->second;
+    }
+  }
+  return readShaderFile(filename);
+}
+
+void ShaderLibrary::clear()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Code.clear();
+}
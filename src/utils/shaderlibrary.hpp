@@ -0,0 +1,28 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//SPIR-V words, read from disk and checked for the magic number. Throws on anything else.
+std::vector<char> readShaderFile(const std::string& filename);
+
+//Shader code read ahead of time: startup preloads every .spv it is going to need on worker threads while the window
+//and device are still being created, so building the pipelines later only has to create modules from memory.
+class ShaderLibrary
+{
+public:
+  //Any thread. A file that can't be read is just left out, get() reports it if it's actually needed.
+  void preload(const std::string& filename);
+
+  //Preloaded code, or read from disk now
+  std::vector<char> get(const std::string& filename);
+
+  //Once startup is done, later reads (shader reloads) go to disk again
+  void clear();
+
+private:
+  std::mutex m_Mutex;
+  std::unordered_map<std::string, std::vector<char>> m_Code;
+};
@@ -0,0 +1,161 @@
+#include "taskgraph.hpp"
+#include "profiler.hpp"
+#include <stdexcept>
+#include <string>
+
+TaskId TaskGraph::add(const char* name, const std::vector<TaskId>& dependencies, std::function<void()> work,
+                      bool mainThread)
+{
+  TaskId id = static_cast<TaskId>(m_Tasks.size());
+  for (TaskId dependency : dependencies)
+  {
+    if (dependency >= id)
+    {
+      throw std::runtime_error(std::string("Task ") + name + " depends on a task added after it!");
+    }
+    m_Tasks[dependency].dependents.push_back(id);
+  }
+
+  Task task;
+  task.name = name;
+  task.work = std::move(work);
+  task.mainThread = mainThread;
+  task.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  m_Tasks.push_back(std::move(task));
+  return id;
+}
+
+void TaskGraph::run(ThreadPool* pool)
+{
+  m_Pool = pool;
+  m_Start = Clock::now();
+  m_Remaining = m_Tasks.size();
+  m_Error = nullptr;
+
+  if (!m_Pool)
+  {
+    for (TaskId id = 0; id < m_Tasks.size(); id++)
+    {
+      execute(id);
+    }
+  }
+  else
+  {
+    for (Task& task : m_Tasks)
+    {
+      task.waitingOn = task.dependencyCount;
+    }
+    for (TaskId id = 0; id < m_Tasks.size(); id++)
+    {
+      if (m_Tasks[id].dependencyCount == 0)
+      {
+        dispatch(id);
+      }
+    }
+
+    //Main thread tasks run here as they become ready, the rest is on the pool
+    for (;;)
+    {
+      TaskId id;
+      {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Wake.wait(lock, [&] { return m_Remaining == 0 || !m_MainReady.empty(); });
+        if (m_MainReady.empty())
+        {
+          break;
+        }
+        id = m_MainReady.back();
+        m_MainReady.pop_back();
+      }
+      execute(id);
+    }
+  }
+
+  m_ElapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - m_Start).count();
+  if (m_Error)
+  {
+    std::rethrow_exception(m_Error);
+  }
+}
+
+void TaskGraph::dispatch(TaskId id)
+{
+  if (m_Tasks[id].mainThread)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_MainReady.push_back(id);
+    m_Wake.notify_all();
+    return;
+  }
+  m_Pool->submit([this, id] { execute(id); });
+}
+
+void TaskGraph::execute(TaskId id)
+{
+  Task& task = m_Tasks[id];
+  bool failed;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    failed = m_Error != nullptr;
+  }
+
+  task.startMs = std::chrono::duration<double, std::milli>(Clock::now() - m_Start).count();
+  if (failed)
+  {
+    task.skipped = true;
+  }
+  else
+  {
+    PROFILE_SCOPE(task.name);
+    try
+    {
+      task.work();
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (!m_Error)
+      {
+        m_Error = std::current_exception();
+      }
+    }
+  }
+  task.endMs = std::chrono::duration<double, std::milli>(Clock::now() - m_Start).count();
+
+  //Serial run, the next one in line is already the next to go
+  if (!m_Pool)
+  {
+    return;
+  }
+
+  std::vector<TaskId> ready;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (TaskId dependent : task.dependents)
+    {
+      if (--m_Tasks[dependent].waitingOn == 0)
+      {
+        ready.push_back(dependent);
+      }
+    }
+    //Under the lock, run() may return and take the graph with it as soon as it sees the last one done
+    if (--m_Remaining == 0)
+    {
+      m_Wake.notify_all();
+    }
+  }
+  for (TaskId dependent : ready)
+  {
+    dispatch(dependent);
+  }
+}
+
+std::vector<TaskTiming> TaskGraph::timings() const
+{
+  std::vector<TaskTiming> timings;
+  for (const Task& task : m_Tasks)
+  {
+    timings.push_back({task.name, task.startMs, task.endMs, task.mainThread, task.skipped});
+  }
+  return timings;
+}
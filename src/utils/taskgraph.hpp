@@ -0,0 +1,71 @@
+#pragma once
+
+#include "threadpool.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+using TaskId = uint32_t;
+
+struct TaskTiming
+{
+  const char* name;
+  //Relative to the start of run()
+  double startMs;
+  double endMs;
+  bool mainThread;
+  //Never ran because something before it threw
+  bool skipped;
+};
+
+//One shot dependency graph for startup work. A task starts once everything it depends on has finished: on the pool,
+//or on the thread calling run() when it has to be there (GLFW window calls). The first exception stops any further
+//task from starting and is rethrown by run() once the running ones are done.
+class TaskGraph
+{
+public:
+  //Dependencies have to be added first, so the order tasks are added in is always a valid serial order.
+  //name has to outlive the trace like any profiler scope name, a literal.
+  TaskId add(const char* name, const std::vector<TaskId>& dependencies, std::function<void()> work,
+             bool mainThread = false);
+
+  //nullptr runs every task on the calling thread in the order they were added
+  void run(ThreadPool* pool);
+
+  std::vector<TaskTiming> timings() const;
+  double elapsedMs() const { return m_ElapsedMs; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task
+  {
+    const char* name;
+    std::function<void()> work;
+    bool mainThread;
+    std::vector<TaskId> dependents;
+    uint32_t dependencyCount;
+    uint32_t waitingOn = 0;
+    double startMs = 0.0;
+    double endMs = 0.0;
+    bool skipped = false;
+  };
+
+  void dispatch(TaskId id);
+  void execute(TaskId id);
+
+  std::vector<Task> m_Tasks;
+  ThreadPool* m_Pool = nullptr;
+  Clock::time_point m_Start;
+  double m_ElapsedMs = 0.0;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_Wake;
+  std::vector<TaskId> m_MainReady;
+  size_t m_Remaining = 0;
+  std::exception_ptr m_Error;
+};
@@ -0,0 +1,67 @@
+#include "threadpool.hpp"
+#include "profiler.hpp"
+
+ThreadPool::~ThreadPool()
+{
+  stop();
+}
+
+void ThreadPool::start(uint32_t threadCount, const std::string& name)
+{
+  m_Stopping = false;
+  for (uint32_t i = 0; i < threadCount; i++)
+  {
+    m_Threads.emplace_back(&ThreadPool::run, this, name + " " + std::to_string(i));
+  }
+}
+
+void ThreadPool::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stopping = true;
+    m_Jobs.clear();
+  }
+  m_Wake.notify_all();
+  for (std::thread& thread : m_Threads)
+  {
+    thread.join();
+  }
+  m_Threads.clear();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Jobs.push_back(std::move(job));
+  }
+  m_Wake.notify_one();
+}
+
+size_t ThreadPool::queued() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Jobs.size();
+}
+
+void ThreadPool::run(std::string name)
+{
+  //Copied by the profiler, doesn't have to outlive this call
+  profilerSetThreadName(name.c_str());
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Wake.wait(lock, [&] { return m_Stopping || !m_Jobs.empty(); });
+      if (m_Stopping)
+      {
+        return;
+      }
+      job = std::move(m_Jobs.front());
+      m_Jobs.pop_front();
+    }
+    job();
+  }
+}
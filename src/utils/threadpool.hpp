@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads pulling jobs off one FIFO queue, for blocking work (file reads, decoding) that
+//shouldn't run on the main or simulation threads. Jobs are independent, nothing waits on a particular one.
+class ThreadPool
+{
+public:
+  ~ThreadPool();
+
+  //name shows up in the trace as "name 0", "name 1", ...
+  void start(uint32_t threadCount, const std::string& name);
+
+  //Jobs still queued are dropped, running ones finish first
+  void stop();
+
+  void submit(std::function<void()> job);
+
+  //Queued, not running yet
+  size_t queued() const;
+  uint32_t threadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+
+private:
+  void run(std::string name);
+
+  std::vector<std::thread> m_Threads;
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Wake;
+  std::deque<std::function<void()>> m_Jobs;
+  bool m_Stopping = false;
+};
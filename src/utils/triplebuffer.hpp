@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Single producer / single consumer triple buffer. The writer fills back() and publishes it, the reader picks up the
+//latest published slot with update() and reads front(). Neither side ever waits: publishing swaps the back slot with
+//the shared middle one, updating swaps the front slot with it, and a flag in the middle index says it's unread.
+template <typename T>
+class TripleBuffer
+{
+public:
+  //Writer thread only
+  T& back() { return m_Slots[m_Back].value; }
+
+  void publish()
+  {
+    uint32_t previous = m_Middle.exchange(m_Back | FRESH_BIT, std::memory_order_acq_rel);
+    m_Back = previous & INDEX_MASK;
+  }
+
+  //Reader thread only, false when nothing was published since the last call
+  bool update()
+  {
+    if (!(m_Middle.load(std::memory_order_relaxed) & FRESH_BIT))
+    {
+      return false;
+    }
+    uint32_t previous = m_Middle.exchange(m_Front, std::memory_order_acq_rel);
+    m_Front = previous & INDEX_MASK;
+    return true;
+  }
+
+  const T& front() const { return m_Slots[m_Front].value; }
+
+private:
+  static constexpr uint32_t INDEX_MASK = 3;
+  static constexpr uint32_t FRESH_BIT = 4;
+
+  //Own cache lines, the two threads write different slots all the time
+  struct alignas(64) Slot
+  {
+    T value{};
+  };
+
+  Slot m_Slots[3];
+  alignas(64) std::atomic<uint32_t> m_Middle{1};
+  alignas(64) uint32_t m_Back = 0;
+  alignas(64) uint32_t m_Front = 2;
+};
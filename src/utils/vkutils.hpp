@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+//Small Vulkan helpers shared by the renderer, they throw on failure like the rest of Volcano
+
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+//More than one queue family makes the buffer CONCURRENT, for buffers used on several queues without ownership transfers
+void createBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory,
+                  uint32_t queueFamilyCount = 0, const uint32_t* queueFamilyIndices = nullptr);
+
+//One shot command buffer on the given pool, submitted and waited on in endSingleTimeCommands
+VkCommandBuffer beginSingleTimeCommands(VkDevice device, VkCommandPool commandPool);
+void endSingleTimeCommands(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer);
+
+void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+
+//Uploads data into a new device local buffer through a temporary staging buffer
+void createDeviceLocalBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue,
+                             const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                             VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+
+void createImage(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format,
+                 VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                 VkImage& image, VkDeviceMemory& imageMemory);
+
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+
+//First of D32 / D32S8 / D24S8 usable as an optimal tiling depth attachment
+VkFormat findDepthFormat(VkPhysicalDevice physicalDevice);
+
+//Like findMemoryType but returns false instead of throwing, for optional properties such as LAZILY_ALLOCATED
+bool tryFindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& memoryType);
+
+//Fullscreen triangle pipeline (no vertex input, no depth, gl_VertexIndex in the vertex shader) for lighting and
+//post passes. pNext takes a VkPipelineRenderingCreateInfo when renderPass is VK_NULL_HANDLE.
+VkPipeline createFullscreenPipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule vertexShader,
+                                    VkShaderModule fragmentShader, VkPipelineLayout layout, VkRenderPass renderPass,
+                                    uint32_t subpass, const void* pNext, const VkAllocationCallbacks* allocator);
+
+//Compute pipeline around a single shader module with entry point main
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule computeShader,
+                                 VkPipelineLayout layout, const VkAllocationCallbacks* allocator);
@@ -1,44 +1,460 @@
 #include "volcano.hpp"
 #include <GLFW/glfw3.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cctype>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <limits>
 #include <ostream>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <vulkan/vulkan_core.h>
-#include "utils/fileread.hpp"
+#include "utils/deviceprobe.hpp"
+#include "utils/hostallocator.hpp"
+#include "utils/pipelinecache.hpp"
+#include "utils/profiler.hpp"
+#include "utils/vkutils.hpp"
+#include "mesh/meshfile.hpp"
+#include "mesh/meshoptimizer.hpp"
+#include "mesh/meshsimplify.hpp"
+#include "mesh/objloader.hpp"
 
 //2 Weeks and 1K lines of code for a single triangle lol
 
 void Volcano::run()
 {
-  std::cout << "Before InitWindow" << std::endl;
-  initWindow();
+  getHostAllocator().setEnabled(!m_Config.systemAllocator);
+  m_Allocator = getHostAllocator().callbacks();
+
+  m_StartupStart = std::chrono::steady_clock::now();
+  profilerSetEnabled(!m_Config.tracePath.empty());
+  profilerSetThreadName("main");
+
+  if (m_Config.listDevices)
+  {
+    initWindow();
+    createInstance();
+    createSurface();
+    listDevices();
+
+    vkDestroySurfaceKHR(m_VulkanInstance, m_Surface, m_Allocator);
+    vkDestroyInstance(m_VulkanInstance, m_Allocator);
+    if (m_Window)
+    {
+      glfwDestroyWindow(m_Window);
+      glfwTerminate();
+    }
+    return;
+  }
+
   std::cout << "Before InitVulkan" << std::endl;
   initVulkan();
+  float travel = (m_Config.grid + 1) * GRID_SPACING;
+  if (m_WorldStreamer.isOpen())
+  {
+    //Down the whole world, short of the far edge by a cell
+    const WorldFileHeader& header = m_WorldStreamer.index().header;
+    travel = std::max(travel, (header.cellsZ - 1) * header.cellSize - 4.0f);
+  }
+  if (m_Config.freezeTime >= 0.0)
+  {
+    m_Simulation.freeze(m_Config.freezeTime, travel);
+  }
+  else
+  {
+    m_Simulation.start(m_Config.simRate, travel);
+  }
+  if (m_Config.simBenchmark)
+  {
+    startSimBenchmark();
+  }
   std::cout << "Before Loop" << std::endl;
   loop();
+  m_Simulation.stop();
   std::cout << "Before onExit" << std::endl;
   onExit();
+  reportHostAllocations();
+  if (!m_Config.reportPath.empty())
+  {
+    writeReport();
+  }
+
+  if (!m_Config.tracePath.empty())
+  {
+    profilerWriteTrace(m_Config.tracePath);
+  }
+}
+
+void Volcano::reportHostAllocations()
+{
+  if (!m_Allocator)
+  {
+    return;
+  }
+
+  //Everything should be back to zero live here, anything left is a leaked object or a driver cache
+  HostAllocatorStats stats = getHostAllocator().stats();
+  std::cout << "Host allocations by scope (live bytes / live count / peak bytes / total allocations):" << std::endl;
+  for (int scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; scope++)
+  {
+    const HostScopeStats& scopeStats = stats.scopes[scope];
+    std::cout << "  " << HostAllocator::scopeName(scope) << ": " << scopeStats.liveBytes << " / "
+              << scopeStats.liveCount << " / " << scopeStats.peakBytes << " / " << scopeStats.totalAllocations << std::endl;
+  }
+  std::cout << "  command arena overflows: " << stats.arenaOverflows << std::endl;
+}
+
+void Volcano::reportResources()
+{
+  ResourceRegistryStats stats = m_Resources.stats();
+  std::cout << "Registry resources at exit (live count / live bytes):" << std::endl;
+  for (int type = 0; type < RESOURCE_TYPE_COUNT; type++)
+  {
+    std::cout << "  " << ResourceRegistry::typeName(static_cast<ResourceType>(type)) << ": "
+              << stats.types[type].liveCount << " / " << stats.types[type].liveBytes << std::endl;
+  }
+  std::cout << "  pending releases: " << stats.pendingCount << " (" << stats.pendingBytes << " bytes), destroyed mid-run: "
+            << stats.destroyedTotal << std::endl;
+}
+
+void Volcano::writeReport()
+{
+  std::ofstream report(m_Config.reportPath);
+  if (!report)
+  {
+    throw std::runtime_error("Failed to open report file " + m_Config.reportPath + "!");
+  }
+
+  //Lower is better for everything in here, that's how the regression check reads it
+  std::vector<double> frameMs = m_ReportFrameMs;
+  std::sort(frameMs.begin(), frameMs.end());
+  double meanMs = 0.0;
+  for (double ms : frameMs)
+  {
+    meanMs += ms;
+  }
+  size_t frames = frameMs.size();
+  report << "frames " << frames << "\n";
+  if (frames > 0)
+  {
+    report << "frame_ms_mean " << meanMs / frames << "\n";
+    report << "frame_ms_p50 " << frameMs[frames / 2] << "\n";
+    report << "frame_ms_p95 " << frameMs[std::min(frames - 1, frames * 95 / 100)] << "\n";
+  }
+  report << "time_to_first_frame_ms " << m_TimeToFirstFrameMs << "\n";
+  report << "resource_peak_bytes " << m_PeakResourceBytes << "\n";
+
+  if (m_Allocator)
+  {
+    HostAllocatorStats stats = getHostAllocator().stats();
+    uint64_t peakBytes = 0;
+    uint64_t liveCount = 0;
+    for (const HostScopeStats& scopeStats : stats.scopes)
+    {
+      peakBytes += scopeStats.peakBytes;
+      liveCount += scopeStats.liveCount;
+    }
+    if (frames > 0)
+    {
+      report << "host_allocations_per_frame " << static_cast<double>(m_ReportAllocations) / frames << "\n";
+    }
+    report << "host_peak_bytes " << peakBytes << "\n";
+    report << "host_live_allocations_at_exit " << liveCount << "\n";
+    report << "host_arena_overflows " << stats.arenaOverflows << "\n";
+  }
+  std::cout << "Wrote report to " << m_Config.reportPath << std::endl;
 }
 
 void Volcano::loop()
 {
-  while (!glfwWindowShouldClose(m_Window))
+  auto lastReport = std::chrono::steady_clock::now();
+  uint32_t frames = 0;
+  uint64_t hostAllocationsAtReport = getHostAllocator().stats().totalAllocations();
+  uint64_t simTicksAtReport = m_Simulation.ticks();
+
+  auto lastFrame = std::chrono::steady_clock::now();
+  uint64_t reportAllocationsStart = 0;
+
+  while (!shouldClose())
   {
-    glfwPollEvents();
+    //Sleep before sampling input, not after, so the frame is built from the freshest input
+    m_FrameLimiter.wait();
+    if (m_Window)
+    {
+      glfwPollEvents();
+    }
+    m_InputSampleTime = std::chrono::steady_clock::now();
+
+    getHostAllocator().beginFrame();
+    //Sim benchmark render load, stands in for a heavy render thread
+    simulateWork(m_RenderLoadMs);
     drawFrame();
+    frames++;
+
+    if (m_FrameNumber == 1)
+    {
+      //Submitted and queued for present, what the startup work is measured against
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_StartupStart;
+      m_TimeToFirstFrameMs = elapsed.count();
+      std::cout << "Time to first frame: " << m_TimeToFirstFrameMs << " ms" << std::endl;
+    }
+
+    if (!m_Config.reportPath.empty())
+    {
+      auto frameEnd = std::chrono::steady_clock::now();
+      if (m_FrameNumber == REPORT_WARMUP_FRAMES)
+      {
+        reportAllocationsStart = getHostAllocator().stats().totalAllocations();
+      }
+      else if (m_FrameNumber > REPORT_WARMUP_FRAMES)
+      {
+        m_ReportFrameMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - lastFrame).count());
+      }
+      m_PeakResourceBytes = std::max(m_PeakResourceBytes, m_Resources.stats().liveBytes());
+      lastFrame = frameEnd;
+    }
+
+    if (m_Config.lightBenchmark)
+    {
+      stepLightBenchmark();
+    }
+    if (m_Config.simBenchmark)
+    {
+      stepSimBenchmark();
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastReport >= std::chrono::seconds(1))
+    {
+      std::cout << frames << " fps, sim " << m_Simulation.ticks() - simTicksAtReport << " ticks/s"
+                << ", triangles/frame " << m_FrameStats.trianglesSubmitted
+                << " (without LOD " << m_FrameStats.trianglesWithoutLod << ")"
+                << ", binds " << m_FrameStats.bindsIssued << " (avoided " << m_FrameStats.bindsAvoided << ")";
+      if (!m_Config.deferredShading)
+      {
+        std::cout << ", lights " << m_FrameStats.lightsVisible << "/" << m_LightCount
+                  << ", shadow cascade renders " << m_ShadowCascadeRenders;
+      }
+      if (m_Config.gpuTimings && !m_Config.lightBenchmark)
+      {
+        //The light benchmark takes the averages for itself
+        for (const auto& range : m_GpuTimeline.takeAverages())
+        {
+          std::cout << ", " << range.first << " " << range.second << " ms";
+        }
+        for (const auto& range : m_ComputeTimeline.takeAverages())
+        {
+          std::cout << ", async " << range.first << " " << range.second << " ms";
+        }
+      }
+      if (m_RenderExtent.width != m_SwapChainExtent.width || m_DynamicResolutionEnabled)
+      {
+        std::cout << ", render " << m_RenderExtent.width << "x" << m_RenderExtent.height
+                  << " (" << static_cast<int>(m_RenderScale * 100.0f + 0.5f) << "%, " << m_RenderScaleChanges << " changes)";
+        m_RenderScaleChanges = 0;
+      }
+      if (m_OcclusionCullingEnabled)
+      {
+        //Last collected frame, triangles/frame above is what the CPU handed over before culling
+        std::cout << ", occlusion drawn " << m_OcclusionStats.earlyObjects << "+" << m_OcclusionStats.lateObjects
+                  << ", occluded " << m_OcclusionStats.occludedObjects
+                  << ", outside frustum " << m_OcclusionStats.frustumCulledObjects
+                  << ", triangles drawn " << m_OcclusionStats.drawnTriangles
+                  << " (saved " << m_OcclusionStats.occludedTriangles << ")";
+      }
+      if (m_WorldStreamer.isOpen())
+      {
+        WorldStreamStats worldStats = m_WorldStreamer.takeStats();
+        std::cout << ", world cells " << m_WorldStreamer.residentCells() << " resident (" << m_WorldStreamer.loadingCells()
+                  << " loading, +" << worldStats.cellsLoaded << " -" << worldStats.cellsUnloaded << ")"
+                  << ", world triangles " << m_FrameStats.worldTriangles
+                  << ", I/O " << worldStats.bytesRead / (1024.0 * 1024.0) << " MB/s";
+        if (worldStats.readSeconds > 0.0)
+        {
+          //Per thread, what a single read sees
+          std::cout << " (" << worldStats.bytesRead / (1024.0 * 1024.0) / worldStats.readSeconds << " MB/s per thread)";
+        }
+        if (worldStats.uploadLatencySamples > 0)
+        {
+          std::cout << ", cell latency " << worldStats.uploadLatencySumMs / worldStats.uploadLatencySamples
+                    << " ms avg / " << worldStats.uploadLatencyMaxMs << " ms max";
+        }
+        if (worldStats.cellsDiscarded > 0 || worldStats.readErrors > 0)
+        {
+          std::cout << ", " << worldStats.cellsDiscarded << " reads discarded, " << worldStats.readErrors << " read errors";
+        }
+        std::cout << ", hitches " << m_WorldHitches;
+        m_WorldHitches = 0;
+      }
+      ResourceRegistryStats resourceStats = m_Resources.stats();
+      std::cout << ", resources " << resourceStats.liveCount() << " (" << resourceStats.liveBytes() / (1024 * 1024) << " MB)";
+      if (resourceStats.pendingCount > 0)
+      {
+        std::cout << ", " << resourceStats.pendingCount << " pending release";
+      }
+      VkDeviceSize evictedBytes;
+      uint32_t evictions = m_MemoryBudget.takeEvictions(evictedBytes);
+      std::cout << ", device memory " << m_MemoryBudget.deviceLocalUsage() / (1024 * 1024) << "/"
+                << m_MemoryBudget.deviceLocalBudget() / (1024 * 1024) << " MB"
+                << (m_MemoryBudget.budgetExtensionEnabled() ? "" : " (tracked)");
+      if (m_MemoryBudget.overBudget())
+      {
+        std::cout << " over budget";
+      }
+      if (evictions > 0)
+      {
+        std::cout << ", evicted " << evictedBytes / (1024 * 1024) << " MB in " << evictions << " rounds";
+      }
+      if (m_PresentLatencySamples > 0)
+      {
+        std::cout << ", input to present " << m_PresentLatencySum / m_PresentLatencySamples << " ms";
+      }
+      if (m_Allocator)
+      {
+        //Steady state should be zero, anything else is churn in the frame loop
+        uint64_t hostAllocations = getHostAllocator().stats().totalAllocations();
+        std::cout << ", host allocs/frame " << (hostAllocations - hostAllocationsAtReport) / frames;
+        hostAllocationsAtReport = hostAllocations;
+      }
+      std::cout << std::endl;
+
+      frames = 0;
+      simTicksAtReport = m_Simulation.ticks();
+      m_ShadowCascadeRenders = 0;
+      m_PresentLatencySum = 0.0;
+      m_PresentLatencySamples = 0;
+      lastReport = now;
+
+      if (m_Config.watchShaders)
+      {
+        reloadChangedShaders();
+      }
+    }
   }
   vkDeviceWaitIdle(m_Device);
+
+  if (!m_ReportFrameMs.empty())
+  {
+    m_ReportAllocations = getHostAllocator().stats().totalAllocations() - reportAllocationsStart;
+  }
 }
 
+void Volcano::requestClose()
+{
+  m_CloseRequested = true;
+  if (m_Window)
+  {
+    glfwSetWindowShouldClose(m_Window, GLFW_TRUE);
+  }
+}
+
+bool Volcano::shouldClose() const
+{
+  return m_CloseRequested || (m_Window && glfwWindowShouldClose(m_Window));
+}
+
+//Phases of --sim-benchmark: nothing extra, a sim that spends most of its tick working, a slow render thread
+static const struct
+{
+  const char* name;
+  double simLoadTicks;
+  double renderLoadMs;
+} s_SimBenchmarkPhases[] =
+{
+  {"idle", 0.0, 0.0},
+  {"sim load", 0.7, 0.0},
+  {"render load", 0.0, 25.0},
+  {"both", 0.7, 25.0}
+};
+#define SIM_BENCHMARK_PHASE_SECONDS 3.0
+#define SIM_BENCHMARK_WARMUP_SECONDS 0.5
+
+void Volcano::startSimBenchmark()
+{
+  std::cout << "Sim benchmark, " << m_Simulation.tickRate() << " Hz fixed timestep, "
+            << SIM_BENCHMARK_PHASE_SECONDS << " s per phase" << std::endl;
+  std::cout << std::setw(12) << "phase" << std::setw(8) << "fps" << std::setw(16) << "worst frame ms"
+            << std::setw(10) << "sim Hz" << std::setw(15) << "worst tick ms" << std::setw(9) << "skipped" << std::endl;
+
+  m_SimBenchmarkPhase = 0;
+  m_SimBenchmarkMeasuring = false;
+  m_Simulation.setLoad(s_SimBenchmarkPhases[0].simLoadTicks * 1000.0 / m_Simulation.tickRate());
+  m_RenderLoadMs = s_SimBenchmarkPhases[0].renderLoadMs;
+  m_SimBenchmarkStart = std::chrono::steady_clock::now();
+  m_SimBenchmarkLastFrame = m_SimBenchmarkStart;
+}
+
+void Volcano::stepSimBenchmark()
+{
+  auto now = std::chrono::steady_clock::now();
+  const auto& phase = s_SimBenchmarkPhases[m_SimBenchmarkPhase];
+
+  std::chrono::duration<double> elapsed = now - m_SimBenchmarkStart;
+  std::chrono::duration<double, std::milli> frameGap = now - m_SimBenchmarkLastFrame;
+  m_SimBenchmarkLastFrame = now;
+
+  //Warmup lets the new load settle before anything is counted
+  if (!m_SimBenchmarkMeasuring)
+  {
+    if (elapsed.count() < SIM_BENCHMARK_WARMUP_SECONDS)
+    {
+      return;
+    }
+    m_SimBenchmarkMeasuring = true;
+    m_SimBenchmarkStart = now;
+    m_SimBenchmarkFrames = 0;
+    m_SimBenchmarkWorstFrameMs = 0.0;
+    m_SimBenchmarkTicks = m_Simulation.ticks();
+    m_SimBenchmarkSkipped = m_Simulation.skippedTicks();
+    m_Simulation.takeWorstTickGap();
+    return;
+  }
+
+  m_SimBenchmarkFrames++;
+  m_SimBenchmarkWorstFrameMs = std::max(m_SimBenchmarkWorstFrameMs, frameGap.count());
+  if (elapsed.count() < SIM_BENCHMARK_PHASE_SECONDS)
+  {
+    return;
+  }
+
+  std::cout << std::fixed << std::setprecision(1)
+            << std::setw(12) << phase.name << std::setw(8) << m_SimBenchmarkFrames / elapsed.count()
+            << std::setw(16) << m_SimBenchmarkWorstFrameMs
+            << std::setw(10) << (m_Simulation.ticks() - m_SimBenchmarkTicks) / elapsed.count()
+            << std::setw(15) << m_Simulation.takeWorstTickGap()
+            << std::setw(9) << m_Simulation.skippedTicks() - m_SimBenchmarkSkipped << std::defaultfloat << std::endl;
+
+  m_SimBenchmarkPhase++;
+  if (m_SimBenchmarkPhase == sizeof(s_SimBenchmarkPhases) / sizeof(s_SimBenchmarkPhases[0]))
+  {
+    m_Simulation.setLoad(0.0);
+    m_RenderLoadMs = 0.0;
+    requestClose();
+    return;
+  }
+
+  const auto& next = s_SimBenchmarkPhases[m_SimBenchmarkPhase];
+  m_Simulation.setLoad(next.simLoadTicks * 1000.0 / m_Simulation.tickRate());
+  m_RenderLoadMs = next.renderLoadMs;
+  m_SimBenchmarkMeasuring = false;
+  m_SimBenchmarkStart = now;
+}
 
 void Volcano::initWindow()
 {
+  if (m_Config.headless)
+  {
+    return;
+  }
+
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
@@ -48,25 +464,480 @@ void Volcano::initWindow()
 
 void Volcano::initVulkan()
 {
-  createInstance();
-  setupDebugMessenger();
-  createSurface();
-  selectPhysicalDevice();
-  createLogicalDevice();
-  createSwapChain();
-  createImageViews();
-  createRenderPass();
-  createGraphicalPipeline();
-  createFrameBuffers();
-  createCommandPool();
-  createCommandBuffer();
-  createSyncObjects();
+  PROFILE_FUNCTION();
+  //Before any task, the instance asks GLFW for its extensions while the window is still being created
+  if (!m_Config.headless)
+  {
+    glfwInit();
+  }
+
+  //File reads have no dependencies and overlap everything up to the device, each pipeline compiles as soon as
+  //its formats, layouts and shaders are there. Window and swapchain calls are GLFW's, they stay on this thread.
+  TaskGraph graph;
+  std::vector<TaskId> compileInputs;
+  for (const std::string& path : startupShaderPaths())
+  {
+    compileInputs.push_back(graph.add("read shader", {}, [this, path] { m_ShaderLibrary.preload(path); }));
+  }
+  std::vector<char> pipelineCacheData;
+  TaskId readCache = graph.add("read pipeline cache", {}, [&]
+  {
+    if (!m_Config.pipelineCachePath.empty())
+    {
+      pipelineCacheData = readPipelineCacheFile(m_Config.pipelineCachePath);
+    }
+  });
+  TaskId mesh = graph.add("load mesh", {}, [this] { loadMesh(); });
+
+  TaskId window = graph.add("window", {}, [this] { initWindow(); }, true);
+  TaskId instance = graph.add("instance", {}, [this]
+  {
+    createInstance();
+    setupDebugMessenger();
+  });
+  TaskId surface = graph.add("surface", {window, instance}, [this] { createSurface(); }, true);
+  TaskId device = graph.add("device", {surface}, [this]
+  {
+    selectPhysicalDevice();
+    createLogicalDevice();
+    m_Resources.init(m_Device, m_Config.framesInFlight, m_Allocator);
+    m_MemoryBudget.init(m_PhysicalDevice, m_MemoryBudgetExtension, m_Config.memoryBudget);
+  });
+  //chooseSwapExtent asks GLFW for the framebuffer size
+  TaskId swapChain = graph.add("swapchain", {device}, [this]
+  {
+    createSwapChain();
+    createImageViews();
+  }, true);
+  compileInputs.push_back(graph.add("pipeline cache", {device, readCache}, [&]
+  {
+    bool reused;
+    m_PipelineCache = createPipelineCache(m_Device, m_PhysicalDevice, pipelineCacheData, m_Allocator, reused);
+    m_PipelineCacheReused = reused ? pipelineCacheData.size() : 0;
+  }));
+  TaskId depth = graph.add("depth", {swapChain}, [this] { createDepthResources(); });
+
+  auto withCompileInputs = [&](std::vector<TaskId> dependencies)
+  {
+    dependencies.insert(dependencies.end(), compileInputs.begin(), compileInputs.end());
+    return dependencies;
+  };
+  //The forward pipeline layout includes the cluster, shadow and occlusion set layouts
+  TaskId cluster = graph.add("cluster resources", withCompileInputs({device}), [this] { createClusterResources(); });
+  TaskId shadows = graph.add("shadow resources", withCompileInputs({device}), [this] { createShadowResources(); });
+  //After depth, which turns occlusion culling off when the depth format can't be sampled
+  TaskId occlusion = graph.add("occlusion resources", withCompileInputs({depth}), [this]
+  {
+    if (m_OcclusionCullingEnabled)
+    {
+      createOcclusionResources();
+    }
+  });
+  TaskId post = graph.add("post resources", withCompileInputs({swapChain}), [this]
+  {
+    if (m_Config.postProcessing)
+    {
+      createPostResources();
+    }
+  });
+  //Only needs the formats, mainColorFormat is known once the swapchain is
+  TaskId renderPass = graph.add("render pass", {swapChain, depth}, [this]
+  {
+    if (m_Config.deferredShading)
+    {
+      createGBuffer();
+      createDeferredRenderPass();
+    }
+    else if (!m_DynamicRenderingEnabled)
+    {
+      createRenderPass();
+    }
+  });
+  graph.add("mesh pipelines", withCompileInputs({renderPass, cluster, shadows, occlusion}), [this]
+  {
+    createGraphicalPipeline();
+    if (m_Config.watchShaders)
+    {
+      //First call only records the write times
+      reloadChangedShaders();
+    }
+  });
+  graph.add("lighting pipeline", withCompileInputs({renderPass}), [this]
+  {
+    if (m_Config.deferredShading)
+    {
+      createLightingPipeline();
+      reportRendererMemory();
+    }
+  });
+  graph.add("framebuffers", {renderPass, post}, [this]
+  {
+    if (!m_DynamicRenderingEnabled)
+    {
+      createFrameBuffers();
+    }
+  });
+
+  //m_CommandPool and the graphics queue are externally synchronized, everything using them during startup is one chain
+  TaskId commandPool = graph.add("command pool", {device}, [this]
+  {
+    createCommandPool();
+    m_GpuTimeline.init(m_VulkanInstance, m_Device, m_PhysicalDevice, findQueueFamilies(m_PhysicalDevice).graphicsFamily.value(),
+                       m_CommandPool, m_GraphicsQueue, m_Config.framesInFlight,
+                       profilerEnabled() || m_Config.lightBenchmark || m_Config.gpuTimings || m_Config.dynamicResolution,
+                       validationLayersOn, m_Allocator);
+  });
+  graph.add("render scale", {commandPool, swapChain}, [this] { initRenderScale(); });
+  graph.add("async compute", {device}, [this]
+  {
+    if (m_AsyncComputeEnabled)
+    {
+      createAsyncCompute();
+    }
+  });
+  TaskId scene = graph.add("scene buffers", {mesh, commandPool, occlusion}, [this]
+  {
+    createVertexBuffer();
+    createIndexBuffer();
+    createScene();
+    if (m_OcclusionCullingEnabled)
+    {
+      createOcclusionBuffers();
+    }
+  });
+  graph.add("lights", {}, [this]
+  {
+    createLights();
+    m_LightCount = m_Config.lightCount;
+    if (m_Config.lightBenchmark)
+    {
+      startLightBenchmark();
+    }
+  });
+  graph.add("frame resources", {scene, swapChain}, [this]
+  {
+    createCommandBuffers();
+    createSyncObjects();
+  });
+  graph.add("capture", {swapChain}, [this]
+  {
+    if (m_CaptureEnabled)
+    {
+      createCapture();
+    }
+  });
+  graph.add("world", {device}, [this]
+  {
+    if (!m_Config.worldPath.empty())
+    {
+      createWorld();
+    }
+  });
+
+  //Tasks are added in the old serial order, --serial-startup runs them that way for comparison
+  ThreadPool pool;
+  uint32_t threads = 0;
+  if (!m_Config.serialStartup)
+  {
+    threads = std::clamp(std::thread::hardware_concurrency(), 2u, STARTUP_MAX_THREADS);
+    pool.start(threads, "startup");
+  }
+  graph.run(threads > 0 ? &pool : nullptr);
+  pool.stop();
+  m_ShaderLibrary.clear();
+
+  reportStartup(graph, threads);
+}
+
+void Volcano::reportStartup(const TaskGraph& graph, uint32_t threads)
+{
+  double busyMs = 0.0;
+  std::vector<TaskTiming> timings = graph.timings();
+  for (const TaskTiming& timing : timings)
+  {
+    busyMs += timing.endMs - timing.startMs;
+  }
+
+  if (threads > 0)
+  {
+    std::cout << "Startup on the main thread + " << threads << " workers: ";
+  }
+  else
+  {
+    std::cout << "Serial startup: ";
+  }
+  std::cout << std::fixed << std::setprecision(1) << graph.elapsedMs() << " ms (" << busyMs << " ms of tasks)" << std::endl;
+
+  //Shader reads are many and tiny, one line for all of them
+  double shaderStartMs = std::numeric_limits<double>::max();
+  double shaderEndMs = 0.0;
+  for (const TaskTiming& timing : timings)
+  {
+    if (strcmp(timing.name, "read shader") == 0)
+    {
+      shaderStartMs = std::min(shaderStartMs, timing.startMs);
+      shaderEndMs = std::max(shaderEndMs, timing.endMs);
+      continue;
+    }
+    std::cout << "  " << std::left << std::setw(22) << timing.name << std::right << std::setw(8) << timing.startMs
+              << " - " << std::setw(8) << timing.endMs << " ms" << (timing.mainThread ? "  (main thread)" : "") << std::endl;
+  }
+  if (shaderEndMs > 0.0)
+  {
+    std::cout << "  " << std::left << std::setw(22) << "read shaders" << std::right << std::setw(8) << shaderStartMs
+              << " - " << std::setw(8) << shaderEndMs << " ms" << std::endl;
+  }
+  std::cout << std::defaultfloat;
+
+  if (m_PipelineCacheReused > 0)
+  {
+    std::cout << "Pipeline cache: reused " << m_PipelineCacheReused / 1024 << " KB from " << m_Config.pipelineCachePath << std::endl;
+  }
+}
+
+//Every .spv the startup tasks create modules from with this config
+std::vector<std::string> Volcano::startupShaderPaths() const
+{
+  std::vector<std::string> paths = {VOLCANO_SHADER_DIR "shader.vert.spv",
+                                    m_Config.deferredShading ? VOLCANO_SHADER_DIR "gbuffer.frag.spv"
+                                                             : VOLCANO_SHADER_DIR "shader.frag.spv",
+                                    VOLCANO_SHADER_DIR "cluster.comp.spv", VOLCANO_SHADER_DIR "shadow.vert.spv"};
+  if (m_Config.deferredShading || m_Config.postProcessing)
+  {
+    paths.push_back(VOLCANO_SHADER_DIR "fullscreen.vert.spv");
+  }
+  if (m_Config.deferredShading)
+  {
+    paths.push_back(VOLCANO_SHADER_DIR "lighting.frag.spv");
+  }
+  if (m_Config.postProcessing)
+  {
+    paths.insert(paths.end(), {VOLCANO_SHADER_DIR "bloom_down.comp.spv", VOLCANO_SHADER_DIR "bloom_up.comp.spv",
+                               VOLCANO_SHADER_DIR "tonemap.frag.spv"});
+  }
+  //The device can still turn it off, then these were read for nothing
+  if (m_Config.occlusionCulling)
+  {
+    paths.insert(paths.end(), {VOLCANO_SHADER_DIR "indirect.vert.spv", VOLCANO_SHADER_DIR "hiz_build.comp.spv",
+                               VOLCANO_SHADER_DIR "occlusion_cull.comp.spv"});
+  }
+  return paths;
+}
+
+VkShaderModule Volcano::loadShader(const char* path)
+{
+  return createShaderModule(m_ShaderLibrary.get(path));
+}
+
+
+void Volcano::loadMesh()
+{
+  PROFILE_FUNCTION();
+  const std::string& path = m_Config.meshPath;
+
+  if (path.empty())
+  {
+    //The old hardcoded triangle, the shader colors by abs(normal) so these normals double as the vertex colors
+    m_Mesh.vertices =
+    {
+      {{0.0f, 0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.5f, 0.0f}},
+      {{-0.5f, -0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+      {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}}
+    };
+    m_Mesh.indices = {0, 1, 2};
+    m_Mesh.computeBounds();
+  }
+  else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0)
+  {
+    ImportStats stats;
+    m_Mesh = loadObj(path, &stats);
+
+    float acmrBefore = computeACMR(m_Mesh.indices, m_Mesh.vertices.size());
+    optimizeMesh(m_Mesh);
+    float acmrAfter = computeACMR(m_Mesh.indices, m_Mesh.vertices.size());
+    buildLodChain(m_Mesh);
+
+    std::cout << "Imported " << path << " at " << stats.throughputMBs() << " MB/s, ACMR "
+              << acmrBefore << " -> " << acmrAfter << std::endl;
+  }
+  else
+  {
+    m_Mesh = loadMeshFile(path);
+  }
+
+  if (m_Mesh.indices.empty())
+  {
+    throw std::runtime_error("Mesh has no triangles!");
+  }
+  m_Mesh.ensureLods();
+}
+
+void Volcano::createScene()
+{
+  PROFILE_FUNCTION();
+  //Normalize the mesh to a unit sized object centered on its grid cell
+  Vec3 boundsMin(m_Mesh.boundsMin[0], m_Mesh.boundsMin[1], m_Mesh.boundsMin[2]);
+  Vec3 boundsMax(m_Mesh.boundsMax[0], m_Mesh.boundsMax[1], m_Mesh.boundsMax[2]);
+  Vec3 extent = boundsMax - boundsMin;
+  Vec3 meshCenter = (boundsMin + boundsMax) * 0.5f;
+
+  float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+  float scale = largestExtent > 0.0f ? 1.0f / largestExtent : 1.0f;
+  float radius = length(extent) * 0.5f * scale;
+
+  int grid = m_Config.grid;
+  m_Objects.clear();
+  m_Objects.reserve(static_cast<size_t>(grid) * grid);
+
+  for (int row = 0; row < grid; row++)
+  {
+    for (int column = 0; column < grid; column++)
+    {
+      Vec3 position((column - (grid - 1) * 0.5f) * GRID_SPACING, 0.0f, -row * GRID_SPACING);
+
+      SceneObject object;
+      object.model = Mat4::translation(position) * Mat4::scale(scale) * Mat4::translation(-meshCenter);
+      object.center = position;
+      object.radius = radius;
+      object.scale = scale;
+      m_Objects.push_back(object);
+    }
+  }
+}
+
+uint32_t Volcano::selectLod(const SceneObject& object, float distance, float pixelsPerUnit) const
+{
+  //Coarsest first, the first one under the threshold wins
+  for (size_t i = m_Mesh.lods.size(); i-- > 1;)
+  {
+    float projectedError = m_Mesh.lods[i].error * object.scale * pixelsPerUnit / distance;
+    if (projectedError <= m_Config.lodThresholdPixels)
+    {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  return 0;
+}
+
+void Volcano::buildDrawList()
+{
+  PROFILE_FUNCTION();
+  //The camera path lives in the simulation, see Simulation::step
+  SimState simState = m_Simulation.sample();
+  m_SimTime = simState.time;
+  Vec3 eye = simState.eye;
+  Vec3 target = eye + Vec3(0.0f, -0.15f, -1.0f);
+
+  float aspect = m_SwapChainExtent.width / static_cast<float>(m_SwapChainExtent.height);
+  Mat4 view = Mat4::lookAt(eye, target, Vec3(0.0f, 1.0f, 0.0f));
+  Mat4 projection = Mat4::perspective(CAMERA_FOV, aspect, CAMERA_NEAR, CAMERA_FAR);
+  Mat4 viewProjection = projection * view;
+
+  //Pixels covered by one unit of world space at distance 1, at the resolution actually rendered
+  float pixelsPerUnit = m_RenderExtent.height / (2.0f * std::tan(CAMERA_FOV * 0.5f));
+
+  m_DrawList.clear();
+  m_DrawQueue.clear();
+  m_FrameStats = {};
+
+  if (m_WorldStreamer.isOpen())
+  {
+    updateWorld(eye, simState.time, view, viewProjection);
+  }
+
+  for (const SceneObject& object : m_Objects)
+  {
+    float distance = std::max(length(object.center - eye) - object.radius, CAMERA_NEAR);
+    uint32_t lodIndex = m_Config.lodEnabled ? selectLod(object, distance, pixelsPerUnit) : 0;
+    const MeshLod& lod = m_Mesh.lods[lodIndex];
+
+    m_DrawQueue.push(makeDrawKey(DRAW_PASS_MAIN, PIPELINE_MESH, MATERIAL_DEFAULT, MESH_SCENE, distance / CAMERA_FAR),
+                     static_cast<uint32_t>(m_DrawList.size()));
+    m_DrawList.push_back({viewProjection * object.model, view * object.model, lod.firstIndex, lod.indexCount});
+
+    m_FrameStats.trianglesSubmitted += lod.indexCount / 3;
+    m_FrameStats.trianglesWithoutLod += m_Mesh.lods[0].indexCount / 3;
+  }
+
+  {
+    PROFILE_SCOPE("sort draws");
+    m_DrawQueue.sort();
+  }
+
+  if (m_OcclusionCullingEnabled)
+  {
+    uploadOcclusionObjects(viewProjection);
+  }
+
+  if (!m_Config.deferredShading)
+  {
+    updateLights(view, projection);
+    updateShadows(eye, target, view);
+  }
+}
+
+void Volcano::createDepthResources()
+{
+  PROFILE_FUNCTION();
+  m_DepthFormat = findDepthFormat(m_PhysicalDevice);
+
+  //The Hi-Z build samples the depth buffer between the two occlusion phases
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (m_OcclusionCullingEnabled)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(m_PhysicalDevice, m_DepthFormat, &properties);
+    if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+    {
+      usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+    else
+    {
+      std::cout << "Depth format can't be sampled, occlusion culling disabled" << std::endl;
+      m_OcclusionCullingEnabled = false;
+    }
+  }
+
+  VkDeviceMemory depthMemory;
+  createImage(m_Device, m_PhysicalDevice, m_SwapChainExtent.width, m_SwapChainExtent.height, m_DepthFormat,
+              VK_IMAGE_TILING_OPTIMAL, usage,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_DepthImage, depthMemory);
+  m_DepthImageView = createImageView(m_Device, m_DepthImage, m_DepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+  m_DepthImageResource = m_Resources.addImage(m_DepthImage, depthMemory, "depth");
+  m_DepthViewResource = m_Resources.addImageView(m_DepthImageView, "depth view");
+}
+
+void Volcano::createVertexBuffer()
+{
+  PROFILE_FUNCTION();
+  VkDeviceSize bufferSize = sizeof(m_Mesh.vertices[0]) * m_Mesh.vertices.size();
+
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  createDeviceLocalBuffer(m_Device, m_PhysicalDevice, m_CommandPool, m_GraphicsQueue,
+                          m_Mesh.vertices.data(), bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, buffer, memory);
+  m_VertexBuffer = m_Resources.addBuffer(buffer, memory, "scene vertices");
+}
+
+void Volcano::createIndexBuffer()
+{
+  PROFILE_FUNCTION();
+  VkDeviceSize bufferSize = sizeof(m_Mesh.indices[0]) * m_Mesh.indices.size();
+
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  createDeviceLocalBuffer(m_Device, m_PhysicalDevice, m_CommandPool, m_GraphicsQueue,
+                          m_Mesh.indices.data(), bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, buffer, memory);
+  m_IndexBuffer = m_Resources.addBuffer(buffer, memory, "scene indices");
+
+  m_MeshBindings = {{m_Resources.buffer(m_VertexBuffer), m_Resources.buffer(m_IndexBuffer)}};
 }
 
 
 
 void Volcano::createSyncObjects()
 {
+  PROFILE_FUNCTION();
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -74,135 +945,523 @@ void Volcano::createSyncObjects()
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  if (vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_ImageAvailableSemaphore) != VK_SUCCESS)
+  m_ImageAvailableSemaphores.resize(m_Config.framesInFlight);
+  m_RenderFinishedSemaphores.resize(m_Config.framesInFlight);
+  m_InFlightFences.resize(m_Config.framesInFlight);
+  m_ImagesInFlight.assign(m_SwapChainImages.size(), VK_NULL_HANDLE);
+
+  for (uint32_t i = 0; i < m_Config.framesInFlight; i++)
+  {
+    if (vkCreateSemaphore(m_Device, &semaphoreInfo, m_Allocator, &m_ImageAvailableSemaphores[i]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create image semaphore!");
+    }
+
+    if (vkCreateSemaphore(m_Device, &semaphoreInfo, m_Allocator, &m_RenderFinishedSemaphores[i]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create render finished semaphore!");
+    }
+
+    if (vkCreateFence(m_Device, &fenceInfo, m_Allocator, &m_InFlightFences[i]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create in flight fence!");
+    }
+  }
+}
+
+void Volcano::drawFrame()
+{
+  PROFILE_FUNCTION();
+  VkFence inFlightFence = m_InFlightFences[m_CurrentFrame];
+  VkCommandBuffer commandBuffer = m_CommandBuffers[m_CurrentFrame];
+
+  {
+    PROFILE_SCOPE("wait for frame fence");
+    vkWaitForFences(m_Device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+  }
+  //Frames up to m_FrameNumber - framesInFlight are done now, so is whatever they released
+  m_Resources.beginFrame(m_FrameNumber);
+  {
+    PROFILE_SCOPE("memory budget");
+    ResourceRegistryStats resourceStats = m_Resources.stats();
+    m_MemoryBudget.update(resourceStats.liveBytes() + resourceStats.pendingBytes, resourceStats.pendingBytes);
+  }
+
+  //This slot's copy from framesInFlight frames ago is done, hand it to the encoder
+  if (m_CaptureEnabled)
+  {
+    collectCapture(m_CurrentFrame);
+  }
+
+  //Counters from this slot's last frame, before the cull writes them again
+  if (m_OcclusionCullingEnabled)
+  {
+    collectOcclusionStats(m_CurrentFrame);
+  }
+
+  //Before buildDrawList, the whole frame uses one render extent
+  if (m_DynamicResolutionEnabled)
+  {
+    updateRenderScale();
+  }
+
+  uint32_t imageIndex;
   {
-    throw std::runtime_error("Failed to create image semaphore!");
+    PROFILE_SCOPE("acquire");
+    vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrame], VK_NULL_HANDLE, &imageIndex);
   }
 
-  if (vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_RenderFinishedSemaphore) != VK_SUCCESS)
+  //With more frames in flight than images an image can come back while an older frame still renders to it
+  if (m_ImagesInFlight[imageIndex] != VK_NULL_HANDLE && m_ImagesInFlight[imageIndex] != inFlightFence)
   {
-    throw std::runtime_error("Failed to create render finished semaphore!");
+    vkWaitForFences(m_Device, 1, &m_ImagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
   }
+  m_ImagesInFlight[imageIndex] = inFlightFence;
+  vkResetFences(m_Device, 1, &inFlightFence);
+
+  buildDrawList();
+
+  //Goes first so binning runs while the graphics command buffer is still being recorded
+  if (m_AsyncComputeEnabled)
+  {
+    submitAsyncCompute();
+  }
+
+  vkResetCommandBuffer(commandBuffer, 0);
+  recordCommandBuffer(commandBuffer, imageIndex);
+
+  submitFrame(commandBuffer, inFlightFence);
+
+  VkSemaphore signalSemaphores[] = {m_RenderFinishedSemaphores[m_CurrentFrame]};
+
+  VkPresentInfoKHR presentInfo{};
+  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  presentInfo.waitSemaphoreCount = 1;
+  presentInfo.pWaitSemaphores = signalSemaphores;
+
+  VkSwapchainKHR swapChains[] = {m_SwapChain};
+  presentInfo.swapchainCount = 1;
+  presentInfo.pSwapchains = swapChains;
+  presentInfo.pImageIndices = &imageIndex;
+  presentInfo.pResults = nullptr;
 
-  if (vkCreateFence(m_Device, &fenceInfo, nullptr, &m_InFlightFence) != VK_SUCCESS)
+  VkPresentIdKHR presentId{};
+  if (m_PresentWaitEnabled)
   {
-    throw std::runtime_error("Failed to create image semaphore!");
+    m_PresentId++;
+    presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentId.swapchainCount = 1;
+    presentId.pPresentIds = &m_PresentId;
+    presentInfo.pNext = &presentId;
+    m_PendingPresents.push_back({m_PresentId, m_InputSampleTime});
   }
 
+  {
+    PROFILE_SCOPE("present");
+    vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+  }
 
+  pollPresentLatency();
 
+  m_CurrentFrame = (m_CurrentFrame + 1) % m_Config.framesInFlight;
+  m_FrameNumber++;
 }
 
-void Volcano::drawFrame()
+void Volcano::submitFrame(VkCommandBuffer commandBuffer, VkFence fence)
 {
-  vkWaitForFences(m_Device, 1, &m_InFlightFence, VK_TRUE, UINT64_MAX);
-  vkResetFences(m_Device, 1, &m_InFlightFence);
+  PROFILE_FUNCTION();
+  //The async binning results are first read by the main pass fragment shader, shadows and vertex work don't wait
+  uint32_t waitCount = m_AsyncComputeEnabled ? 2 : 1;
 
-  uint32_t imageIndex;
-  vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+  if (m_Synchronization2Enabled)
+  {
+    //Only the color output has to wait for the acquire, vertex work can start right away
+    VkSemaphoreSubmitInfo waitInfos[2]{};
+    waitInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    waitInfos[0].semaphore = m_ImageAvailableSemaphores[m_CurrentFrame];
+    waitInfos[0].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    if (m_AsyncComputeEnabled)
+    {
+      waitInfos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+      waitInfos[1].semaphore = m_ComputeFinishedSemaphores[m_CurrentFrame];
+      waitInfos[1].stageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+    }
 
-  vkResetCommandBuffer(m_CommandBuffer, 0);
-  recordCommandBuffer(m_CommandBuffer, imageIndex);
+    VkCommandBufferSubmitInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    commandBufferInfo.commandBuffer = commandBuffer;
+
+    VkSemaphoreSubmitInfo signalInfo{};
+    signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signalInfo.semaphore = m_RenderFinishedSemaphores[m_CurrentFrame];
+    //ALL_COMMANDS so the signal also covers the transition to PRESENT_SRC at the end of the command buffer
+    signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo2 submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submitInfo.waitSemaphoreInfoCount = waitCount;
+    submitInfo.pWaitSemaphoreInfos = waitInfos;
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount = 1;
+    submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+    if (vkQueueSubmit2(m_GraphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to submit draw command buffer!");
+    }
+    return;
+  }
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSephamores[] = {m_ImageAvailableSemaphore};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  VkSemaphore waitSephamores[] = {m_ImageAvailableSemaphores[m_CurrentFrame], VK_NULL_HANDLE};
+  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
+  if (m_AsyncComputeEnabled)
+  {
+    waitSephamores[1] = m_ComputeFinishedSemaphores[m_CurrentFrame];
+  }
+  submitInfo.waitSemaphoreCount = waitCount;
   submitInfo.pWaitSemaphores = waitSephamores;
   submitInfo.pWaitDstStageMask = waitStages;
    
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &m_CommandBuffer;
+  submitInfo.pCommandBuffers = &commandBuffer;
 
-  VkSemaphore signalSemaphores[] = {m_RenderFinishedSemaphore};
+  VkSemaphore signalSemaphores[] = {m_RenderFinishedSemaphores[m_CurrentFrame]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  if (vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, m_InFlightFence) != VK_SUCCESS)
+  if (vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to submit draw command buffer!");
   }
+}
 
-  VkPresentInfoKHR presentInfo{};
-  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-  presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = signalSemaphores;
+void Volcano::pollPresentLatency()
+{
+  if (!m_PresentWaitEnabled)
+    return;
 
-  VkSwapchainKHR swapChains[] = {m_SwapChain};
-  presentInfo.swapchainCount = 1;
-  presentInfo.pSwapchains = swapChains;
-  presentInfo.pImageIndices = &imageIndex;
-  presentInfo.pResults = nullptr;
-  vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+  //Zero timeout: never stall the frame, a present found complete this frame is off by at most one frame
+  while (!m_PendingPresents.empty())
+  {
+    const PendingPresent& pending = m_PendingPresents.front();
+    if (m_vkWaitForPresentKHR(m_Device, m_SwapChain, pending.presentId, 0) != VK_SUCCESS)
+      break;
+
+    std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - pending.inputSampleTime;
+    m_PresentLatencySum += latency.count();
+    m_PresentLatencySamples++;
+    m_PendingPresents.pop_front();
+  }
+}
+
+void Volcano::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  PROFILE_FUNCTION();
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = 0;
+  beginInfo.pInheritanceInfo = nullptr;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to begin recording command buffer!");
+  }
+
+  m_GpuTimeline.beginFrame(commandBuffer, m_CurrentFrame);
+  m_GpuTimeline.beginRange(commandBuffer, "frame");
+
+  //Cells staged in buildDrawList, outside any render pass and ahead of everything that draws them
+  recordWorldUploads(commandBuffer);
+
+  //Compute has to finish binning before the render pass begins, no dispatches inside one.
+  //Same for the shadow atlas, it's its own render pass (and usually skipped, see updateShadows).
+  //With async compute the binning was already submitted to the compute queue, see submitAsyncCompute.
+  if (!m_Config.deferredShading)
+  {
+    recordShadowPass(commandBuffer);
+    if (!m_AsyncComputeEnabled)
+    {
+      recordLightBinning(commandBuffer, false);
+    }
+  }
+
+  //Same reason, the early cull writes the commands the main pass draws
+  if (m_OcclusionCullingEnabled)
+  {
+    recordOcclusionCull(commandBuffer, 0);
+  }
+
+  if (m_DynamicRenderingEnabled)
+  {
+    beginDynamicRendering(commandBuffer, imageIndex);
+  }
+  else
+  {
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_RenderPass;
+    renderPassInfo.framebuffer = m_SwapChainFrameBuffer[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = m_RenderExtent;
+
+    VkClearValue clearValues[2 + GBUFFER_ATTACHMENT_COUNT]{};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = m_Config.deferredShading ? 2 + GBUFFER_ATTACHMENT_COUNT : 2;
+    renderPassInfo.pClearValues = clearValues;
+
+    //Returns null either way so no error handling 
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  }
+
+  m_GpuTimeline.beginRange(commandBuffer, "main pass");
+
+  VkViewport viewport{};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = static_cast<uint32_t>(m_RenderExtent.width);
+  viewport.height = static_cast<uint32_t>(m_RenderExtent.height);
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor{};
+  scissor.offset = {0, 0};
+  scissor.extent = m_RenderExtent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  if (!m_Config.deferredShading)
+  {
+    bindClusterSet(commandBuffer);
+    bindShadowSet(commandBuffer);
+  }
+
+  //The GPU picks the draws, phase 0 here and phase 1 after the Hi-Z build in recordOcclusionLatePass
+  if (m_OcclusionCullingEnabled)
+  {
+    recordOcclusionDraws(commandBuffer, 0);
+  }
+  else
+  {
+    //Packets are sorted by key, so a bind only happens where the pipeline or mesh actually changes
+    uint32_t boundPipeline = UINT32_MAX;
+    uint32_t boundMesh = UINT32_MAX;
+
+    for (const DrawPacket& packet : m_DrawQueue.packets())
+    {
+      uint32_t pipeline = drawKeyPipeline(packet.key);
+      if (pipeline != boundPipeline)
+      {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipelines[pipeline]);
+        boundPipeline = pipeline;
+        m_FrameStats.bindsIssued++;
+      }
+      else
+      {
+        m_FrameStats.bindsAvoided++;
+      }
+
+      uint32_t mesh = drawKeyMesh(packet.key);
+      if (mesh != boundMesh)
+      {
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_MeshBindings[mesh].vertexBuffer, &offset);
+        vkCmdBindIndexBuffer(commandBuffer, m_MeshBindings[mesh].indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        boundMesh = mesh;
+        m_FrameStats.bindsIssued += 2;
+      }
+      else
+      {
+        m_FrameStats.bindsAvoided += 2;
+      }
+
+      const DrawItem& draw = m_DrawList[packet.item];
+      vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, 2 * sizeof(Mat4), &draw.mvp);
+      vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, 0, 0);
+    }
+  }
+  recordWorldDraws(commandBuffer);
+  m_GpuTimeline.endRange(commandBuffer);
+
+  if (m_OcclusionCullingEnabled)
+  {
+    recordOcclusionLatePass(commandBuffer, imageIndex);
+  }
 
-  
-}
+  if (m_DynamicRenderingEnabled)
+  {
+    endDynamicRendering(commandBuffer, imageIndex);
+  }
+  else
+  {
+    if (m_Config.deferredShading)
+    {
+      recordLightingSubpass(commandBuffer);
+    }
+    vkCmdEndRenderPass(commandBuffer);
+  }
 
-void Volcano::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
-{
-  VkCommandBufferBeginInfo beginInfo{};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = 0;
-  beginInfo.pInheritanceInfo = nullptr;
+  if (m_Config.postProcessing)
+  {
+    recordPostChain(commandBuffer, imageIndex);
+  }
 
-  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+  if (m_CaptureEnabled)
   {
-    throw std::runtime_error("Failed to begin recording command buffer!");
+    recordCapture(commandBuffer, imageIndex);
   }
 
-  VkRenderPassBeginInfo renderPassInfo{};
-  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassInfo.renderPass = m_RenderPass;
-  renderPassInfo.framebuffer = m_SwapChainFrameBuffer[imageIndex];
-  renderPassInfo.renderArea.offset = {0, 0};
-  renderPassInfo.renderArea.extent = m_SwapChainExtent;
+  m_GpuTimeline.endRange(commandBuffer);
 
-  VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-  renderPassInfo.clearValueCount = 1;
-  renderPassInfo.pClearValues = &clearColor;
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+  {
+    throw std::runtime_error("Failed to record to command buffer!");
+  }
 
-  //Returns null either way so no error handling 
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
 
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = static_cast<uint32_t>(m_SwapChainExtent.width);
-  viewport.height = static_cast<uint32_t>(m_SwapChainExtent.height);
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = m_SwapChainExtent;
-  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+void Volcano::beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  //Nothing needs the old contents, so both transitions come from UNDEFINED and only order against the
+  //previous frame's writes to the same attachments (and its post chain reads of the scene color)
+  VkImageMemoryBarrier2 barriers[2]{};
+  barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+  if (m_Config.postProcessing)
+    barriers[0].srcStageMask |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+  barriers[0].srcAccessMask = VK_ACCESS_2_NONE;
+  barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].image = m_Config.postProcessing ? m_SceneColor : m_SwapChainImages[imageIndex];
+  barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+  VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (m_DepthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || m_DepthFormat == VK_FORMAT_D24_UNORM_S8_UINT)
+    depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+  barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+  barriers[1].srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[1].image = m_DepthImage;
+  barriers[1].subresourceRange = {depthAspect, 0, 1, 0, 1};
+
+  VkDependencyInfo dependencyInfo{};
+  dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependencyInfo.imageMemoryBarrierCount = 2;
+  dependencyInfo.pImageMemoryBarriers = barriers;
+  vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+  VkRenderingAttachmentInfo colorAttachment{};
+  colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  colorAttachment.imageView = m_Config.postProcessing ? m_SceneColorView : m_SwapChainImageViews[imageIndex];
+  colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+  VkRenderingAttachmentInfo depthAttachment{};
+  depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  depthAttachment.imageView = m_DepthImageView;
+  depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  //Occlusion culling builds its Hi-Z from this depth before the late pass loads it again
+  depthAttachment.storeOp = m_OcclusionCullingEnabled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+  VkRenderingInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  renderingInfo.renderArea.offset = {0, 0};
+  renderingInfo.renderArea.extent = m_RenderExtent;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachments = &colorAttachment;
+  renderingInfo.pDepthAttachment = &depthAttachment;
+
+  vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
 
-  vkCmdEndRenderPass(commandBuffer);
+void Volcano::endDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  vkCmdEndRendering(commandBuffer);
 
-  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+  if (!m_Config.postProcessing)
   {
-    throw std::runtime_error("Failed to record to command buffer!");
+    recordPresentTransition(commandBuffer, imageIndex);
+    return;
   }
 
+  //The swapchain image is written later by the tonemap pass, the scene color goes to the post chain
+  VkImageMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+  barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = m_SceneColor;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+  VkDependencyInfo dependencyInfo{};
+  dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependencyInfo.imageMemoryBarrierCount = 1;
+  dependencyInfo.pImageMemoryBarriers = &barrier;
+  vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
 
-
+void Volcano::recordPresentTransition(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+  //The present engine synchronizes through the render finished semaphore, no destination stage needed
+  VkImageMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+  barrier.dstAccessMask = VK_ACCESS_2_NONE;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = m_SwapChainImages[imageIndex];
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+  VkDependencyInfo dependencyInfo{};
+  dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependencyInfo.imageMemoryBarrierCount = 1;
+  dependencyInfo.pImageMemoryBarriers = &barrier;
+  vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
 }
 
-void Volcano::createCommandBuffer()
+void Volcano::createCommandBuffers()
 {
+  PROFILE_FUNCTION();
+  m_CommandBuffers.resize(m_Config.framesInFlight);
+
   VkCommandBufferAllocateInfo allocateInfo{};
   allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   allocateInfo.commandPool = m_CommandPool;
   allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocateInfo.commandBufferCount = 1;
+  allocateInfo.commandBufferCount = static_cast<uint32_t>(m_CommandBuffers.size());
 
-  if (vkAllocateCommandBuffers(m_Device, &allocateInfo, &m_CommandBuffer) != VK_SUCCESS)
+  if (vkAllocateCommandBuffers(m_Device, &allocateInfo, m_CommandBuffers.data()) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to allocate command buffers!");
   }
@@ -211,26 +1470,32 @@ void Volcano::createCommandBuffer()
 
 void Volcano::createFrameBuffers()
 {
+  PROFILE_FUNCTION();
   m_SwapChainFrameBuffer.resize(m_SwapChainImageViews.size());
 
   for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
   {
-    VkImageView attachments[] = 
+    std::vector<VkImageView> attachments = 
     {
-      m_SwapChainImageViews[i]
+      m_Config.postProcessing ? m_SceneColorView : m_SwapChainImageViews[i],
+      m_DepthImageView
     };
+    if (m_Config.deferredShading)
+    {
+      attachments.insert(attachments.end(), m_GBufferImageViews, m_GBufferImageViews + GBUFFER_ATTACHMENT_COUNT);
+    }
 
  VkFramebufferCreateInfo frameBufferInfo{};
     frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
     frameBufferInfo.renderPass = m_RenderPass; 
-    frameBufferInfo.attachmentCount = 1;
-    frameBufferInfo.pAttachments = attachments;
+    frameBufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    frameBufferInfo.pAttachments = attachments.data();
     frameBufferInfo.width = m_SwapChainExtent.width;
     frameBufferInfo.height = m_SwapChainExtent.height;
     frameBufferInfo.layers = 1;
 
 
-   if (vkCreateFramebuffer(m_Device, &frameBufferInfo, nullptr, &m_SwapChainFrameBuffer[i]) != VK_SUCCESS)
+   if (vkCreateFramebuffer(m_Device, &frameBufferInfo, m_Allocator, &m_SwapChainFrameBuffer[i]) != VK_SUCCESS)
    {
      throw std::runtime_error("Failed to create Framebuffer!");
 
@@ -241,6 +1506,7 @@ void Volcano::createFrameBuffers()
 
 void Volcano::createCommandPool()
 {
+  PROFILE_FUNCTION();
   QueueFamilyIndices queueFamilyIndeces = findQueueFamilies(m_PhysicalDevice);
 
   VkCommandPoolCreateInfo poolInfo{};
@@ -248,7 +1514,7 @@ void Volcano::createCommandPool()
   poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   poolInfo.queueFamilyIndex = queueFamilyIndeces.graphicsFamily.value();
 
-  if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS)
+  if (vkCreateCommandPool(m_Device, &poolInfo, m_Allocator, &m_CommandPool) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to create command pool!");
   }
@@ -257,47 +1523,75 @@ void Volcano::createCommandPool()
 
 void Volcano::createRenderPass()
 {
+  PROFILE_FUNCTION();
 
   VkAttachmentDescription colorAttachment{};
-  colorAttachment.format = m_SwapChainImageFormat;
+  colorAttachment.format = mainColorFormat();
   colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
   colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  //With post processing the pass renders the HDR scene color, the bloom and tonemap passes sample it afterwards
+  colorAttachment.finalLayout = m_Config.postProcessing ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
 
+  VkAttachmentDescription depthAttachment{};
+  depthAttachment.format = m_DepthFormat;
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference colorAttachmentRef{};
   colorAttachmentRef.attachment = 0;
   colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+  VkAttachmentReference depthAttachmentRef{};
+  depthAttachmentRef.attachment = 1;
+  depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
   VkSubpassDescription subpass{};
   subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
   subpass.colorAttachmentCount = 1;
   subpass.pColorAttachments = &colorAttachmentRef;
-
-  VkSubpassDependency dependancy{};
-  dependancy.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependancy.dstSubpass = 0;
-  dependancy.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependancy.srcAccessMask = 0;
-  dependancy.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependancy.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  //Fragment and compute in the source stages cover last frame's post chain still sampling the scene color
+  VkSubpassDependency dependancies[2]{};
+  dependancies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependancies[0].dstSubpass = 0;
+  dependancies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  dependancies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependancies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependancies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  dependancies[1].srcSubpass = 0;
+  dependancies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependancies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependancies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependancies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependancies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment};
 
   VkRenderPassCreateInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  renderPassInfo.attachmentCount = 1;
-  renderPassInfo.pAttachments = &colorAttachment;
+  renderPassInfo.attachmentCount = 2;
+  renderPassInfo.pAttachments = attachments;
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependancy;
+  renderPassInfo.dependencyCount = m_Config.postProcessing ? 2 : 1;
+  renderPassInfo.pDependencies = dependancies;
 
 
 
-  if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS)
+  if (vkCreateRenderPass(m_Device, &renderPassInfo, m_Allocator, &m_RenderPass) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to create render pass!");
   }
@@ -308,8 +1602,10 @@ void Volcano::createRenderPass()
 
 void Volcano::createGraphicalPipeline()
 {
-  auto vertShaderCode = readFile("../src/shaders/vert.spv");
-  auto fragShaderCode = readFile("../src/shaders/frag.spv");
+  PROFILE_FUNCTION();
+  auto vertShaderCode = m_ShaderLibrary.get(VOLCANO_SHADER_DIR "shader.vert.spv");
+  auto fragShaderCode = m_ShaderLibrary.get(m_Config.deferredShading ? VOLCANO_SHADER_DIR "gbuffer.frag.spv"
+                                                                     : VOLCANO_SHADER_DIR "shader.frag.spv");
 
   VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
   VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -328,12 +1624,33 @@ void Volcano::createGraphicalPipeline()
 
   VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
+  VkVertexInputBindingDescription bindingDescription{};
+  bindingDescription.binding = 0;
+  bindingDescription.stride = sizeof(Vertex);
+  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  VkVertexInputAttributeDescription attributeDescriptions[3]{};
+  attributeDescriptions[0].binding = 0;
+  attributeDescriptions[0].location = 0;
+  attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+  attributeDescriptions[0].offset = offsetof(Vertex, position);
+
+  attributeDescriptions[1].binding = 0;
+  attributeDescriptions[1].location = 1;
+  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+  attributeDescriptions[1].offset = offsetof(Vertex, normal);
+
+  attributeDescriptions[2].binding = 0;
+  attributeDescriptions[2].location = 2;
+  attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+  attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
   vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 0;
-  vertexInputInfo.pVertexBindingDescriptions = nullptr;
-  vertexInputInfo.vertexBindingDescriptionCount = 0;
-  vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+  vertexInputInfo.vertexAttributeDescriptionCount = 3;
+  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
   inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -368,7 +1685,7 @@ void Volcano::createGraphicalPipeline()
   rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
   rasterizerInfo.lineWidth = 1.0f;
   rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-  rasterizerInfo.frontFace =VK_FRONT_FACE_CLOCKWISE;
+  rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
   rasterizerInfo.depthBiasEnable = VK_FALSE;
   rasterizerInfo.depthBiasConstantFactor = 0.0f;
   rasterizerInfo.depthBiasClamp = 0.0f;
@@ -383,6 +1700,14 @@ void Volcano::createGraphicalPipeline()
   multiSampleInfo.alphaToCoverageEnable = VK_FALSE;
   multiSampleInfo.alphaToOneEnable = VK_FALSE;
 
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = VK_TRUE;
+  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+  depthStencil.depthBoundsTestEnable = VK_FALSE;
+  depthStencil.stencilTestEnable = VK_FALSE;
+
   VkPipelineColorBlendAttachmentState colorBlendAttachmentInfo{};
   colorBlendAttachmentInfo.colorWriteMask = 
     VK_COLOR_COMPONENT_R_BIT | 
@@ -391,13 +1716,16 @@ void Volcano::createGraphicalPipeline()
     VK_COLOR_COMPONENT_A_BIT ;
   colorBlendAttachmentInfo.blendEnable = VK_FALSE;
 
+  //Deferred writes every G-buffer attachment with the same state
+  std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(
+    m_Config.deferredShading ? GBUFFER_ATTACHMENT_COUNT : 1, colorBlendAttachmentInfo);
   
   VkPipelineColorBlendStateCreateInfo colorBlending{};
   colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
   colorBlending.logicOpEnable = VK_FALSE;
   colorBlending.logicOp = VK_LOGIC_OP_COPY;
-  colorBlending.attachmentCount = 1;
-  colorBlending.pAttachments = &colorBlendAttachmentInfo;
+  colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+  colorBlending.pAttachments = colorBlendAttachments.data();
   colorBlending.blendConstants[0] = 0.0f;
   colorBlending.blendConstants[1] = 0.0f;
   colorBlending.blendConstants[2] = 0.0f;
@@ -419,12 +1747,22 @@ void Volcano::createGraphicalPipeline()
 
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0;
-  pipelineLayoutInfo.pSetLayouts = nullptr;
-  pipelineLayoutInfo.pushConstantRangeCount = 0;
-  pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-  if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS)
+  //Lights + cluster lists and the shadow atlas for shader.frag, unused by gbuffer.frag but harmless to keep in the layout.
+  //Occlusion culling adds the object buffer indirect.vert reads.
+  VkDescriptorSetLayout setLayouts[] = {m_ClusterSetLayout, m_ShadowSetLayout, m_OcclusionSetLayout};
+  pipelineLayoutInfo.setLayoutCount = m_OcclusionCullingEnabled ? 3 : 2;
+  pipelineLayoutInfo.pSetLayouts = setLayouts;
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = 2 * sizeof(Mat4);
+
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  //A shader reload only rebuilds the pipelines, the descriptor sets stay bound against this layout
+  if (m_PipelineLayout == VK_NULL_HANDLE &&
+      vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_Allocator, &m_PipelineLayout) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to create Pipeline Layout");
   }
@@ -439,23 +1777,124 @@ void Volcano::createGraphicalPipeline()
   pipelineInfo.pViewportState = &viewportInfo;
   pipelineInfo.pRasterizationState = &rasterizerInfo;
   pipelineInfo.pMultisampleState = &multiSampleInfo;
-  pipelineInfo.pDepthStencilState = nullptr;
+  pipelineInfo.pDepthStencilState = &depthStencil;
   pipelineInfo.pColorBlendState = &colorBlending;
   pipelineInfo.pDynamicState = &dynamicStateInfo;
 
   pipelineInfo.layout = m_PipelineLayout;
-  pipelineInfo.renderPass = m_RenderPass;
+
+  //Dynamic rendering pipelines only need the attachment formats, not a render pass
+  VkFormat colorFormat = mainColorFormat();
+  VkPipelineRenderingCreateInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachmentFormats = &colorFormat;
+  renderingInfo.depthAttachmentFormat = m_DepthFormat;
+
+  if (m_DynamicRenderingEnabled)
+  {
+    pipelineInfo.pNext = &renderingInfo;
+    pipelineInfo.renderPass = VK_NULL_HANDLE;
+  }
+  else
+  {
+    pipelineInfo.renderPass = m_RenderPass;
+  }
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.basePipelineIndex = -1;
   
-  if (vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_GraphicsPipeline) != VK_SUCCESS)
+  if (vkCreateGraphicsPipelines(m_Device, m_PipelineCache, 1, &pipelineInfo, m_Allocator, &m_GraphicsPipeline) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to create graphics pipeline!");
   }
+  m_GraphicsPipelineResource = m_Resources.addPipeline(m_GraphicsPipeline, "mesh");
+
+  //Same state, the vertex shader fetches its matrices by instance index instead of push constants
+  if (m_OcclusionCullingEnabled)
+  {
+    VkShaderModule indirectShaderModule = loadShader(VOLCANO_SHADER_DIR "indirect.vert.spv");
+    shaderStages[0].module = indirectShaderModule;
+    if (vkCreateGraphicsPipelines(m_Device, m_PipelineCache, 1, &pipelineInfo, m_Allocator, &m_IndirectPipeline) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create indirect graphics pipeline!");
+    }
+    m_IndirectPipelineResource = m_Resources.addPipeline(m_IndirectPipeline, "mesh indirect");
+    vkDestroyShaderModule(m_Device, indirectShaderModule, m_Allocator);
+  }
+
+  vkDestroyShaderModule(m_Device, fragShaderModule, m_Allocator);
+  vkDestroyShaderModule(m_Device, vertShaderModule, m_Allocator);
+
+  m_Pipelines = {m_GraphicsPipeline};
+}
+
+//The .spv files createGraphicalPipeline reads
+std::vector<std::string> Volcano::meshShaderPaths() const
+{
+  std::vector<std::string> paths = {VOLCANO_SHADER_DIR "shader.vert.spv",
+                                    m_Config.deferredShading ? VOLCANO_SHADER_DIR "gbuffer.frag.spv"
+                                                             : VOLCANO_SHADER_DIR "shader.frag.spv"};
+  if (m_OcclusionCullingEnabled)
+  {
+    paths.push_back(VOLCANO_SHADER_DIR "indirect.vert.spv");
+  }
+  return paths;
+}
+
+void Volcano::reloadChangedShaders()
+{
+  //Files missing halfway through a shader build count as unchanged, the next check picks them up
+  std::filesystem::file_time_type newest = m_ShaderWriteTime;
+  for (const std::string& path : meshShaderPaths())
+  {
+    std::error_code error;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+    if (!error)
+    {
+      newest = std::max(newest, writeTime);
+    }
+  }
+
+  if (newest == m_ShaderWriteTime)
+  {
+    return;
+  }
+  bool firstCheck = m_ShaderWriteTime == std::filesystem::file_time_type::min();
+  m_ShaderWriteTime = newest;
+  if (firstCheck)
+  {
+    return;
+  }
+
+  //Frames in flight still draw with the old pipelines, they are released and not destroyed. A broken shader keeps them.
+  ResourceHandle oldGraphics = m_GraphicsPipelineResource;
+  ResourceHandle oldIndirect = m_IndirectPipelineResource;
+  VkPipeline oldGraphicsPipeline = m_GraphicsPipeline;
+  VkPipeline oldIndirectPipeline = m_IndirectPipeline;
+  m_GraphicsPipelineResource = {};
+  m_IndirectPipelineResource = {};
+
+  try
+  {
+    createGraphicalPipeline();
+  }
+  catch (const std::exception& exception)
+  {
+    std::cout << "Shader reload failed, keeping the old pipelines: " << exception.what() << std::endl;
+    m_Resources.release(m_GraphicsPipelineResource);
+    m_Resources.release(m_IndirectPipelineResource);
+    m_GraphicsPipelineResource = oldGraphics;
+    m_IndirectPipelineResource = oldIndirect;
+    m_GraphicsPipeline = oldGraphicsPipeline;
+    m_IndirectPipeline = oldIndirectPipeline;
+    m_Pipelines = {m_GraphicsPipeline};
+    return;
+  }
 
-  vkDestroyShaderModule(m_Device, fragShaderModule, nullptr);
-  vkDestroyShaderModule(m_Device, vertShaderModule, nullptr);
+  m_Resources.release(oldGraphics);
+  m_Resources.release(oldIndirect);
+  std::cout << "Reloaded mesh shaders" << std::endl;
 }
 
 VkShaderModule Volcano::createShaderModule(const std::vector<char>& code)
@@ -467,7 +1906,7 @@ VkShaderModule Volcano::createShaderModule(const std::vector<char>& code)
 
   VkShaderModule shaderModule;
 
-  if (vkCreateShaderModule(m_Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+  if (vkCreateShaderModule(m_Device, &createInfo, m_Allocator, &shaderModule) != VK_SUCCESS)
   {
     throw std::runtime_error("Failed to create shader module");
   }
@@ -478,6 +1917,7 @@ VkShaderModule Volcano::createShaderModule(const std::vector<char>& code)
 
 void Volcano::createImageViews()
 {
+  PROFILE_FUNCTION();
   m_SwapChainImageViews.resize(m_SwapChainImages.size());
 
   for (size_t i = 0; i < m_SwapChainImages.size(); i++)
@@ -499,7 +1939,7 @@ void Volcano::createImageViews()
     createInfo.subresourceRange.baseArrayLayer = 0;
     createInfo.subresourceRange.layerCount = 1;
 
-    if (vkCreateImageView(m_Device, &createInfo, nullptr, &m_SwapChainImageViews[i]) != VK_SUCCESS)
+    if (vkCreateImageView(m_Device, &createInfo, m_Allocator, &m_SwapChainImageViews[i]) != VK_SUCCESS)
     {
       throw std::runtime_error("Failed to create Image Views!");
     }
@@ -512,6 +1952,7 @@ void Volcano::createImageViews()
 
 void Volcano::createInstance()
 {
+  PROFILE_FUNCTION();
   if (validationLayersOn && !checkValidationLayerSupport())
   {
     throw std::runtime_error("Validation layers requested but not available");
@@ -523,7 +1964,7 @@ void Volcano::createInstance()
   vkAppInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   vkAppInfo.pEngineName = "NoneRN";
   vkAppInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  vkAppInfo.apiVersion = VK_API_VERSION_1_0;
+  vkAppInfo.apiVersion = VK_API_VERSION_1_3;
 
   VkInstanceCreateInfo vkCreateInfo{};
   vkCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -550,7 +1991,7 @@ void Volcano::createInstance()
   }
 
 
-  if (vkCreateInstance(&vkCreateInfo, nullptr, &m_VulkanInstance) != VK_SUCCESS)
+  if (vkCreateInstance(&vkCreateInfo, m_Allocator, &m_VulkanInstance) != VK_SUCCESS)
   {
     throw std::runtime_error("Cannot create Vulkan Instance");
   }
@@ -558,7 +1999,21 @@ void Volcano::createInstance()
 
 void Volcano::createSurface()
 {
-  if (glfwCreateWindowSurface(m_VulkanInstance, m_Window, nullptr, &m_Surface) != VK_SUCCESS)
+  PROFILE_FUNCTION();
+  if (m_Config.headless)
+  {
+    //Extension entry point, not exported by every loader
+    auto createHeadlessSurface = (PFN_vkCreateHeadlessSurfaceEXT) vkGetInstanceProcAddr(m_VulkanInstance, "vkCreateHeadlessSurfaceEXT");
+    VkHeadlessSurfaceCreateInfoEXT createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+    if (!createHeadlessSurface || createHeadlessSurface(m_VulkanInstance, &createInfo, m_Allocator, &m_Surface) != VK_SUCCESS)
+    {
+      throw std::runtime_error("Failed to create headless surface!");
+    }
+    return;
+  }
+
+  if (glfwCreateWindowSurface(m_VulkanInstance, m_Window, m_Allocator, &m_Surface) != VK_SUCCESS)
   {
       throw std::runtime_error("Failed to create window surface");
   }
@@ -568,6 +2023,7 @@ void Volcano::createSurface()
 
 void Volcano::selectPhysicalDevice()
 {
+  PROFILE_FUNCTION();
   uint32_t supportedDevicesCount = 0;
 
   vkEnumeratePhysicalDevices(m_VulkanInstance, &supportedDevicesCount, nullptr);
@@ -578,20 +2034,196 @@ void Volcano::selectPhysicalDevice()
   std::vector<VkPhysicalDevice> devices(supportedDevicesCount);
   vkEnumeratePhysicalDevices(m_VulkanInstance, &supportedDevicesCount, devices.data());
 
+  //Enumeration order is up to the loader, lavapipe can easily come before the real GPU
+  int64_t bestScore = -1;
   for (const auto& device : devices)
   {
-    if (isDeviceSuitable(device))
+    if (!isDeviceSuitable(device))
+      continue;
+
+    if (!m_Config.deviceOverride.empty())
+    {
+      if (matchesDeviceOverride(device))
+      {
+        m_PhysicalDevice = device;
+        break;
+      }
+      continue;
+    }
+
+    int64_t score = rateDevice(device);
+    if (score > bestScore)
     {
+      bestScore = score;
       m_PhysicalDevice = device;
-      break;
     }
   }
 
   if (m_PhysicalDevice == VK_NULL_HANDLE)
   {
+    if (!m_Config.deviceOverride.empty())
+      throw std::runtime_error("No suitable GPU matches --device " + m_Config.deviceOverride);
     throw std::runtime_error("Failed to find suitable GPU!");
   }
 
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+  std::cout << "Using " << properties.deviceName << std::endl;
+}
+
+int64_t Volcano::rateDevice(VkPhysicalDevice pDevice)
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(pDevice, &properties);
+
+  //Device type dominates, everything else only breaks ties within a type
+  int64_t score = 0;
+  switch (properties.deviceType)
+  {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 1000000; break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 500000; break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 200000; break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 10000; break;
+    default: break;
+  }
+
+  //One point per 16MiB of VRAM, capped at 64GiB so a huge heap can't outweigh queue topology
+  VkDeviceSize heapMiB = getDeviceLocalHeapSize(pDevice) / (1024 * 1024);
+  score += static_cast<int64_t>(std::min<VkDeviceSize>(heapMiB, 64 * 1024) / 16);
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(pDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(pDevice, &queueFamilyCount, queueFamilies.data());
+
+  bool dedicatedTransfer = false;
+  bool asyncCompute = false;
+  for (const auto& queueFamily : queueFamilies)
+  {
+    VkQueueFlags flags = queueFamily.queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+      dedicatedTransfer = true;
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+      asyncCompute = true;
+  }
+
+  if (dedicatedTransfer)
+    score += 5000;
+  if (asyncCompute)
+    score += 5000;
+
+  return score;
+}
+
+bool Volcano::matchesDeviceOverride(VkPhysicalDevice pDevice)
+{
+  VkPhysicalDeviceIDProperties idProperties{};
+  idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+  VkPhysicalDeviceProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &idProperties;
+  vkGetPhysicalDeviceProperties2(pDevice, &properties);
+
+  auto lower = [](std::string text)
+  {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+  };
+
+  std::string wanted = lower(m_Config.deviceOverride);
+  std::string uuid = formatDeviceUUID(idProperties.deviceUUID);
+  std::string compactUuid = uuid;
+  compactUuid.erase(std::remove(compactUuid.begin(), compactUuid.end(), '-'), compactUuid.end());
+
+  return wanted == uuid || wanted == compactUuid ||
+         lower(properties.properties.deviceName).find(wanted) != std::string::npos;
+}
+
+bool Volcano::meetsRequiredLimits(VkPhysicalDevice pDevice)
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(pDevice, &properties);
+
+  if (properties.limits.maxPushConstantsSize < 2 * sizeof(Mat4))
+    return false;
+  if (properties.limits.maxImageDimension2D < static_cast<uint32_t>(std::max(WINDOW_LENGTH, WINDOW_HEIGHT)))
+    return false;
+
+  try {
+    findDepthFormat(pDevice);
+  } catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+void Volcano::listDevices()
+{
+  uint32_t deviceCount = 0;
+  vkEnumeratePhysicalDevices(m_VulkanInstance, &deviceCount, nullptr);
+  std::vector<VkPhysicalDevice> devices(deviceCount);
+  vkEnumeratePhysicalDevices(m_VulkanInstance, &deviceCount, devices.data());
+
+  static const char* typeNames[] = {"other", "integrated", "discrete", "virtual", "cpu"};
+
+  for (uint32_t d = 0; d < deviceCount; d++)
+  {
+    VkPhysicalDevice device = devices[d];
+
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+    const VkPhysicalDeviceProperties& properties = properties2.properties;
+
+    bool suitable = isDeviceSuitable(device);
+
+    std::cout << "[" << d << "] " << properties.deviceName << std::endl;
+    std::cout << "    type " << (properties.deviceType <= VK_PHYSICAL_DEVICE_TYPE_CPU ? typeNames[properties.deviceType] : "unknown")
+              << ", api " << VK_VERSION_MAJOR(properties.apiVersion) << "." << VK_VERSION_MINOR(properties.apiVersion)
+              << "." << VK_VERSION_PATCH(properties.apiVersion)
+              << ", uuid " << formatDeviceUUID(idProperties.deviceUUID) << std::endl;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+    for (uint32_t h = 0; h < memoryProperties.memoryHeapCount; h++)
+    {
+      std::cout << "    heap " << h << ": " << memoryProperties.memoryHeaps[h].size / (1024 * 1024) << " MiB"
+                << ((memoryProperties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " device local" : "") << std::endl;
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+    uint32_t probeFamily = 0;
+    for (uint32_t q = 0; q < queueFamilyCount; q++)
+    {
+      VkQueueFlags flags = queueFamilies[q].queueFlags;
+      std::cout << "    queue family " << q << ": " << queueFamilies[q].queueCount << "x"
+                << ((flags & VK_QUEUE_GRAPHICS_BIT) ? " graphics" : "")
+                << ((flags & VK_QUEUE_COMPUTE_BIT) ? " compute" : "")
+                << ((flags & VK_QUEUE_TRANSFER_BIT) ? " transfer" : "") << std::endl;
+
+      if (flags & VK_QUEUE_GRAPHICS_BIT)
+        probeFamily = q;
+    }
+
+    std::cout << "    limits: maxImageDimension2D " << properties.limits.maxImageDimension2D
+              << ", maxPushConstantsSize " << properties.limits.maxPushConstantsSize
+              << ", timestampPeriod " << properties.limits.timestampPeriod << " ns" << std::endl;
+
+    if (suitable)
+      std::cout << "    suitable, score " << rateDevice(device) << std::endl;
+    else
+      std::cout << "    not suitable" << std::endl;
+
+    std::cout << "    copy throughput " << probeCopyThroughput(device, probeFamily) << " GB/s" << std::endl;
+  }
 }
 
 bool Volcano::isDeviceSuitable(VkPhysicalDevice pDevice)
@@ -607,7 +2239,7 @@ bool Volcano::isDeviceSuitable(VkPhysicalDevice pDevice)
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
 
-  return indices.isComplete() && extensionsSupported && swapChainAdequate;
+  return indices.isComplete() && extensionsSupported && swapChainAdequate && meetsRequiredLimits(pDevice);
 }
 
 
@@ -625,15 +2257,29 @@ VkSurfaceFormatKHR Volcano::chooseSwapSurfaceFormat(const std::vector<VkSurfaceF
 }
 
 
+static const char* presentModeName(VkPresentModeKHR presentMode)
+{
+  switch (presentMode)
+  {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+    default: return "other";
+  }
+}
+
 void Volcano::createSwapChain()
 {
+  PROFILE_FUNCTION();
       SwapChainSupportDetails swapChainSupport = querySwapChainSupport(m_PhysicalDevice);
 
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        uint32_t imageCount = m_Config.swapChainImages > 0 ? m_Config.swapChainImages : swapChainSupport.capabilities.minImageCount + 1;
+        imageCount = std::max(imageCount, swapChainSupport.capabilities.minImageCount);
         if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
             imageCount = swapChainSupport.capabilities.maxImageCount;
         }
@@ -649,6 +2295,25 @@ void Volcano::createSwapChain()
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+        //Capture copies straight out of the swapchain image
+        if (!m_Config.capturePath.empty())
+        {
+          m_CaptureEnabled = swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+          if (m_CaptureEnabled)
+          {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+          }
+          else if (m_Config.headless)
+          {
+            //Capture is the only thing that ends a headless run
+            throw std::runtime_error("Headless swapchain images can't be copied from, nothing to capture!");
+          }
+          else
+          {
+            std::cout << "Swapchain images can't be copied from on this surface, capture disabled" << std::endl;
+          }
+        }
+
         QueueFamilyIndices indices = findQueueFamilies(m_PhysicalDevice);
         uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
@@ -670,7 +2335,7 @@ void Volcano::createSwapChain()
 
         createInfo.oldSwapchain = VK_NULL_HANDLE;
 
-        if (vkCreateSwapchainKHR(m_Device, &createInfo, nullptr, &m_SwapChain) != VK_SUCCESS) {
+        if (vkCreateSwapchainKHR(m_Device, &createInfo, m_Allocator, &m_SwapChain) != VK_SUCCESS) {
             throw std::runtime_error("failed to create swap chain!");
         }
 
@@ -681,10 +2346,37 @@ void Volcano::createSwapChain()
         m_SwapChainImageFormat = surfaceFormat.format;
         m_SwapChainExtent = extent;
 
+        std::cout << "Swapchain: " << imageCount << " images, present mode " << presentModeName(presentMode)
+                  << ", " << m_Config.framesInFlight << " frames in flight" << std::endl;
+
 }
 
 VkPresentModeKHR Volcano::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
 {
+  if (!m_Config.presentMode.empty())
+  {
+    VkPresentModeKHR requested;
+    if (m_Config.presentMode == "immediate")
+      requested = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    else if (m_Config.presentMode == "mailbox")
+      requested = VK_PRESENT_MODE_MAILBOX_KHR;
+    else if (m_Config.presentMode == "fifo")
+      requested = VK_PRESENT_MODE_FIFO_KHR;
+    else if (m_Config.presentMode == "fifo-relaxed")
+      requested = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    else
+      throw std::runtime_error("Unknown present mode " + m_Config.presentMode);
+
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(), requested) != availablePresentModes.end())
+    {
+      return requested;
+    }
+
+    //FIFO is the only mode the spec guarantees
+    std::cerr << "Present mode " << m_Config.presentMode << " not supported, falling back to FIFO" << std::endl;
+    return VK_PRESENT_MODE_FIFO_KHR;
+  }
+
   for (const auto& availablePresentMode : availablePresentModes)
   {
     if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
@@ -704,8 +2396,12 @@ VkExtent2D Volcano::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilitie
   }
   else 
   {
-    int width, height;
-    glfwGetFramebufferSize(m_Window, &width, &height);
+    //A headless surface takes whatever size it's given, the window's so captures match
+    int width = WINDOW_LENGTH, height = WINDOW_HEIGHT;
+    if (m_Window)
+    {
+      glfwGetFramebufferSize(m_Window, &width, &height);
+    }
 
     VkExtent2D actualExtent = 
     {
@@ -780,6 +2476,23 @@ bool Volcano::checkDeviceExtensionsSupport(VkPhysicalDevice pDevice)
 }
 
 
+bool Volcano::isDeviceExtensionSupported(VkPhysicalDevice pDevice, const char* extensionName)
+{
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(pDevice, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(pDevice, nullptr, &extensionCount, availableExtensions.data());
+
+  for (const auto& extension : availableExtensions)
+  {
+    if (strcmp(extension.extensionName, extensionName) == 0)
+      return true;
+  }
+  return false;
+}
+
+
 bool Volcano::checkValidationLayerSupport()
 {
   uint32_t  layerCount;
@@ -820,11 +2533,18 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 
 std::vector<const char*> Volcano::getRequiredExtensions()
 {
-  uint32_t glfwExtensionsCount = 0;
-  const char** glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
-
-  std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+  std::vector<const char*> extensions;
+  if (m_Config.headless)
+  {
+    extensions = {VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME};
+  }
+  else
+  {
+    uint32_t glfwExtensionsCount = 0;
+    const char** glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+  }
 
   if (validationLayersOn)
   {
@@ -836,33 +2556,140 @@ std::vector<const char*> Volcano::getRequiredExtensions()
 
  void Volcano::createLogicalDevice() 
 {
+  PROFILE_FUNCTION();
   QueueFamilyIndices indices = findQueueFamilies(m_PhysicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
-  float queuePriority = 1.0f;
+  //Light binning is the only compute work that can run async, the deferred renderer has none
+  if (m_Config.asyncCompute && !m_Config.deferredShading)
+  {
+    m_AsyncComputeEnabled = findAsyncComputeQueue(indices.graphicsFamily.value(), m_ComputeFamily, m_ComputeQueueIndex);
+    if (m_AsyncComputeEnabled)
+    {
+      uniqueQueueFamilies.insert(m_ComputeFamily);
+      if (m_ComputeFamily != indices.graphicsFamily.value())
+      {
+        m_ClusterQueueFamilies = {indices.graphicsFamily.value(), m_ComputeFamily};
+      }
+    }
+    else
+    {
+      std::cout << "No async compute queue, light binning stays on the graphics queue" << std::endl;
+    }
+  }
+
+  float queuePriorities[2] = {1.0f, 1.0f};
   for (uint32_t queueFamily : uniqueQueueFamilies) {
       VkDeviceQueueCreateInfo queueCreateInfo{};
       queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
       queueCreateInfo.queueFamilyIndex = queueFamily;
-      queueCreateInfo.queueCount = 1;
-      queueCreateInfo.pQueuePriorities = &queuePriority;
+      queueCreateInfo.queueCount = m_AsyncComputeEnabled && queueFamily == m_ComputeFamily ? m_ComputeQueueIndex + 1 : 1;
+      queueCreateInfo.pQueuePriorities = queuePriorities;
       queueCreateInfos.push_back(queueCreateInfo);
   }
 
-  VkPhysicalDeviceFeatures deviceFeatures{};
+  m_EnabledDeviceExtensions = m_DeviceExtensions;
+
+  //Optional extensions, each one is only chained in when the device reports it
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+  presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+  presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+  VkPhysicalDeviceFeatures2 deviceFeatures{};
+  deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+
+  if (isDeviceExtensionSupported(m_PhysicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+      isDeviceExtensionSupported(m_PhysicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+  {
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    deviceFeatures.pNext = &presentIdFeatures;
+    vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &deviceFeatures);
+
+    m_PresentWaitEnabled = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+    if (m_PresentWaitEnabled)
+    {
+      m_EnabledDeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+      m_EnabledDeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+    else
+    {
+      deviceFeatures.pNext = nullptr;
+    }
+  }
+
+  //Per heap budget and usage for MemoryBudget, without it only our own allocations are known
+  if (isDeviceExtensionSupported(m_PhysicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+  {
+    m_EnabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    m_MemoryBudgetExtension = true;
+  }
+
+  //Dynamic rendering + synchronization2 fast path, core since 1.3
+  VkPhysicalDeviceVulkan13Features vulkan13Features{};
+  vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
+
+  //Subpass input attachments need a real render pass, the deferred renderer always takes the fallback path
+  if (!m_Config.legacyRenderPass && !m_Config.deferredShading && deviceProperties.apiVersion >= VK_API_VERSION_1_3)
+  {
+    VkPhysicalDeviceFeatures2 queryFeatures{};
+    queryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    queryFeatures.pNext = &vulkan13Features;
+    vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &queryFeatures);
+
+    if (vulkan13Features.dynamicRendering && vulkan13Features.synchronization2)
+    {
+      m_DynamicRenderingEnabled = true;
+      m_Synchronization2Enabled = true;
+
+      //Enable exactly these two, the query filled in everything else the device has
+      VkPhysicalDeviceVulkan13Features enabled13{};
+      enabled13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+      enabled13.dynamicRendering = VK_TRUE;
+      enabled13.synchronization2 = VK_TRUE;
+      enabled13.pNext = deviceFeatures.pNext;
+      vulkan13Features = enabled13;
+      deviceFeatures.pNext = &vulkan13Features;
+    }
+  }
+
+  std::cout << (m_DynamicRenderingEnabled ? "Dynamic rendering + synchronization2" : "Render pass fallback") << std::endl;
+
+  //The indirect draws pass the object slot as firstInstance, the late pass splits rendering around the Hi-Z build
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supportedFeatures);
+  if (m_Config.occlusionCulling)
+  {
+    m_OcclusionCullingEnabled = m_DynamicRenderingEnabled && supportedFeatures.drawIndirectFirstInstance;
+    m_MultiDrawIndirectEnabled = m_OcclusionCullingEnabled && supportedFeatures.multiDrawIndirect;
+    if (!m_OcclusionCullingEnabled)
+    {
+      std::cout << "Occlusion culling needs dynamic rendering and drawIndirectFirstInstance, drawing everything" << std::endl;
+    }
+  }
+
+  //Only what we use, vkGetPhysicalDeviceFeatures2 above filled in everything the device has
+  deviceFeatures.features = VkPhysicalDeviceFeatures{};
+  deviceFeatures.features.drawIndirectFirstInstance = m_OcclusionCullingEnabled;
+  deviceFeatures.features.multiDrawIndirect = m_MultiDrawIndirectEnabled;
 
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  createInfo.pNext = &deviceFeatures;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-  createInfo.pEnabledFeatures = &deviceFeatures;
+  createInfo.pEnabledFeatures = nullptr;
 
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(m_DeviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = m_DeviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(m_EnabledDeviceExtensions.size());
+  createInfo.ppEnabledExtensionNames = m_EnabledDeviceExtensions.data();
 
   if (validationLayersOn) 
   {
@@ -874,13 +2701,24 @@ std::vector<const char*> Volcano::getRequiredExtensions()
       createInfo.enabledLayerCount = 0;
   }
 
-  if (vkCreateDevice(m_PhysicalDevice, &createInfo, nullptr, &m_Device) != VK_SUCCESS) 
+  if (vkCreateDevice(m_PhysicalDevice, &createInfo, m_Allocator, &m_Device) != VK_SUCCESS) 
   {
       throw std::runtime_error("failed to create logical device!");
   }
 
   vkGetDeviceQueue(m_Device, indices.graphicsFamily.value(), 0, &m_GraphicsQueue);
   vkGetDeviceQueue(m_Device, indices.presentFamily.value(), 0, &m_PresentQueue);
+  if (m_AsyncComputeEnabled)
+  {
+    vkGetDeviceQueue(m_Device, m_ComputeFamily, m_ComputeQueueIndex, &m_ComputeQueue);
+    std::cout << "Async compute on queue family " << m_ComputeFamily << ", queue " << m_ComputeQueueIndex << std::endl;
+  }
+
+  if (m_PresentWaitEnabled)
+  {
+    m_vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(m_Device, "vkWaitForPresentKHR");
+    m_PresentWaitEnabled = m_vkWaitForPresentKHR != nullptr;
+  }
 }
 
 
@@ -912,12 +2750,13 @@ SwapChainSupportDetails Volcano::querySwapChainSupport(VkPhysicalDevice pDevice)
 
 void Volcano::setupDebugMessenger()
 {
+  PROFILE_FUNCTION();
   if (!validationLayersOn) return;
 
   VkDebugUtilsMessengerCreateInfoEXT vkCreateInfo;
   populateDebugMesssengerCreateInfo(vkCreateInfo);
 
-  if (CreateDebugUtilsMessengerEXT(m_VulkanInstance, &vkCreateInfo, nullptr, &m_DebugMessenger) != VK_SUCCESS)
+  if (CreateDebugUtilsMessengerEXT(m_VulkanInstance, &vkCreateInfo, m_Allocator, &m_DebugMessenger) != VK_SUCCESS)
   {
      throw std::runtime_error("Failed to set up debug messenger");
   }
@@ -968,40 +2807,91 @@ VkResult Volcano::CreateDebugUtilsMessengerEXT
 
 void Volcano::onExit()
 {
-  vkDestroySemaphore(m_Device, m_ImageAvailableSemaphore, nullptr);
-  vkDestroySemaphore(m_Device, m_RenderFinishedSemaphore, nullptr);
-  vkDestroyFence(m_Device, m_InFlightFence, nullptr);
+  if (m_CaptureEnabled)
+  {
+    destroyCapture();
+  }
+
+  for (uint32_t i = 0; i < m_Config.framesInFlight; i++)
+  {
+    vkDestroySemaphore(m_Device, m_ImageAvailableSemaphores[i], m_Allocator);
+    vkDestroySemaphore(m_Device, m_RenderFinishedSemaphores[i], m_Allocator);
+    vkDestroyFence(m_Device, m_InFlightFences[i], m_Allocator);
+  }
 
 
-  vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
+  m_GpuTimeline.destroy(m_Allocator);
+  vkDestroyCommandPool(m_Device, m_CommandPool, m_Allocator);
 
   for (auto framebuffer : m_SwapChainFrameBuffer)
   {
-    vkDestroyFramebuffer(m_Device, framebuffer, nullptr);
+    vkDestroyFramebuffer(m_Device, framebuffer, m_Allocator);
+  }
+
+  if (m_Config.deferredShading)
+  {
+    reportGBufferCommitment();
+    destroyDeferredResources();
+  }
+  destroyClusterResources();
+  destroyShadowResources();
+  if (m_AsyncComputeEnabled)
+  {
+    destroyAsyncCompute();
+  }
+  if (m_Config.postProcessing)
+  {
+    destroyPostResources();
+  }
+  if (m_OcclusionCullingEnabled)
+  {
+    destroyOcclusionResources();
+  }
+
+  if (m_WorldStreamer.isOpen())
+  {
+    destroyWorld();
   }
 
-  vkDestroyPipeline(m_Device, m_GraphicsPipeline, nullptr);
-  vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
-  vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+  //The device is idle, pending releases go too
+  reportResources();
+  m_Resources.destroy();
+
+  //Everything compiled this run, including shader reloads, is there for the next one
+  if (!m_Config.pipelineCachePath.empty())
+  {
+    size_t saved = savePipelineCache(m_Device, m_PipelineCache, m_Config.pipelineCachePath);
+    std::cout << "Pipeline cache: saved " << saved / 1024 << " KB to " << m_Config.pipelineCachePath << std::endl;
+  }
+  vkDestroyPipelineCache(m_Device, m_PipelineCache, m_Allocator);
+
+  vkDestroyPipelineLayout(m_Device, m_PipelineLayout, m_Allocator);
+  if (!m_DynamicRenderingEnabled)
+  {
+    vkDestroyRenderPass(m_Device, m_RenderPass, m_Allocator);
+  }
 
 
   for (auto imageView : m_SwapChainImageViews)
   {
-    vkDestroyImageView(m_Device, imageView, nullptr);
+    vkDestroyImageView(m_Device, imageView, m_Allocator);
   }
 
 
-  vkDestroySwapchainKHR(m_Device, m_SwapChain, nullptr);
-  vkDestroyDevice(m_Device, nullptr);
+  vkDestroySwapchainKHR(m_Device, m_SwapChain, m_Allocator);
+  vkDestroyDevice(m_Device, m_Allocator);
 
   if (validationLayersOn)
   {
-    DestroyDebugUtilsMessengerEXT(m_VulkanInstance, m_DebugMessenger, nullptr);
+    DestroyDebugUtilsMessengerEXT(m_VulkanInstance, m_DebugMessenger, m_Allocator);
   }
 
-  vkDestroySurfaceKHR(m_VulkanInstance, m_Surface, nullptr);
-  vkDestroyInstance(m_VulkanInstance, nullptr);
-  glfwDestroyWindow(m_Window);
-  glfwTerminate();
+  vkDestroySurfaceKHR(m_VulkanInstance, m_Surface, m_Allocator);
+  vkDestroyInstance(m_VulkanInstance, m_Allocator);
+  if (m_Window)
+  {
+    glfwDestroyWindow(m_Window);
+    glfwTerminate();
+  }
 }
 
@@ -2,10 +2,28 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
 #include <optional>
+#include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
+#include "config.hpp"
+#include "simulation.hpp"
+#include "mesh/mesh.hpp"
+#include "utils/framelimiter.hpp"
+#include "utils/drawqueue.hpp"
+#include "utils/frameencoder.hpp"
+#include "utils/gputimeline.hpp"
+#include "utils/math.hpp"
+#include "utils/memorybudget.hpp"
+#include "utils/resourceregistry.hpp"
+#include "utils/shaderlibrary.hpp"
+#include "utils/taskgraph.hpp"
+#include "world/worldstreamer.hpp"
 
 #define VK_USE_PLATFORM_WIN32_KHR
 #define GLFW_INCLUDE_VULKAN
@@ -17,6 +35,57 @@
 #define WINDOW_HEIGHT 600
 #define APP_NAME "Volcano" 
 
+#define CAMERA_FOV 1.0471976f // 60 degrees
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 500.0f
+#define GRID_SPACING 1.5f
+
+//Draw key ids, indices into m_Pipelines / m_MeshBindings
+#define DRAW_PASS_MAIN 0
+#define PIPELINE_MESH 0
+#define MATERIAL_DEFAULT 0
+#define MESH_SCENE 0
+
+//Albedo + normal, see renderer/deferred.cpp
+#define GBUFFER_ATTACHMENT_COUNT 2
+
+//Clustered lighting (MAX_LIGHTS is in config.hpp), see renderer/clustered.cpp. MAX_LIGHTS_PER_CLUSTER must match cluster.comp
+#define MAX_LIGHTS_PER_CLUSTER 128
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+
+//Directional light shared by the ambient/sun term and the shadow cascades, points towards the sun
+#define SUN_DIRECTION Vec3(0.4f, 1.0f, 0.3f)
+
+//Cascaded shadow maps, see renderer/shadows.cpp. 2x2 tiles in one atlas, SHADOW_CASCADE_COUNT must match shader.frag
+#define SHADOW_CASCADE_COUNT 4
+#define SHADOW_ATLAS_SIZE 2048
+
+//Bloom pyramid levels, level 0 is half the swapchain resolution, see renderer/post.cpp
+#define BLOOM_MIP_COUNT 5
+
+//Readback buffers for --capture, a few more than frames in flight so the encoder can lag without dropping frames
+#define CAPTURE_RING_SIZE (MAX_FRAMES_IN_FLIGHT + 4)
+
+//Startup task graph workers, on top of the main thread
+#define STARTUP_MAX_THREADS 6u
+
+//Hi-Z pyramid levels allocated for occlusion culling, level 0 is half the swapchain resolution
+#define HIZ_MAX_LEVELS 16
+
+//Streamed world, see renderer/world.cpp. Cell size of --generate-world, and how much decoded geometry gets staged per frame
+#define WORLD_CELL_SIZE 16.0f
+#define WORLD_UPLOAD_BUDGET_BYTES (8ull * 1024 * 1024)
+
+//--report leaves out the first frames, pipeline warmup and first uploads aren't the steady state
+#define REPORT_WARMUP_FRAMES 10
+
+
+//Compiled shaders, the build passes its own shader output directory (see CMakeLists.txt)
+#ifndef VOLCANO_SHADER_DIR
+#define VOLCANO_SHADER_DIR "shaders/"
+#endif
 
 #ifdef NDEBUG
   const bool validationLayersOn = false;
@@ -46,19 +115,192 @@ struct QueueFamilyIndices
 
 };
 
+//One instance of the mesh in the world, bounds are in world space
+struct SceneObject
+{
+  Mat4 model;
+  Vec3 center;
+  float radius;
+  float scale;
+};
+
+//Built each frame ahead of recordCommandBuffer, recorded in m_DrawQueue order
+struct DrawItem
+{
+  //Push constant block of shader.vert, modelView feeds the view space lighting
+  Mat4 mvp;
+  Mat4 modelView;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+};
+
+//World space light, animated and uploaded in view space every frame
+struct SceneLight
+{
+  Vec3 position;
+  float radius;
+  Vec3 color;
+  float phase;
+  bool spot;
+};
+
+//Light binning buffers, one set per frame in flight
+struct ClusterFrame
+{
+  VkBuffer lightBuffer;
+  VkDeviceMemory lightMemory;
+  void* lightsMapped;
+  VkBuffer paramsBuffer;
+  VkDeviceMemory paramsMemory;
+  void* paramsMapped;
+  VkBuffer gridBuffer;
+  VkDeviceMemory gridMemory;
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexMemory;
+  VkDescriptorSet descriptorSet;
+};
+
+//What a cascade's atlas tile was last rendered for, it stays valid while the camera's slice fits inside
+struct ShadowCascade
+{
+  bool valid = false;
+  Vec3 center;
+  float radius = 0.0f;
+  Vec3 lightDirection;
+  Mat4 viewProjection;
+};
+
+struct ShadowDraw
+{
+  Mat4 mvp;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t cascade;
+};
+
+struct ShadowFrame
+{
+  VkBuffer paramsBuffer;
+  VkDeviceMemory paramsMemory;
+  void* paramsMapped;
+  VkDescriptorSet descriptorSet;
+};
+
+//One readback buffer owned by m_Resources, inUse from the copy being recorded until the encoder thread is done with the mapping
+struct CaptureSlot
+{
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  void* mapped;
+  std::atomic<bool> inUse{false};
+};
+
+//Occlusion culling buffers the CPU writes or reads, one set per frame in flight
+struct OcclusionFrame
+{
+  VkBuffer objectBuffer;
+  VkDeviceMemory objectMemory;
+  void* objectsMapped;
+  VkBuffer statsBuffer;
+  VkDeviceMemory statsMemory;
+  void* statsMapped;
+  VkDescriptorSet descriptorSet;
+};
+
+//Counters occlusion_cull.comp fills in (std430), read back once the frame's fence has signaled
+struct OcclusionStats
+{
+  uint32_t earlyObjects;
+  uint32_t lateObjects;
+  uint32_t occludedObjects;
+  uint32_t frustumCulledObjects;
+  uint32_t occludedTriangles;
+  uint32_t drawnTriangles;
+};
+
+//Vertex + index buffer pair a draw key's mesh id resolves to
+struct MeshBinding
+{
+  VkBuffer vertexBuffer;
+  VkBuffer indexBuffer;
+};
+
+//A resident world cell's buffers, owned by m_Resources. Bounds are a world space sphere for the frustum test.
+struct WorldCellGpu
+{
+  ResourceHandle vertexBuffer;
+  ResourceHandle indexBuffer;
+  uint32_t indexCount;
+  VkDeviceSize bytes;
+  Vec3 center;
+  float radius;
+};
+
+//Copies recorded at the top of the next command buffer, the staging buffer holds the vertices then the indices
+struct WorldUpload
+{
+  VkBuffer staging;
+  VkBuffer vertexBuffer;
+  VkBuffer indexBuffer;
+  VkDeviceSize vertexBytes;
+  VkDeviceSize indexBytes;
+};
+
+struct WorldDraw
+{
+  VkBuffer vertexBuffer;
+  VkBuffer indexBuffer;
+  uint32_t indexCount;
+};
+
+struct FrameStats
+{
+  uint64_t trianglesSubmitted = 0;
+  uint64_t trianglesWithoutLod = 0;
+
+  //Pipeline and vertex/index buffer binds, avoided ones were skipped because the sorted neighbour already bound it
+  uint64_t bindsIssued = 0;
+  uint64_t bindsAvoided = 0;
+
+  //Lights left after the CPU frustum cull, the ones cluster.comp bins
+  uint32_t lightsVisible = 0;
+
+  //Triangles drawn into re-rendered shadow cascades, 0 while every cascade is cached
+  uint64_t shadowTriangles = 0;
+
+  //Streamed world cells in the frustum, not part of trianglesSubmitted
+  uint64_t worldTriangles = 0;
+};
+
 class Volcano {
 public:
+  explicit Volcano(const VolcanoConfig& config) : m_Config(config) {}
   void run();
 
 private:
+  //--headless has no window, everything GLFW is skipped and the surface is a VK_EXT_headless_surface
   void initWindow();
+  //Runs the startup steps as a TaskGraph, see reportStartup for the per task timings
   void initVulkan();
+  void reportStartup(const TaskGraph& graph, uint32_t threads);
+  std::vector<std::string> startupShaderPaths() const;
   void loop();
+  //Ends the loop after the current frame, the window close button does the same
+  void requestClose();
+  bool shouldClose() const;
+  //--sim-benchmark: fps and sim rate under sim load, render load and both, then exits
+  void startSimBenchmark();
+  void stepSimBenchmark();
   void onExit();
 
   void createInstance();
   bool checkValidationLayerSupport();
   void selectPhysicalDevice();
+  //Higher is better, only meaningful for devices that pass isDeviceSuitable
+  int64_t rateDevice(VkPhysicalDevice pDevice);
+  bool matchesDeviceOverride(VkPhysicalDevice pDevice);
+  bool meetsRequiredLimits(VkPhysicalDevice pDevice);
+  void listDevices();
   void createLogicalDevice();
   std::vector<const char*> getRequiredExtensions();
   void setupDebugMessenger();
@@ -75,6 +317,7 @@ private:
   void createSurface();
 
   bool checkDeviceExtensionsSupport(VkPhysicalDevice pDevice);
+  bool isDeviceExtensionSupported(VkPhysicalDevice pDevice, const char* extensionName);
 
   void createSwapChain();
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice pDevice);
@@ -86,24 +329,131 @@ private:
 
   void createImageViews();
 
+  //Geometry
+  void loadMesh();
+  void createVertexBuffer();
+  void createIndexBuffer();
+  void createScene();
+
+  //Per frame draw list, picks a LOD per object by projected screen space error
+  void buildDrawList();
+  uint32_t selectLod(const SceneObject& object, float distance, float pixelsPerUnit) const;
+
+  void createDepthResources();
+
   //Drawing
   void createFrameBuffers();
   void createCommandPool();
-  void createCommandBuffer();
+  void createCommandBuffers();
   void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void submitFrame(VkCommandBuffer commandBuffer, VkFence fence);
+
+  //VK_KHR_dynamic_rendering path: layout transitions with vkCmdPipelineBarrier2 instead of render pass dependencies
+  void beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void endDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void recordPresentTransition(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
   void createSyncObjects();
 
 
   //Pipeline Methods
   void createGraphicalPipeline();
+  //--watch-shaders: rebuilds the mesh pipelines when their .spv files change, the old ones go through m_Resources
+  void reloadChangedShaders();
+  std::vector<std::string> meshShaderPaths() const;
   VkShaderModule createShaderModule(const std::vector<char>& code);
+  //Through m_ShaderLibrary, from memory during startup
+  VkShaderModule loadShader(const char* path);
   void createRenderPass();
+
+  //Deferred renderer (renderer/deferred.cpp), replaces createRenderPass when --renderer deferred
+  void createGBuffer();
+  void createDeferredRenderPass();
+  void createLightingPipeline();
+  void recordLightingSubpass(VkCommandBuffer commandBuffer);
+  void reportRendererMemory();
+  void reportGBufferCommitment();
+  void destroyDeferredResources();
+
+  //Clustered forward lighting (renderer/clustered.cpp), the forward renderer's shading
+  void createLights();
+  void createClusterResources();
+  void updateLights(const Mat4& view, const Mat4& projection);
+  //asyncQueue: recorded for m_ComputeQueue, timed on m_ComputeTimeline and left to the semaphore to publish
+  void recordLightBinning(VkCommandBuffer commandBuffer, bool asyncQueue);
+  void bindClusterSet(VkCommandBuffer commandBuffer);
+  void startLightBenchmark();
+  void stepLightBenchmark();
+  void destroyClusterResources();
+
+  //Cascaded shadow maps (renderer/shadows.cpp), forward renderer only
+  void createShadowResources();
+  void createShadowPipeline();
+  void updateShadows(const Vec3& eye, const Vec3& target, const Mat4& view);
+  void recordShadowPass(VkCommandBuffer commandBuffer);
+  void bindShadowSet(VkCommandBuffer commandBuffer);
+  void destroyShadowResources();
+
+  //Async compute submission (renderer/asynccompute.cpp), light binning on its own queue ahead of the graphics submit
+  bool findAsyncComputeQueue(uint32_t graphicsFamily, uint32_t& family, uint32_t& queueIndex);
+  void createAsyncCompute();
+  void submitAsyncCompute();
+  void destroyAsyncCompute();
+
+  //Pipelined frame readback (renderer/capture.cpp), --capture
+  void createCapture();
+  void recordCapture(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void collectCapture(uint32_t frameIndex);
+  void destroyCapture();
+
+  //HDR scene color, bloom and tonemap (renderer/post.cpp), the renderers draw into mainColorFormat()
+  VkFormat mainColorFormat() const;
+  void createSceneColor();
+  void createPostResources();
+  void recordPostChain(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void destroyPostResources();
+
+  //Two phase Hi-Z occlusion culling (renderer/occlusion.cpp), forward renderer with dynamic rendering only
+  void createOcclusionResources();
+  void createOcclusionBuffers();
+  void uploadOcclusionObjects(const Mat4& viewProjection);
+  void recordOcclusionCull(VkCommandBuffer commandBuffer, uint32_t phase);
+  void recordOcclusionDraws(VkCommandBuffer commandBuffer, uint32_t phase);
+  void recordOcclusionLatePass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void collectOcclusionStats(uint32_t frameIndex);
+  void destroyOcclusionResources();
+
+  //Streamed world (renderer/world.cpp), --world
+  void createWorld();
+  void updateWorld(const Vec3& eye, double time, const Mat4& view, const Mat4& viewProjection);
+  void uploadWorldCell(DecodedCell& decoded);
+  VkDeviceSize releaseWorldCell(uint32_t cell);
+  void recordWorldUploads(VkCommandBuffer commandBuffer);
+  void recordWorldDraws(VkCommandBuffer commandBuffer);
+  void destroyWorld();
+
+  //Dynamic resolution (renderer/resolution.cpp): the main pass renders into the top left m_RenderExtent of the
+  //scene color, the tonemap pass upscales it
+  void initRenderScale();
+  void setRenderScale(float scale);
+  void updateRenderScale();
  
   //Rendering {FFS FINALLY}
   void drawFrame();
 
-  GLFWwindow *m_Window;
+  //VK_KHR_present_wait: polls which presents have hit the screen and accumulates their latency
+  void pollPresentLatency();
+
+  //Per scope live/peak/total host allocation counts, printed at exit
+  void reportHostAllocations();
+  void reportResources();
+  //--report: frame times after REPORT_WARMUP_FRAMES and host allocation counters, one "name value" per line
+  void writeReport();
+
+  VolcanoConfig m_Config;
+
+  GLFWwindow *m_Window = nullptr;
+  bool m_CloseRequested = false;
   VkInstance m_VulkanInstance;
   VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
   VkDevice m_Device;
@@ -116,20 +466,255 @@ private:
   VkExtent2D m_SwapChainExtent;
   std::vector<VkImageView> m_SwapChainImageViews;
   VkRenderPass m_RenderPass;
-  VkPipelineLayout m_PipelineLayout;
+  VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+  //Every pipeline goes through it, loaded from and saved to --pipeline-cache. Internally synchronized, the startup
+  //workers compile against it at the same time.
+  VkPipelineCache m_PipelineCache = VK_NULL_HANDLE;
+  size_t m_PipelineCacheReused = 0;
+  ShaderLibrary m_ShaderLibrary;
+  std::chrono::steady_clock::time_point m_StartupStart;
+  //Owned by m_Resources, so a shader reload can drop them while older frames still draw with them
   VkPipeline m_GraphicsPipeline;
+  ResourceHandle m_GraphicsPipelineResource;
   VkCommandPool m_CommandPool;
-  VkCommandBuffer m_CommandBuffer;
+  std::vector<VkCommandBuffer> m_CommandBuffers;
 
-  VkSemaphore m_ImageAvailableSemaphore;
-  VkSemaphore m_RenderFinishedSemaphore;
-  VkFence m_InFlightFence;
-  
+  MeshData m_Mesh;
+  //Owned by m_Resources, m_MeshBindings holds the resolved buffers
+  ResourceHandle m_VertexBuffer;
+  ResourceHandle m_IndexBuffer;
+
+  std::vector<SceneObject> m_Objects;
+  std::vector<DrawItem> m_DrawList;
+  DrawQueue m_DrawQueue;
+  std::vector<VkPipeline> m_Pipelines;
+  std::vector<MeshBinding> m_MeshBindings;
+  FrameStats m_FrameStats;
+
+  VkFormat m_DepthFormat;
+  VkImage m_DepthImage;
+  VkImageView m_DepthImageView;
+  ResourceHandle m_DepthImageResource;
+  ResourceHandle m_DepthViewResource;
+
+  //Transient G-buffer, only read as input attachments inside the deferred render pass. Owned by m_Resources.
+  VkImage m_GBufferImages[GBUFFER_ATTACHMENT_COUNT];
+  VkDeviceMemory m_GBufferMemory[GBUFFER_ATTACHMENT_COUNT];
+  VkImageView m_GBufferImageViews[GBUFFER_ATTACHMENT_COUNT];
+  VkDeviceSize m_GBufferAllocatedBytes = 0;
+  bool m_GBufferLazy = false;
+
+  std::vector<SceneLight> m_Lights;
+  uint32_t m_LightCount = 0;
+  std::vector<ClusterFrame> m_ClusterFrames;
+  VkDescriptorSetLayout m_ClusterSetLayout;
+  VkDescriptorPool m_ClusterDescriptorPool;
+  VkPipelineLayout m_ClusterPipelineLayout;
+  VkPipeline m_ClusterPipeline;
+
+  //--light-benchmark progress, see stepLightBenchmark
+  uint32_t m_LightBenchmarkStep = 0;
+  uint32_t m_LightBenchmarkFrame = 0;
+  uint64_t m_LightBenchmarkVisible = 0;
+  std::chrono::steady_clock::time_point m_LightBenchmarkStart;
+
+  //Set in createLogicalDevice when --async-compute finds a queue, m_ClusterQueueFamilies is empty unless the compute
+  //family differs from graphics, then the cluster buffers are CONCURRENT across both
+  bool m_AsyncComputeEnabled = false;
+  uint32_t m_ComputeFamily = 0;
+  uint32_t m_ComputeQueueIndex = 0;
+  VkQueue m_ComputeQueue;
+  VkCommandPool m_ComputeCommandPool;
+  std::vector<VkCommandBuffer> m_ComputeCommandBuffers;
+  std::vector<VkSemaphore> m_ComputeFinishedSemaphores;
+  std::vector<uint32_t> m_ClusterQueueFamilies;
+  GpuTimeline m_ComputeTimeline;
+
+  VkFormat m_ShadowFormat;
+  VkImage m_ShadowAtlas;
+  VkDeviceMemory m_ShadowAtlasMemory;
+  VkImageView m_ShadowAtlasView;
+  VkSampler m_ShadowSampler;
+  VkRenderPass m_ShadowRenderPass;
+  VkFramebuffer m_ShadowFramebuffer;
+  VkDescriptorSetLayout m_ShadowSetLayout;
+  VkDescriptorPool m_ShadowDescriptorPool;
+  VkPipelineLayout m_ShadowPipelineLayout;
+  VkPipeline m_ShadowPipeline;
+  std::vector<ShadowFrame> m_ShadowFrames;
+  bool m_ShadowAtlasInitialized = false;
+  ShadowCascade m_ShadowCascades[SHADOW_CASCADE_COUNT];
+  bool m_ShadowCascadeDirty[SHADOW_CASCADE_COUNT] = {};
+  std::vector<ShadowDraw> m_ShadowDraws;
+  //Cascade re-renders since the last stats line
+  uint64_t m_ShadowCascadeRenders = 0;
+
+  //Scene color and the bloom chain are owned by m_Resources
+  VkImage m_SceneColor;
+  VkDeviceMemory m_SceneColorMemory;
+  VkImageView m_SceneColorView;
+  VkImage m_BloomImage;
+  VkDeviceMemory m_BloomMemory;
+  VkImageView m_BloomMipViews[BLOOM_MIP_COUNT];
+  VkExtent2D m_BloomExtents[BLOOM_MIP_COUNT];
+  VkSampler m_PostSampler;
+  VkDescriptorSetLayout m_BloomSetLayout;
+  VkDescriptorSetLayout m_TonemapSetLayout;
+  VkDescriptorPool m_PostDescriptorPool;
+  VkDescriptorSet m_BloomDownSets[BLOOM_MIP_COUNT];
+  VkDescriptorSet m_BloomUpSets[BLOOM_MIP_COUNT - 1];
+  VkDescriptorSet m_TonemapSet;
+  VkPipelineLayout m_BloomPipelineLayout;
+  VkPipelineLayout m_TonemapPipelineLayout;
+  VkPipeline m_BloomDownPipeline;
+  VkPipeline m_BloomUpPipeline;
+  VkPipeline m_TonemapPipeline;
+  //Legacy path only, dynamic rendering writes the swapchain image directly
+  VkRenderPass m_PostRenderPass;
+  std::vector<VkFramebuffer> m_PostFramebuffers;
+
+  //Swapchain sized unless post processing is on, everything screen sized is allocated at swapchain size regardless
+  VkExtent2D m_RenderExtent;
+  float m_RenderScale = 1.0f;
+  bool m_DynamicResolutionEnabled = false;
+  double m_RenderScaleGpuMs = 0.0;
+  uint32_t m_RenderScaleSamples = 0;
+  //Scale changes since the last stats line
+  uint32_t m_RenderScaleChanges = 0;
+
+  //Set in createLogicalDevice, needs drawIndirectFirstInstance. Without multiDrawIndirect every command is its own call.
+  bool m_OcclusionCullingEnabled = false;
+  bool m_MultiDrawIndirectEnabled = false;
+  VkDescriptorSetLayout m_OcclusionSetLayout;
+  VkDescriptorSetLayout m_HiZSetLayout;
+  VkDescriptorPool m_OcclusionDescriptorPool;
+  std::vector<OcclusionFrame> m_OcclusionFrames;
+  //Shared by the frames in flight like the depth buffer: last frame's verdict per object and both phases' commands.
+  //These, the per frame buffers and the Hi-Z image and views are owned by m_Resources.
+  VkBuffer m_VisibilityBuffer;
+  VkDeviceMemory m_VisibilityMemory;
+  VkBuffer m_IndirectBuffer;
+  VkDeviceMemory m_IndirectMemory;
+  uint32_t m_OcclusionObjectCount = 0;
+  VkImage m_HiZImage;
+  VkDeviceMemory m_HiZMemory;
+  VkImageView m_HiZView;
+  VkImageView m_HiZMipViews[HIZ_MAX_LEVELS];
+  VkDescriptorSet m_HiZSets[HIZ_MAX_LEVELS];
+  uint32_t m_HiZLevels = 0;
+  VkSampler m_HiZSampler;
+  VkPipelineLayout m_HiZPipelineLayout;
+  VkPipelineLayout m_CullPipelineLayout;
+  VkPipeline m_HiZPipeline;
+  VkPipeline m_CullPipeline;
+  //shader.frag with indirect.vert, which reads its matrices from the object buffer. Owned by m_Resources.
+  VkPipeline m_IndirectPipeline = VK_NULL_HANDLE;
+  ResourceHandle m_IndirectPipelineResource;
+  Mat4 m_OcclusionViewProjection;
+  //Last collected frame's counters
+  OcclusionStats m_OcclusionStats{};
+
+  //Cells are read on the streamer's I/O threads, everything GPU side happens on the main thread in updateWorld
+  WorldStreamer m_WorldStreamer;
+  std::unordered_map<uint32_t, WorldCellGpu> m_WorldCells;
+  std::vector<WorldUpload> m_WorldUploads;
+  std::vector<WorldDraw> m_WorldDraws;
+  Mat4 m_WorldViewProjection;
+  Mat4 m_WorldView;
+  Vec3 m_WorldLastEye;
+  double m_WorldLastTime = 0.0;
+  std::chrono::steady_clock::time_point m_WorldLastFrame;
+  double m_WorldFrameMsAverage = 0.0;
+  //Hitches since the last stats line
+  uint32_t m_WorldHitches = 0;
+
+  //Set in createSwapChain, capture needs TRANSFER_SRC on the swapchain images
+  bool m_CaptureEnabled = false;
+  CaptureSlot m_CaptureSlots[CAPTURE_RING_SIZE];
+  //Slot each frame in flight copied into, -1 for none
+  int32_t m_CaptureFrameSlots[MAX_FRAMES_IN_FLIGHT];
+  uint32_t m_CaptureNextSlot = 0;
+  bool m_CaptureMemoryCoherent = false;
+  uint64_t m_CaptureRecorded = 0;
+  uint64_t m_CaptureCollected = 0;
+  uint64_t m_CaptureDropped = 0;
+  FrameEncoder m_FrameEncoder;
+
+  VkDescriptorSetLayout m_LightingSetLayout;
+  VkDescriptorPool m_LightingDescriptorPool;
+  VkDescriptorSet m_LightingDescriptorSet;
+  VkPipelineLayout m_LightingPipelineLayout;
+  VkPipeline m_LightingPipeline;
+
+  //One set per frame in flight, m_ImagesInFlight remembers which frame's fence last used a swapchain image
+  std::vector<VkSemaphore> m_ImageAvailableSemaphores;
+  std::vector<VkSemaphore> m_RenderFinishedSemaphores;
+  std::vector<VkFence> m_InFlightFences;
+  std::vector<VkFence> m_ImagesInFlight;
+  uint32_t m_CurrentFrame = 0;
+  //Frames recorded so far, m_Resources tags releases with it
+  uint64_t m_FrameNumber = 0;
+
+  //Buffers, images, views and pipelines that can be freed mid-run, see ResourceRegistry
+  ResourceRegistry m_Resources;
+  //Device memory usage against the budget, polled every frame. The extension is enabled in createLogicalDevice.
+  MemoryBudget m_MemoryBudget;
+  bool m_MemoryBudgetExtension = false;
+  //--watch-shaders: newest write time seen of the mesh pipelines' .spv files
+  std::filesystem::file_time_type m_ShaderWriteTime = std::filesystem::file_time_type::min();
+
+  FrameLimiter m_FrameLimiter{m_Config.fpsLimit};
+
+  //Camera and light animation tick here, buildDrawList samples it once per frame
+  Simulation m_Simulation;
+  double m_SimTime = 0.0;
+
+  //--report: CPU frame times and host allocations once the warmup frames are done
+  std::vector<double> m_ReportFrameMs;
+  uint64_t m_ReportAllocations = 0;
+  double m_TimeToFirstFrameMs = 0.0;
+  uint64_t m_PeakResourceBytes = 0;
+
+  //--sim-benchmark progress, see stepSimBenchmark
+  double m_RenderLoadMs = 0.0;
+  uint32_t m_SimBenchmarkPhase = 0;
+  bool m_SimBenchmarkMeasuring = false;
+  uint32_t m_SimBenchmarkFrames = 0;
+  double m_SimBenchmarkWorstFrameMs = 0.0;
+  uint64_t m_SimBenchmarkTicks = 0;
+  uint64_t m_SimBenchmarkSkipped = 0;
+  std::chrono::steady_clock::time_point m_SimBenchmarkStart;
+  std::chrono::steady_clock::time_point m_SimBenchmarkLastFrame;
+  std::chrono::steady_clock::time_point m_InputSampleTime;
+
+  struct PendingPresent
+  {
+    uint64_t presentId;
+    std::chrono::steady_clock::time_point inputSampleTime;
+  };
+
+  bool m_PresentWaitEnabled = false;
+  PFN_vkWaitForPresentKHR m_vkWaitForPresentKHR = nullptr;
+  uint64_t m_PresentId = 0;
+  std::deque<PendingPresent> m_PendingPresents;
+  double m_PresentLatencySum = 0.0;
+  uint32_t m_PresentLatencySamples = 0;
 
 
   std::vector<VkFramebuffer> m_SwapChainFrameBuffer;
   const std::vector<const char*> m_ValidationLayers = { "VK_LAYER_KHRONOS_validation" };
   const std::vector<const char*> m_DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+  std::vector<const char*> m_EnabledDeviceExtensions;
+
+  //Timestamp ranges + debug labels for the trace, timestamps only when --trace, --gpu-timings or --light-benchmark is given
+  GpuTimeline m_GpuTimeline;
+
+  //Host allocation callbacks passed to every vkCreate*/vkDestroy*, nullptr with --system-allocator
+  const VkAllocationCallbacks* m_Allocator = nullptr;
+
+  //Set in createLogicalDevice, without them m_RenderPass and m_SwapChainFrameBuffer are used instead
+  bool m_DynamicRenderingEnabled = false;
+  bool m_Synchronization2Enabled = false;
   VkDebugUtilsMessengerEXT m_DebugMessenger;
 
 
@@ -0,0 +1,252 @@
+#include "worldfile.hpp"
+#include "../utils/math.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+//Ground quads per cell side, and the pillar count range per cell
+#define WORLD_TILE_RESOLUTION 32
+#define WORLD_MIN_PILLARS 8
+#define WORLD_MAX_PILLARS 24
+//Half width of the clear corridor along the camera's dolly
+#define WORLD_CORRIDOR 2.0f
+
+uint64_t WorldIndex::cellBytes(uint32_t cell) const
+{
+  return static_cast<uint64_t>(cells[cell].vertexCount) * sizeof(Vertex) +
+         static_cast<uint64_t>(cells[cell].indexCount) * sizeof(uint32_t);
+}
+
+WorldIndex loadWorldIndex(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+  {
+    throw std::runtime_error("Failed to open world file " + filename + "!");
+  }
+  uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+  file.seekg(0);
+
+  WorldIndex index;
+  if (!file.read(reinterpret_cast<char*>(&index.header), sizeof(index.header)) ||
+      index.header.magic != WORLD_FILE_MAGIC || index.header.version != WORLD_FILE_VERSION)
+  {
+    throw std::runtime_error("Not a supported world file!");
+  }
+
+  index.cells.resize(static_cast<size_t>(index.header.cellsX) * index.header.cellsZ);
+  if (index.cells.empty() ||
+      !file.read(reinterpret_cast<char*>(index.cells.data()), index.cells.size() * sizeof(WorldCellEntry)))
+  {
+    throw std::runtime_error("World file index is truncated!");
+  }
+
+  for (uint32_t i = 0; i < index.cells.size(); i++)
+  {
+    if (index.cells[i].offset + index.cellBytes(i) > fileSize)
+    {
+      throw std::runtime_error("World file cell is out of bounds!");
+    }
+  }
+  return index;
+}
+
+MeshData loadWorldCell(const std::string& filename, const WorldCellEntry& entry)
+{
+  //Own stream per call, workers read different cells at the same time
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open())
+  {
+    throw std::runtime_error("Failed to open world file " + filename + "!");
+  }
+
+  MeshData mesh;
+  mesh.vertices.resize(entry.vertexCount);
+  mesh.indices.resize(entry.indexCount);
+  file.seekg(static_cast<std::streamoff>(entry.offset));
+  file.read(reinterpret_cast<char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+  file.read(reinterpret_cast<char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+  if (!file)
+  {
+    throw std::runtime_error("World file cell is truncated!");
+  }
+
+  for (uint32_t index : mesh.indices)
+  {
+    if (index >= entry.vertexCount)
+    {
+      throw std::runtime_error("World file cell index is out of range!");
+    }
+  }
+  std::copy(entry.boundsMin, entry.boundsMin + 3, mesh.boundsMin);
+  std::copy(entry.boundsMax, entry.boundsMax + 3, mesh.boundsMax);
+  return mesh;
+}
+
+//Rolling hills, flattened to the corridor the camera flies down
+static float groundHeight(float x, float z)
+{
+  float hills = 0.35f * std::sin(x * 0.21f) * std::cos(z * 0.17f) + 0.2f * std::sin(x * 0.05f + z * 0.07f);
+  float t = std::clamp((std::fabs(x) - WORLD_CORRIDOR * 0.75f) / WORLD_CORRIDOR, 0.0f, 1.0f);
+  return -0.5f + hills * t * t * (3.0f - 2.0f * t);
+}
+
+static void pushVertex(MeshData& mesh, const Vec3& position, const Vec3& normal, float u, float v)
+{
+  mesh.vertices.push_back({{position.x, position.y, position.z}, {normal.x, normal.y, normal.z}, {u, v}});
+}
+
+static void addGround(MeshData& mesh, float x0, float z0, float size)
+{
+  uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+  float step = size / WORLD_TILE_RESOLUTION;
+  for (uint32_t j = 0; j <= WORLD_TILE_RESOLUTION; j++)
+  {
+    for (uint32_t i = 0; i <= WORLD_TILE_RESOLUTION; i++)
+    {
+      float x = x0 + i * step;
+      float z = z0 + j * step;
+      //Central differences, continuous across cell borders
+      Vec3 normal = normalize(Vec3(groundHeight(x - step, z) - groundHeight(x + step, z), 2.0f * step,
+                                   groundHeight(x, z - step) - groundHeight(x, z + step)));
+      pushVertex(mesh, Vec3(x, groundHeight(x, z), z), normal, i / float(WORLD_TILE_RESOLUTION), j / float(WORLD_TILE_RESOLUTION));
+    }
+  }
+
+  //Counter clockwise seen from above
+  uint32_t row = WORLD_TILE_RESOLUTION + 1;
+  for (uint32_t j = 0; j < WORLD_TILE_RESOLUTION; j++)
+  {
+    for (uint32_t i = 0; i < WORLD_TILE_RESOLUTION; i++)
+    {
+      uint32_t v00 = base + j * row + i;
+      uint32_t v10 = v00 + 1;
+      uint32_t v01 = v00 + row;
+      uint32_t v11 = v01 + 1;
+      mesh.indices.insert(mesh.indices.end(), {v00, v01, v10, v10, v01, v11});
+    }
+  }
+}
+
+static Vec3 scaled(const Vec3& a, const Vec3& b)
+{
+  return {a.x * b.x, a.y * b.y, a.z * b.z};
+}
+
+//Axis aligned box without a bottom, halfExtents along each axis
+static void addBox(MeshData& mesh, const Vec3& center, const Vec3& halfExtents)
+{
+  //Outward normal plus two tangents with u x v = normal, so the corners below wind counter clockwise from outside
+  const Vec3 faces[5][3] =
+  {
+    {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+    {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+    {{0, 1, 0}, {0, 0, 1}, {1, 0, 0}},
+    {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+    {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}}
+  };
+  const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+
+  for (const auto& face : faces)
+  {
+    uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+    for (const auto& corner : corners)
+    {
+      Vec3 offset = face[0] + face[1] * corner[0] + face[2] * corner[1];
+      pushVertex(mesh, center + scaled(offset, halfExtents), face[0], corner[0] * 0.5f + 0.5f, corner[1] * 0.5f + 0.5f);
+    }
+    mesh.indices.insert(mesh.indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+  }
+}
+
+//Deterministic per cell, xorshift on a hash of the cell index
+static uint32_t nextRandom(uint32_t& state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static float randomRange(uint32_t& state, float low, float high)
+{
+  return low + (high - low) * (nextRandom(state) & 0xFFFFFF) / float(0xFFFFFF);
+}
+
+static MeshData generateCell(const WorldFileHeader& header, uint32_t cellX, uint32_t cellZ)
+{
+  float x0 = header.origin[0] + cellX * header.cellSize;
+  float z0 = header.origin[1] + cellZ * header.cellSize;
+
+  MeshData mesh;
+  addGround(mesh, x0, z0, header.cellSize);
+
+  uint32_t state = (cellZ * header.cellsX + cellX) * 2654435761u + 1u;
+  uint32_t pillars = WORLD_MIN_PILLARS + nextRandom(state) % (WORLD_MAX_PILLARS - WORLD_MIN_PILLARS + 1);
+  for (uint32_t i = 0; i < pillars; i++)
+  {
+    Vec3 halfExtents(randomRange(state, 0.15f, 0.6f), randomRange(state, 0.25f, 2.0f), randomRange(state, 0.15f, 0.6f));
+    float x = randomRange(state, x0 + halfExtents.x, x0 + header.cellSize - halfExtents.x);
+    float z = randomRange(state, z0 + halfExtents.z, z0 + header.cellSize - halfExtents.z);
+    if (std::fabs(x) < WORLD_CORRIDOR + halfExtents.x)
+    {
+      continue;
+    }
+    //Sunk a bit so slopes don't show a gap under the box
+    addBox(mesh, Vec3(x, groundHeight(x, z) - 0.2f + halfExtents.y, z), halfExtents);
+  }
+
+  mesh.computeBounds();
+  return mesh;
+}
+
+void generateWorldFile(const std::string& filename, uint32_t cellsX, uint32_t cellsZ, float cellSize)
+{
+  WorldFileHeader header{};
+  header.magic = WORLD_FILE_MAGIC;
+  header.version = WORLD_FILE_VERSION;
+  header.cellsX = cellsX;
+  header.cellsZ = cellsZ;
+  header.cellSize = cellSize;
+  //Centered on x, ending just behind the camera's start at z = 2
+  header.origin[0] = -0.5f * cellsX * cellSize;
+  header.origin[1] = 4.0f - cellsZ * cellSize;
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    throw std::runtime_error("Failed to open world file for writing!");
+  }
+
+  //Index goes in once every cell's offset is known
+  std::vector<WorldCellEntry> cells(static_cast<size_t>(cellsX) * cellsZ);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(cells.data()), cells.size() * sizeof(WorldCellEntry));
+
+  uint64_t offset = sizeof(header) + cells.size() * sizeof(WorldCellEntry);
+  for (uint32_t z = 0; z < cellsZ; z++)
+  {
+    for (uint32_t x = 0; x < cellsX; x++)
+    {
+      MeshData mesh = generateCell(header, x, z);
+      WorldCellEntry& entry = cells[z * cellsX + x];
+      entry.offset = offset;
+      entry.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+      entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+      std::copy(mesh.boundsMin, mesh.boundsMin + 3, entry.boundsMin);
+      std::copy(mesh.boundsMax, mesh.boundsMax + 3, entry.boundsMax);
+
+      file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+      file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+      offset += mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(uint32_t);
+    }
+  }
+
+  file.seekp(sizeof(header));
+  file.write(reinterpret_cast<const char*>(cells.data()), cells.size() * sizeof(WorldCellEntry));
+  if (!file)
+  {
+    throw std::runtime_error("Failed to write world file!");
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../mesh/mesh.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Binary world layout (.vworld), little endian:
+//  WorldFileHeader
+//  WorldCellEntry cells[cellsX * cellsZ]   row major, x fastest
+//  per cell: Vertex vertices[vertexCount], uint32_t indices[indexCount] at its entry's offset
+//Geometry is in world space, so a cell draws with the view projection alone. Only the header and the index are read
+//up front, cells are read one by one as the camera gets near them.
+#define WORLD_FILE_MAGIC 0x444C5756u // "VWLD"
+#define WORLD_FILE_VERSION 1
+
+struct WorldFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t cellsX;
+  uint32_t cellsZ;
+  float cellSize;
+  float origin[2]; //x, z of cell 0's corner
+};
+
+struct WorldCellEntry
+{
+  uint64_t offset;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+struct WorldIndex
+{
+  WorldFileHeader header{};
+  std::vector<WorldCellEntry> cells;
+
+  uint64_t cellBytes(uint32_t cell) const;
+};
+
+//Header + index only
+WorldIndex loadWorldIndex(const std::string& filename);
+
+//One cell's geometry, reads only its own range of the file. Safe to call from several threads at once.
+MeshData loadWorldCell(const std::string& filename, const WorldCellEntry& entry);
+
+//Synthetic world for streaming tests: a cellsX x cellsZ grid of height field tiles with pillars on them, written
+//one cell at a time so it never has to fit in memory. The camera's dolly runs down the middle along -z from z = 2,
+//a corridor there is kept clear.
+void generateWorldFile(const std::string& filename, uint32_t cellsX, uint32_t cellsZ, float cellSize);
@@ -0,0 +1,233 @@
+#include "worldstreamer.hpp"
+#include "../utils/profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+void WorldStreamer::open(const std::string& filename, uint32_t ioThreads, float radiusCells)
+{
+  m_Filename = filename;
+  m_Index = loadWorldIndex(filename);
+  m_RadiusCells = std::max(radiusCells, 1.0f);
+  m_MaxRadiusCells = m_RadiusCells;
+
+  size_t cellCount = m_Index.cells.size();
+  m_States.assign(cellCount, CELL_UNLOADED);
+  m_RequestedAt.assign(cellCount, Clock::time_point{});
+  m_Tickets.reset(new std::atomic<uint32_t>[cellCount]);
+  for (size_t i = 0; i < cellCount; i++)
+  {
+    m_Tickets[i].store(0, std::memory_order_relaxed);
+  }
+
+  m_Pool.start(std::max(ioThreads, 1u), "world io");
+}
+
+void WorldStreamer::close()
+{
+  m_Pool.stop();
+  m_Completed.clear();
+  m_Active.clear();
+  m_Index.cells.clear();
+}
+
+float WorldStreamer::distanceToCell(uint32_t cell, float x, float z) const
+{
+  const WorldFileHeader& header = m_Index.header;
+  float x0 = header.origin[0] + (cell % header.cellsX) * header.cellSize;
+  float z0 = header.origin[1] + (cell / header.cellsX) * header.cellSize;
+  float dx = std::max({x0 - x, 0.0f, x - (x0 + header.cellSize)});
+  float dz = std::max({z0 - z, 0.0f, z - (z0 + header.cellSize)});
+  return std::sqrt(dx * dx + dz * dz);
+}
+
+void WorldStreamer::update(const Vec3& eye, const Vec3& velocity, std::vector<uint32_t>& unload)
+{
+  PROFILE_FUNCTION();
+  const WorldFileHeader& header = m_Index.header;
+  m_Eye = eye;
+  m_Ahead = eye + velocity * WORLD_PREFETCH_SECONDS;
+  float radius = m_RadiusCells * header.cellSize;
+
+  //One cell of hysteresis, so a camera on a border doesn't load and unload the same cells every frame
+  collectOutOfRange(radius + header.cellSize, unload);
+
+  //Wanted but not loaded, around the camera and around where it is headed
+  std::vector<std::pair<float, uint32_t>> wanted;
+  for (const Vec3& center : {m_Eye, m_Ahead})
+  {
+    int minX = std::max(0, static_cast<int>(std::floor((center.x - radius - header.origin[0]) / header.cellSize)));
+    int maxX = std::min(static_cast<int>(header.cellsX) - 1,
+                        static_cast<int>(std::floor((center.x + radius - header.origin[0]) / header.cellSize)));
+    int minZ = std::max(0, static_cast<int>(std::floor((center.z - radius - header.origin[1]) / header.cellSize)));
+    int maxZ = std::min(static_cast<int>(header.cellsZ) - 1,
+                        static_cast<int>(std::floor((center.z + radius - header.origin[1]) / header.cellSize)));
+    for (int z = minZ; z <= maxZ; z++)
+    {
+      for (int x = minX; x <= maxX; x++)
+      {
+        uint32_t cell = static_cast<uint32_t>(z) * header.cellsX + static_cast<uint32_t>(x);
+        if (m_States[cell] == CELL_UNLOADED && distanceToCell(cell, center.x, center.z) <= radius)
+        {
+          //Nearest to the camera first, prefetched cells are further out so they naturally go last
+          wanted.push_back({distanceToCell(cell, m_Eye.x, m_Eye.z), cell});
+          m_States[cell] = CELL_LOADING;
+        }
+      }
+    }
+  }
+  std::sort(wanted.begin(), wanted.end());
+
+  Clock::time_point now = Clock::now();
+  for (const auto& request : wanted)
+  {
+    uint32_t cell = request.second;
+    uint32_t ticket = m_Tickets[cell].fetch_add(1, std::memory_order_relaxed) + 1;
+    m_RequestedAt[cell] = now;
+    m_Active.push_back(cell);
+    m_LoadingCount++;
+
+    WorldCellEntry entry = m_Index.cells[cell];
+    m_Pool.submit([this, cell, ticket, entry]
+    {
+      //Dropped while it waited in the queue, don't bother reading it
+      if (m_Tickets[cell].load(std::memory_order_relaxed) != ticket)
+      {
+        return;
+      }
+
+      PROFILE_SCOPE("read world cell");
+      Completed completed{};
+      completed.decoded.cell = cell;
+      completed.ticket = ticket;
+      Clock::time_point start = Clock::now();
+      try
+      {
+        completed.decoded.mesh = loadWorldCell(m_Filename, entry);
+        completed.decoded.bytes = static_cast<uint64_t>(entry.vertexCount) * sizeof(Vertex) +
+                                  static_cast<uint64_t>(entry.indexCount) * sizeof(uint32_t);
+      }
+      catch (const std::exception&)
+      {
+        completed.failed = true;
+      }
+      completed.readSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+      std::lock_guard<std::mutex> lock(m_CompletedMutex);
+      m_Completed.push_back(std::move(completed));
+    });
+  }
+}
+
+void WorldStreamer::collectOutOfRange(float radius, std::vector<uint32_t>& unload)
+{
+  size_t kept = 0;
+  for (uint32_t cell : m_Active)
+  {
+    if (distanceToCell(cell, m_Eye.x, m_Eye.z) <= radius || distanceToCell(cell, m_Ahead.x, m_Ahead.z) <= radius)
+    {
+      m_Active[kept++] = cell;
+      continue;
+    }
+
+    if (m_States[cell] == CELL_RESIDENT)
+    {
+      //Stays resident until the caller has released its buffers and calls markUnloaded
+      unload.push_back(cell);
+    }
+    else if (m_States[cell] == CELL_FAILED)
+    {
+      m_States[cell] = CELL_UNLOADED;
+    }
+    else
+    {
+      //Still loading: a new ticket makes the worker skip it or its result get discarded
+      m_Tickets[cell].fetch_add(1, std::memory_order_relaxed);
+      m_States[cell] = CELL_UNLOADED;
+      m_LoadingCount--;
+    }
+  }
+  m_Active.resize(kept);
+}
+
+void WorldStreamer::takeDecoded(std::vector<DecodedCell>& cells, uint64_t maxBytes)
+{
+  uint64_t taken = 0;
+  std::lock_guard<std::mutex> lock(m_CompletedMutex);
+  while (!m_Completed.empty() && (cells.empty() || taken + m_Completed.front().decoded.bytes <= maxBytes))
+  {
+    Completed completed = std::move(m_Completed.front());
+    m_Completed.pop_front();
+    uint32_t cell = completed.decoded.cell;
+    bool current = m_Tickets[cell].load(std::memory_order_relaxed) == completed.ticket && m_States[cell] == CELL_LOADING;
+
+    m_Stats.readSeconds += completed.readSeconds;
+    if (completed.failed)
+    {
+      m_Stats.readErrors++;
+      if (current)
+      {
+        //Gives up on it until it goes out of range and comes back
+        m_States[cell] = CELL_FAILED;
+        m_LoadingCount--;
+      }
+      continue;
+    }
+
+    m_Stats.bytesRead += completed.decoded.bytes;
+    if (!current)
+    {
+      m_Stats.cellsDiscarded++;
+      continue;
+    }
+    taken += completed.decoded.bytes;
+    cells.push_back(std::move(completed.decoded));
+  }
+}
+
+void WorldStreamer::markResident(uint32_t cell)
+{
+  m_States[cell] = CELL_RESIDENT;
+  m_LoadingCount--;
+  m_ResidentCount++;
+  m_Stats.cellsLoaded++;
+
+  double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - m_RequestedAt[cell]).count();
+  m_Stats.uploadLatencySumMs += latencyMs;
+  m_Stats.uploadLatencyMaxMs = std::max(m_Stats.uploadLatencyMaxMs, latencyMs);
+  m_Stats.uploadLatencySamples++;
+}
+
+void WorldStreamer::markUnloaded(uint32_t cell)
+{
+  if (m_States[cell] == CELL_RESIDENT)
+  {
+    m_ResidentCount--;
+    m_Stats.cellsUnloaded++;
+  }
+  m_States[cell] = CELL_UNLOADED;
+}
+
+void WorldStreamer::shrinkRadius(std::vector<uint32_t>& unload)
+{
+  m_RadiusCells = std::max(m_RadiusCells - 1.0f, 1.0f);
+  collectOutOfRange(m_RadiusCells * m_Index.header.cellSize, unload);
+}
+
+bool WorldStreamer::growRadius()
+{
+  if (m_RadiusCells >= m_MaxRadiusCells)
+  {
+    return false;
+  }
+  //The next update queues the cells that are in range again
+  m_RadiusCells = std::min(m_RadiusCells + 1.0f, m_MaxRadiusCells);
+  return true;
+}
+
+WorldStreamStats WorldStreamer::takeStats()
+{
+  WorldStreamStats stats = m_Stats;
+  m_Stats = {};
+  return stats;
+}
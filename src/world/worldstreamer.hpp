@@ -0,0 +1,123 @@
+#pragma once
+
+#include "worldfile.hpp"
+#include "../utils/math.hpp"
+#include "../utils/threadpool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//How far ahead of the camera's motion cells are prefetched
+#define WORLD_PREFETCH_SECONDS 0.75f
+
+//A cell read and decoded by an I/O worker, waiting for the main thread to upload it
+struct DecodedCell
+{
+  uint32_t cell;
+  MeshData mesh;
+  uint64_t bytes;
+};
+
+struct WorldStreamStats
+{
+  uint64_t bytesRead = 0;
+  //Summed over the workers, so throughput per thread is bytesRead / readSeconds
+  double readSeconds = 0.0;
+  uint32_t cellsLoaded = 0;
+  uint32_t cellsUnloaded = 0;
+  //Finished reading after the camera had already moved on
+  uint32_t cellsDiscarded = 0;
+  uint32_t readErrors = 0;
+  //Request to resident (uploaded and drawn)
+  double uploadLatencySumMs = 0.0;
+  double uploadLatencyMaxMs = 0.0;
+  uint32_t uploadLatencySamples = 0;
+};
+
+//Camera driven streaming of a .vworld. The main thread calls update() every frame with the camera position and
+//velocity: every cell within radius of the camera or of where it will be WORLD_PREFETCH_SECONDS from now is queued
+//on the I/O pool (nearest first), cells more than a cell past radius of both are handed back to be unloaded.
+//Workers only read and decode, the GPU side (uploads, buffers) stays with the caller, which reports back with
+//markResident / markUnloaded. All calls except the workers' own are main thread only.
+class WorldStreamer
+{
+public:
+  //Workers touch the members, they have to be joined first
+  ~WorldStreamer() { m_Pool.stop(); }
+
+  void open(const std::string& filename, uint32_t ioThreads, float radiusCells);
+  void close();
+
+  bool isOpen() const { return !m_Index.cells.empty(); }
+  const WorldIndex& index() const { return m_Index; }
+
+  void update(const Vec3& eye, const Vec3& velocity, std::vector<uint32_t>& unload);
+
+  //Decoded cells still wanted, oldest first, up to maxBytes (always at least one so a big cell can't stall)
+  void takeDecoded(std::vector<DecodedCell>& cells, uint64_t maxBytes);
+
+  void markResident(uint32_t cell);
+  void markUnloaded(uint32_t cell);
+
+  //Memory pressure: shrinks the radius by a cell (not below one) and returns the resident cells now out of range
+  void shrinkRadius(std::vector<uint32_t>& unload);
+  //Pressure is gone: grows it back by a cell, false once it is at the radius open() got again
+  bool growRadius();
+  float radiusCells() const { return m_RadiusCells; }
+
+  uint32_t residentCells() const { return m_ResidentCount; }
+  uint32_t loadingCells() const { return m_LoadingCount; }
+
+  WorldStreamStats takeStats();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  enum CellState : uint8_t
+  {
+    CELL_UNLOADED,
+    CELL_LOADING,
+    CELL_RESIDENT,
+    CELL_FAILED
+  };
+
+  struct Completed
+  {
+    DecodedCell decoded;
+    uint32_t ticket;
+    double readSeconds;
+    bool failed;
+  };
+
+  float distanceToCell(uint32_t cell, float x, float z) const;
+  //Drops every loading or resident cell further than radius from both m_Eye and m_Ahead
+  void collectOutOfRange(float radius, std::vector<uint32_t>& unload);
+
+  std::string m_Filename;
+  WorldIndex m_Index;
+  ThreadPool m_Pool;
+  float m_RadiusCells = 3.0f;
+  float m_MaxRadiusCells = 3.0f;
+
+  std::vector<CellState> m_States;
+  std::vector<Clock::time_point> m_RequestedAt;
+  //Bumped on every request and cancel, a worker's result only counts if its ticket is still the cell's latest
+  std::unique_ptr<std::atomic<uint32_t>[]> m_Tickets;
+  //Cells not unloaded, so the range check doesn't walk the whole grid
+  std::vector<uint32_t> m_Active;
+  uint32_t m_ResidentCount = 0;
+  uint32_t m_LoadingCount = 0;
+  Vec3 m_Eye;
+  Vec3 m_Ahead;
+
+  //Filled by the workers
+  std::mutex m_CompletedMutex;
+  std::deque<Completed> m_Completed;
+
+  WorldStreamStats m_Stats;
+};
@@ -0,0 +1,60 @@
+# One regression scene, run by ctest through cmake -P, see tests/CMakeLists.txt for the variables
+string(REPLACE "|" ";" scene_args "${SCENE_ARGS}")
+set(image ${OUTPUT_DIR}/${SCENE}.ppm)
+set(report ${OUTPUT_DIR}/${SCENE}.txt)
+file(REMOVE ${image} ${report})
+
+# Camera and lights frozen, so every run draws the same frame. No pipeline cache, time to first frame
+# is measured from scratch every time.
+execute_process(
+  COMMAND ${VOLCANO} --headless --device ${DEVICE} --freeze-time 4 --no-pipeline-cache
+          --capture ${image} --capture-after ${FRAMES} --capture-frames 1 --report ${report} ${scene_args}
+  RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "Volcano failed on scene ${SCENE}: ${result}")
+endif()
+if (NOT EXISTS ${image} OR NOT EXISTS ${report})
+  message(FATAL_ERROR "Scene ${SCENE} wrote no capture or report")
+endif()
+
+if ("$ENV{VOLCANO_BLESS}")
+  file(COPY ${image} DESTINATION ${GOLDEN_DIR})
+  file(COPY ${report} DESTINATION ${BASELINE_DIR})
+  message(STATUS "Blessed ${SCENE}: ${GOLDEN_DIR}/${SCENE}.ppm, ${BASELINE_DIR}/${SCENE}.txt")
+  return()
+endif()
+
+set(failed FALSE)
+set(missing "")
+
+if (EXISTS ${GOLDEN_DIR}/${SCENE}.ppm)
+  execute_process(
+    COMMAND ${CHECK} image ${image} ${GOLDEN_DIR}/${SCENE}.ppm ${CHANNEL_TOLERANCE} ${BAD_PIXELS}
+    RESULT_VARIABLE result)
+  if (NOT result EQUAL 0)
+    set(failed TRUE)
+  endif()
+else()
+  list(APPEND missing ${GOLDEN_DIR}/${SCENE}.ppm)
+endif()
+
+if (EXISTS ${BASELINE_DIR}/${SCENE}.txt)
+  execute_process(
+    COMMAND ${CHECK} perf ${report} ${BASELINE_DIR}/${SCENE}.txt ${TIME_THRESHOLD} ${COUNT_THRESHOLD}
+    RESULT_VARIABLE result)
+  if (NOT result EQUAL 0)
+    set(failed TRUE)
+  endif()
+else()
+  list(APPEND missing ${BASELINE_DIR}/${SCENE}.txt)
+endif()
+
+if (failed)
+  message(FATAL_ERROR "Scene ${SCENE} regressed")
+endif()
+# Only reachable with VOLCANO_TEST_UNBLESSED, a failure rather than a skip so a scene can't pass without checking
+# anything
+if (missing)
+  message(FATAL_ERROR "No golden image or baseline for ${SCENE} (${missing}), run with VOLCANO_BLESS=1 on the "
+                      "reference machine and commit them")
+endif()
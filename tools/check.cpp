@@ -0,0 +1,246 @@
+#include "../src/utils/fileread.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Regression checks for the CTest suite, see tests/CMakeLists.txt
+//  volcano-check image <captured.ppm> <golden.ppm> [channel tolerance] [max bad pixel fraction]
+//  volcano-check perf <report.txt> <baseline.txt> [time threshold] [count threshold]
+//Exit code 0 is a pass, anything else a regression or an unreadable input.
+
+#define DEFAULT_CHANNEL_TOLERANCE 8
+#define DEFAULT_BAD_PIXEL_FRACTION 0.001
+#define DEFAULT_TIME_THRESHOLD 0.25
+#define DEFAULT_COUNT_THRESHOLD 0.05
+//Absolute slack on top of the relative thresholds, so a zero baseline or a sub millisecond frame isn't all noise
+#define TIME_SLACK_MS 0.5
+#define COUNT_SLACK 0.5
+
+struct Image
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> rgb;
+};
+
+static size_t readPpmNumber(const std::vector<char>& data, size_t& offset)
+{
+  //Whitespace and # comments between the header fields
+  while (offset < data.size() && (std::isspace(static_cast<unsigned char>(data[offset])) || data[offset] == '#'))
+  {
+    if (data[offset] == '#')
+    {
+      while (offset < data.size() && data[offset] != '\n')
+      {
+        offset++;
+      }
+    }
+    else
+    {
+      offset++;
+    }
+  }
+  size_t value = 0;
+  size_t start = offset;
+  while (offset < data.size() && data[offset] >= '0' && data[offset] <= '9')
+  {
+    value = value * 10 + (data[offset] - '0');
+    offset++;
+  }
+  if (offset == start)
+  {
+    throw std::runtime_error("Malformed PPM header!");
+  }
+  return value;
+}
+
+//Last frame of a binary PPM stream, which is what FrameEncoder writes for anything but .y4m
+static Image loadLastPpm(const std::string& filename)
+{
+  std::vector<char> data = readFile(filename);
+  Image image;
+  size_t offset = 0;
+  while (offset + 2 <= data.size() && data[offset] == 'P' && data[offset + 1] == '6')
+  {
+    offset += 2;
+    image.width = static_cast<uint32_t>(readPpmNumber(data, offset));
+    image.height = static_cast<uint32_t>(readPpmNumber(data, offset));
+    if (readPpmNumber(data, offset) != 255)
+    {
+      throw std::runtime_error("Only 8 bit PPMs are supported: " + filename + "!");
+    }
+    //Exactly one whitespace byte before the pixels
+    offset++;
+
+    size_t bytes = static_cast<size_t>(image.width) * image.height * 3;
+    if (offset + bytes > data.size())
+    {
+      throw std::runtime_error("Truncated PPM: " + filename + "!");
+    }
+    image.rgb.assign(data.begin() + offset, data.begin() + offset + bytes);
+    offset += bytes;
+  }
+  if (image.rgb.empty())
+  {
+    throw std::runtime_error("No PPM frame in " + filename + "!");
+  }
+  return image;
+}
+
+static void writePpm(const std::string& filename, const Image& image)
+{
+  std::ofstream file(filename, std::ios::binary);
+  file << "P6\n" << image.width << " " << image.height << "\n255\n";
+  file.write(reinterpret_cast<const char*>(image.rgb.data()), image.rgb.size());
+}
+
+static int checkImage(const std::string& capturedPath, const std::string& goldenPath, int channelTolerance,
+                      double maxBadFraction)
+{
+  Image captured = loadLastPpm(capturedPath);
+  Image golden = loadLastPpm(goldenPath);
+  if (captured.width != golden.width || captured.height != golden.height)
+  {
+    std::cout << "Size mismatch: " << captured.width << "x" << captured.height << " captured, " << golden.width << "x"
+              << golden.height << " golden" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //Rasterization and float rounding differ a little between lavapipe versions, only count clearly different pixels
+  Image diff = captured;
+  size_t pixels = static_cast<size_t>(captured.width) * captured.height;
+  size_t badPixels = 0;
+  int maxDifference = 0;
+  double squaredError = 0.0;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    int pixelDifference = 0;
+    for (size_t c = 0; c < 3; c++)
+    {
+      int difference = std::abs(captured.rgb[i * 3 + c] - golden.rgb[i * 3 + c]);
+      pixelDifference = std::max(pixelDifference, difference);
+      squaredError += difference * difference;
+      //Amplified so small differences still show up when looking at it
+      diff.rgb[i * 3 + c] = static_cast<uint8_t>(std::min(255, difference * 8));
+    }
+    maxDifference = std::max(maxDifference, pixelDifference);
+    if (pixelDifference > channelTolerance)
+    {
+      badPixels++;
+    }
+  }
+
+  double badFraction = static_cast<double>(badPixels) / pixels;
+  double rmse = std::sqrt(squaredError / (pixels * 3));
+  std::cout << "Image: " << badPixels << " of " << pixels << " pixels off by more than " << channelTolerance
+            << " (" << badFraction * 100.0 << "%, allowed " << maxBadFraction * 100.0 << "%), max difference "
+            << maxDifference << ", RMSE " << rmse << std::endl;
+
+  if (badFraction > maxBadFraction)
+  {
+    std::string diffPath = capturedPath + ".diff.ppm";
+    writePpm(diffPath, diff);
+    std::cout << "Image regression, difference written to " << diffPath << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static std::map<std::string, double> loadMetrics(const std::string& filename)
+{
+  std::ifstream file(filename);
+  if (!file)
+  {
+    throw std::runtime_error("Failed to open " + filename + "!");
+  }
+  std::map<std::string, double> metrics;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream fields(line);
+    std::string name;
+    double value;
+    if (fields >> name >> value)
+    {
+      metrics[name] = value;
+    }
+  }
+  return metrics;
+}
+
+static int checkPerf(const std::string& reportPath, const std::string& baselinePath, double timeThreshold,
+                     double countThreshold)
+{
+  std::map<std::string, double> report = loadMetrics(reportPath);
+  std::map<std::string, double> baseline = loadMetrics(baselinePath);
+
+  //Everything in the report is a cost, see Volcano::writeReport. Only what the baseline has is checked.
+  bool regressed = false;
+  std::cout << std::left << std::setw(32) << "metric" << std::right << std::setw(14) << "baseline" << std::setw(14)
+            << "current" << std::setw(14) << "allowed" << std::endl;
+  for (const auto& entry : baseline)
+  {
+    const std::string& name = entry.first;
+    //How many frames were measured, not a cost
+    if (name == "frames")
+    {
+      continue;
+    }
+
+    auto current = report.find(name);
+    if (current == report.end())
+    {
+      std::cout << std::left << std::setw(32) << name << std::right << " missing from the report" << std::endl;
+      regressed = true;
+      continue;
+    }
+
+    //frame_ms_p95 as well as time_to_first_frame_ms
+    bool timing = name.find("_ms") != std::string::npos;
+    double allowed = timing ? entry.second * (1.0 + timeThreshold) + TIME_SLACK_MS
+                            : entry.second * (1.0 + countThreshold) + COUNT_SLACK;
+    bool failed = current->second > allowed;
+    regressed |= failed;
+    std::cout << std::left << std::setw(32) << name << std::right << std::setw(14) << entry.second << std::setw(14)
+              << current->second << std::setw(14) << allowed << (failed ? "  REGRESSED" : "") << std::endl;
+  }
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 4 || (strcmp(argv[1], "image") != 0 && strcmp(argv[1], "perf") != 0))
+  {
+    std::cerr << "usage: " << argv[0] << " image <captured.ppm> <golden.ppm> [channel tolerance] [max bad pixel fraction]"
+              << std::endl;
+    std::cerr << "       " << argv[0] << " perf <report.txt> <baseline.txt> [time threshold] [count threshold]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    if (strcmp(argv[1], "image") == 0)
+    {
+      int channelTolerance = argc > 4 ? std::atoi(argv[4]) : DEFAULT_CHANNEL_TOLERANCE;
+      double maxBadFraction = argc > 5 ? std::atof(argv[5]) : DEFAULT_BAD_PIXEL_FRACTION;
+      return checkImage(argv[2], argv[3], channelTolerance, maxBadFraction);
+    }
+    double timeThreshold = argc > 4 ? std::atof(argv[4]) : DEFAULT_TIME_THRESHOLD;
+    double countThreshold = argc > 5 ? std::atof(argv[5]) : DEFAULT_COUNT_THRESHOLD;
+    return checkPerf(argv[2], argv[3], timeThreshold, countThreshold);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
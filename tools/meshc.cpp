@@ -0,0 +1,46 @@
+#include "../src/mesh/meshfile.hpp"
+#include "../src/mesh/meshoptimizer.hpp"
+#include "../src/mesh/meshsimplify.hpp"
+#include "../src/mesh/objloader.hpp"
+#include <cstdlib>
+#include <iostream>
+
+//Offline mesh compiler: OBJ in, optimized .vmesh out
+//  volcano-meshc <input.obj> <output.vmesh>
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    std::cerr << "usage: " << argv[0] << " <input.obj> <output.vmesh>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    ImportStats stats;
+    MeshData mesh = loadObj(argv[1], &stats);
+
+    std::cout << "Parsed " << stats.fileBytes << " bytes in " << stats.parseSeconds * 1000.0 << " ms ("
+              << stats.throughputMBs() << " MB/s)" << std::endl;
+    std::cout << "Vertices: " << stats.faceCorners << " corners -> " << mesh.vertices.size() << " unique, "
+              << mesh.indices.size() / 3 << " triangles" << std::endl;
+
+    float acmrBefore = computeACMR(mesh.indices, mesh.vertices.size());
+    optimizeMesh(mesh);
+    float acmrAfter = computeACMR(mesh.indices, mesh.vertices.size());
+
+    std::cout << "ACMR (FIFO " << VERTEX_CACHE_SIZE << "): " << acmrBefore << " -> " << acmrAfter << std::endl;
+
+    buildLodChain(mesh);
+    for (size_t i = 0; i < mesh.lods.size(); i++)
+    {
+      std::cout << "LOD " << i << ": " << mesh.lods[i].indexCount / 3 << " triangles, error " << mesh.lods[i].error << std::endl;
+    }
+
+    writeMeshFile(argv[2], mesh);
+    std::cout << "Wrote " << argv[2] << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}